@@ -28,9 +28,177 @@
 //
 
 #include "PhysicsShapeCache.h"
+#include <algorithm>
+#include <cctype>
+#include <cfloat>
+#include <chrono>
+#include <cstring>
+#include <unordered_set>
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define PSC_QUERY_SSE2 1
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define PSC_QUERY_NEON 1
+#endif
+#if PHYSICSSHAPECACHE_COMPRESSED
+#include "PhysicsShapeInflate.h"
+#if AX_TARGET_PLATFORM == AX_PLATFORM_ANDROID
+#include "platform/android/FileUtils-android.h"
+#include <android/asset_manager.h>
+#endif
+#endif
+
+// red-black tree node of std::map: parent, left, right and color
+static const size_t MAP_NODE_OVERHEAD = 4 * sizeof(void *);
+
+typedef std::chrono::steady_clock LoadClock;
+
+// FNV-1a
+static uint64_t hashBytes(uint64_t hash, const void *data, size_t size)
+{
+    const unsigned char *bytes = (const unsigned char *)data;
+    for (size_t i = 0; i < size; i++)
+    {
+        hash = (hash ^ bytes[i]) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+
+template <typename T>
+static uint64_t hashValue(uint64_t hash, const T &value)
+{
+    return hashBytes(hash, &value, sizeof(value));
+}
+
+
+static const uint64_t HASH_SEED = 14695981039346656037ULL;
+
+// statements for the stats and trace builds, compiled out otherwise
+#if PHYSICSSHAPECACHE_STATS
+#define PSC_STATS(...) __VA_ARGS__
+#else
+#define PSC_STATS(...)
+#endif
+#if PHYSICSSHAPECACHE_TRACE
+#define PSC_TRACE(...) __VA_ARGS__
+#define PSC_TRACE_SCOPE(recorder, name, subject) ShapeCacheTrace::Scope traceScope(recorder, name, subject)
+#else
+#define PSC_TRACE(...)
+#define PSC_TRACE_SCOPE(recorder, name, subject)
+#endif
+
+#if PHYSICSSHAPECACHE_STATS
+typedef LoadClock StatsClock;
+
+static double microsSince(const StatsClock::time_point &start)
+{
+    return std::chrono::duration<double, std::micro>(StatsClock::now() - start).count();
+}
+#endif
+
+
+#if PHYSICSSHAPECACHE_COMPRESSED
+#if AX_TARGET_PLATFORM == AX_PLATFORM_ANDROID
+static size_t readFromAsset(void *asset, void *buffer, size_t size)
+{
+    int count = AAsset_read((AAsset *)asset, buffer, size);
+    return count > 0 ? (size_t)count : 0;
+}
+#endif
+
+
+// Inflates a file written by pe_shape_pack.py compress while the next
+// chunks are read, from the file system or from the APK on Android
+static Data readCompressedFile(const std::string &fullPath)
+{
+    Data data;
+    PhysicsShapePack::CompressedFileReader reader;
+#if AX_TARGET_PLATFORM == AX_PLATFORM_ANDROID
+    AAsset *asset = nullptr;
+    if (!fullPath.empty() && fullPath[0] != '/')
+    {
+        // paths of files in the APK start with "assets/" or "@assets/"
+        std::string relativePath = fullPath;
+        for (const char *prefix : { "assets/", "@assets/" })
+        {
+            if (relativePath.compare(0, strlen(prefix), prefix) == 0)
+            {
+                relativePath.erase(0, strlen(prefix));
+                break;
+            }
+        }
+        asset = AAssetManager_open(FileUtilsAndroid::getAssetManager(), relativePath.c_str(), AASSET_MODE_STREAMING);
+        if (!asset || !reader.open(asset, readFromAsset))
+        {
+            if (asset)
+            {
+                AAsset_close(asset);
+            }
+            return data;
+        }
+    }
+    else
+#endif
+    if (!reader.open(fullPath.c_str()))
+    {
+        return data;
+    }
+
+    size_t size = reader.getContentSize();
+    unsigned char *bytes = (unsigned char *)malloc(std::max<size_t>(size, 1));
+    bool ok = bytes && reader.read(bytes);
+#if AX_TARGET_PLATFORM == AX_PLATFORM_ANDROID
+    if (asset)
+    {
+        AAsset_close(asset);
+    }
+#endif
+    if (!ok)
+    {
+        free(bytes);
+        return data;
+    }
+    data.fastSet(bytes, size);
+    return data;
+}
+#endif
+
+
+// Reads a plist or bundle. With PHYSICSSHAPECACHE_COMPRESSED, .pscz files
+// are inflated straight into the returned buffer, see PhysicsShapeInflate.h
+static Data readShapeFile(const std::string &file)
+{
+    FileUtils *fileUtils = FileUtils::getInstance();
+#if PHYSICSSHAPECACHE_COMPRESSED
+    static const char COMPRESSED_EXTENSION[] = ".pscz";
+    static const size_t EXTENSION_LENGTH = sizeof(COMPRESSED_EXTENSION) - 1;
+
+    if (file.size() > EXTENSION_LENGTH
+        && file.compare(file.size() - EXTENSION_LENGTH, EXTENSION_LENGTH, COMPRESSED_EXTENSION) == 0)
+    {
+        return readCompressedFile(fileUtils->fullPathForFilename(file));
+    }
+#endif
+    return fileUtils->getDataFromFile(file);
+}
 
 
 PhysicsShapeCache::PhysicsShapeCache()
+: memoryBudget(0)
+, releaseCounter(0)
+, loadCounter(0)
+, compactVertexStorage(false)
+, shareIdenticalShapes(true)
+, liveOverrides(false)
+, livePruneThreshold(1024)
+#if PHYSICSSHAPECACHE_TRACE
+, trace("PhysicsShapeCache")
+#endif
+#if PHYSICSSHAPECACHE_STATS
+, stats()
+#endif
 {
 }
 
@@ -38,6 +206,7 @@ PhysicsShapeCache::PhysicsShapeCache()
 PhysicsShapeCache::~PhysicsShapeCache()
 {
     removeAllShapes();
+    setLiveOverridesEnabled(false);
 }
 
 
@@ -56,232 +225,3752 @@ bool PhysicsShapeCache::addShapesWithFile(const std::string &plist)
 
 
 bool PhysicsShapeCache::addShapesWithFile(const std::string &plist, float scaleFactor)
+{
+    return addShapesWithFile(plist, scaleFactor, LOAD_EAGER);
+}
+
+
+bool PhysicsShapeCache::addShapesWithFile(const std::string &plist, float scaleFactor, LoadMode mode)
 {
     AXASSERT(bodiesInFile.find(plist) == bodiesInFile.end(), "file already loaded");
 
-    ValueMap dict = FileUtils::getInstance()->getValueMapFromFile(plist);
-    if (dict.empty())
+    PSC_STATS(auto ioStart = StatsClock::now());
+    PSC_TRACE(auto traceStart = trace.now());
+    Data data = readShapeFile(plist);
+    PSC_TRACE(trace.record("read", plist, traceStart));
+    if (data.isNull())
     {
         // plist file not found
         return false;
     }
+    PSC_STATS(double ioMicros = microsSince(ioStart));
 
-    ValueMap &metadata = dict["metadata"].asValueMap();
-    int format = metadata["format"].asInt();
-    if (format != 1)
+    SharedData *storage = new SharedData();
+    storage->data = std::move(data);
+    bool ok = addShapesWithData(plist, storage, 0, storage->data.getSize(), scaleFactor, mode);
+    storage->release();
+#if PHYSICSSHAPECACHE_STATS
+    if (ok)
     {
-        AXASSERT(format == 1, "format not supported!");
-        return false;
+        stats.files[plist].ioMicros = ioMicros;
     }
+#endif
+    return ok;
+}
 
-    ValueMap &bodydict = dict.at("bodies").asValueMap();
 
-    std::vector<BodyDef*> bodies(bodydict.size());
-    int num=0;
+bool PhysicsShapeCache::addShapesWithFiles(const std::vector<std::string> &plists)
+{
+    return addShapesWithFiles(plists, Director::getInstance()->getContentScaleFactor(), LOAD_EAGER);
+}
 
-    for (auto iter = bodydict.cbegin(); iter != bodydict.cend(); ++iter)
+
+/**
+ * Lets FileUtils read a file into a slice of a larger buffer
+ */
+class SliceBuffer : public ResizableBuffer
+{
+public:
+    SliceBuffer(unsigned char *bytes, size_t capacity)
+    : bytes(bytes)
+    , capacity(capacity)
+    , size(0)
     {
-        const ValueMap &bodyData = iter->second.asValueMap();
-        std::string bodyName = iter->first;
-        BodyDef *bodyDef = new BodyDef();
-        bodies[num++] = bodyDef;
-        bodyDefs.insert(std::make_pair(bodyName, bodyDef));
-        bodyDef->anchorPoint          = PointFromString(bodyData.at("anchorpoint").asString());
-        bodyDef->isDynamic            = bodyData.at("is_dynamic").asBool();
-        bodyDef->affectedByGravity    = bodyData.at("affected_by_gravity").asBool();
-        bodyDef->allowsRotation       = bodyData.at("allows_rotation").asBool();
-        bodyDef->linearDamping        = bodyData.at("linear_damping").asFloat();
-        bodyDef->angularDamping       = bodyData.at("angular_damping").asFloat();
-        bodyDef->velocityLimit        = bodyData.at("velocity_limit").asFloat();
-        bodyDef->angularVelocityLimit = bodyData.at("angular_velocity_limit").asFloat();
-
-        const ValueVector &fixtureList = bodyData.at("fixtures").asValueVector();
-        for (auto &fixtureitem : fixtureList)
-        {
-            FixtureData *fd = new FixtureData();
-            bodyDef->fixtures.push_back(fd);
-            auto &fixturedata = fixtureitem.asValueMap();
-            fd->density         = fixturedata.at("density").asFloat();
-            fd->restitution     = fixturedata.at("restitution").asFloat();
-            fd->friction        = fixturedata.at("friction").asFloat();
-            fd->tag             = fixturedata.at("tag").asInt();
-            fd->group           = fixturedata.at("group").asInt();
-            fd->categoryMask    = fixturedata.at("category_mask").asInt();
-            fd->collisionMask   = fixturedata.at("collision_mask").asInt();
-            fd->contactTestMask = fixturedata.at("contact_test_mask").asInt();
-
-            std::string fixtureType = fixturedata.at("fixture_type").asString();
-            if (fixtureType == "POLYGON")
-            {
-                fd->fixtureType = FIXTURE_POLYGON;
-                const ValueVector &polygonsArray = fixturedata.at("polygons").asValueVector();
-                for (auto &polygonitem : polygonsArray)
-                {
-                    Polygon *poly = new Polygon();
-                    fd->polygons.push_back(poly);
-                    auto &polygonArray = polygonitem.asValueVector();
-                    poly->numVertices = (int)polygonArray.size();
-                    auto *vertices = poly->vertices = new Point[poly->numVertices];
-                    int vindex = 0;
-                    for (auto &pointString : polygonArray)
-                    {
-                        auto offset = PointFromString(pointString.asString());
-                        vertices[vindex].x = offset.x / scaleFactor;
-                        vertices[vindex].y = offset.y / scaleFactor;
-                        vindex++;
-                    }
-                }
-            }
-            else if (fixtureType == "CIRCLE")
-            {
-                fd->fixtureType = FIXTURE_CIRCLE;
-                const ValueMap &circleData = fixturedata.at("circle").asValueMap();
-                fd->radius = circleData.at("radius").asFloat() / scaleFactor;
-                fd->center = PointFromString(circleData.at("position").asString()) / scaleFactor;
-            }
-            else
-            {
-                // unknown type
-                return false;
-            }
+    }
 
+    virtual void resize(size_t newSize) override
+    {
+        // a file that grew since its size was taken is read aside and skipped
+        size = newSize;
+        if (size > capacity)
+        {
+            overflow.resize(size);
         }
     }
 
-    bodiesInFile[plist] = bodies;
+    virtual void *buffer() const override
+    {
+        return size > capacity ? overflow.data() : bytes;
+    }
 
-    return true;
-}
+    unsigned char *bytes;
+    size_t capacity;
+    size_t size;
+    mutable std::vector<unsigned char> overflow;
+};
 
 
-PhysicsShapeCache::BodyDef *PhysicsShapeCache::getBodyDef(const std::string &name)
+bool PhysicsShapeCache::addShapesWithFiles(const std::vector<std::string> &plists, float scaleFactor, LoadMode mode)
 {
-    try
-    {
-        return bodyDefs.at(name);
-    }
-    catch(std::out_of_range&)
+    FileUtils *fileUtils = FileUtils::getInstance();
+    bool ok = true;
+
+    PSC_STATS(auto ioStart = StatsClock::now());
+    PSC_TRACE(auto traceStart = trace.now());
+
+    // sizes first, so that all files go into one allocation; 0 skips a file
+    std::vector<size_t> sizes(plists.size());
+    size_t total = 0;
+    for (size_t i = 0; i < plists.size(); i++)
     {
+        if (bodiesInFile.find(plists[i]) != bodiesInFile.end())
+        {
+            AXLOG("WARNING: shapes \"%s\" are already loaded!", plists[i].c_str());
+            ok = false;
+            continue;
+        }
+        long size = (long)fileUtils->getFileSize(plists[i]);
+        if (size <= 0)
+        {
+            // plist file not found
+            ok = false;
+            continue;
+        }
+        sizes[i] = (size_t)size;
+        total += sizes[i];
     }
 
-    try
+    SharedData *storage = new SharedData();
+    unsigned char *bytes = (unsigned char *)malloc(std::max<size_t>(total, 1));
+    storage->data.fastSet(bytes, total);
+
+    std::vector<size_t> offsets(plists.size());
+    size_t offset = 0;
+    for (size_t i = 0; i < plists.size(); i++)
     {
-        return bodyDefs.at(name.substr(0, name.rfind('.'))); // remove file suffix and try again...
+        if (sizes[i] == 0)
+        {
+            continue;
+        }
+        SliceBuffer buffer(bytes + offset, sizes[i]);
+        if (fileUtils->getContents(plists[i], &buffer) != FileUtils::Status::OK || buffer.size == 0 || buffer.size > sizes[i])
+        {
+            sizes[i] = 0;
+            ok = false;
+            continue;
+        }
+        offsets[i] = offset;
+        sizes[i] = buffer.size;
+        offset += buffer.size;
     }
-    catch(std::out_of_range&)
+
+    PSC_TRACE(trace.record("read", std::to_string(plists.size()) + " files", traceStart));
+    PSC_STATS(double ioMicros = microsSince(ioStart));
+
+    for (size_t i = 0; i < plists.size(); i++)
     {
+        if (sizes[i] == 0)
+        {
+            continue;
+        }
+        if (!addShapesWithData(plists[i], storage, offsets[i], sizes[i], scaleFactor, mode))
+        {
+            ok = false;
+            continue;
+        }
+        // the read is shared, each file gets its part by size
+        PSC_STATS(stats.files[plists[i]].ioMicros = ioMicros * sizes[i] / offset);
     }
+    storage->release();
+    return ok;
+}
 
-    return nullptr;
+
+bool PhysicsShapeCache::addShapesWithBundle(const std::string &bundle)
+{
+    return addShapesWithBundle(bundle, Director::getInstance()->getContentScaleFactor(), LOAD_EAGER);
 }
 
 
-void PhysicsShapeCache::setBodyProperties(PhysicsBody *body, BodyDef *bd)
+static uint32_t readUint32(const unsigned char *p)
 {
-    body->setGravityEnable(bd->affectedByGravity);
-    body->setDynamic(bd->isDynamic);
-    body->setRotationEnable(bd->allowsRotation);
-    body->setLinearDamping(bd->linearDamping);
-    body->setAngularDamping(bd->angularDamping);
-    body->setVelocityLimit(bd->velocityLimit);
-    body->setAngularVelocityLimit(bd->angularVelocityLimit);
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
 }
 
 
-void PhysicsShapeCache::setShapeProperties(PhysicsShape *shape, FixtureData *fd)
+bool PhysicsShapeCache::addShapesWithBundle(const std::string &bundle, float scaleFactor, LoadMode mode)
 {
-    shape->setGroup(fd->group);
-    shape->setCategoryBitmask(fd->categoryMask);
-    shape->setCollisionBitmask(fd->collisionMask);
-    shape->setContactTestBitmask(fd->contactTestMask);
-    shape->setTag(fd->tag);
+    // layout written by pe_shape_pack.py bundle, all numbers little endian uint32:
+    // "PSCBNDL1", number of files, per file: name offset, name length,
+    // data offset, data length, followed by the names and the plist files
+    static const char MAGIC[] = "PSCBNDL1";
+    static const size_t HEADER_SIZE = 12;
+    static const size_t ENTRY_SIZE = 16;
+
+    PSC_STATS(auto ioStart = StatsClock::now());
+    PSC_TRACE(auto traceStart = trace.now());
+    Data data = readShapeFile(bundle);
+    PSC_TRACE(trace.record("read", bundle, traceStart));
+    if (data.isNull())
+    {
+        // bundle not found
+        return false;
+    }
+    PSC_STATS(double ioMicros = microsSince(ioStart));
+
+    SharedData *storage = new SharedData();
+    storage->data = std::move(data);
+    const unsigned char *bytes = storage->data.getBytes();
+    uint64_t size = (uint64_t)storage->data.getSize();
+
+    if (size < HEADER_SIZE || memcmp(bytes, MAGIC, 8) != 0
+        || readUint32(bytes + 8) > (size - HEADER_SIZE) / ENTRY_SIZE)
+    {
+        AXLOG("WARNING: \"%s\" is not a shape bundle!", bundle.c_str());
+        storage->release();
+        return false;
+    }
+
+    bool ok = true;
+    uint32_t numFiles = readUint32(bytes + 8);
+    for (uint32_t i = 0; i < numFiles; i++)
+    {
+        const unsigned char *entry = bytes + HEADER_SIZE + i * ENTRY_SIZE;
+        uint64_t nameOffset = readUint32(entry);
+        uint64_t nameLength = readUint32(entry + 4);
+        uint64_t dataOffset = readUint32(entry + 8);
+        uint64_t dataLength = readUint32(entry + 12);
+        if (nameOffset + nameLength > size || dataOffset + dataLength > size)
+        {
+            AXLOG("WARNING: \"%s\" is not a shape bundle!", bundle.c_str());
+            ok = false;
+            break;
+        }
+
+        std::string plist((const char *)bytes + nameOffset, (size_t)nameLength);
+        if (bodiesInFile.find(plist) != bodiesInFile.end())
+        {
+            AXLOG("WARNING: shapes \"%s\" are already loaded!", plist.c_str());
+            ok = false;
+            continue;
+        }
+        if (!addShapesWithData(plist, storage, (size_t)dataOffset, (size_t)dataLength, scaleFactor, mode))
+        {
+            ok = false;
+            continue;
+        }
+        PSC_STATS(stats.files[plist].ioMicros = ioMicros * dataLength / size);
+    }
+    storage->release();
+    return ok;
 }
 
 
-PhysicsBody *PhysicsShapeCache::createBodyWithName(const std::string &name)
+bool PhysicsShapeCache::addShapesWithData(const std::string &plist, SharedData *storage, size_t offset, size_t size, float scaleFactor, LoadMode mode)
 {
-    BodyDef *bd = getBodyDef(name);
-    if (!bd)
+    PSC_STATS(FileLoadStats fileStats = FileLoadStats());
+    PSC_STATS(auto parseStart = StatsClock::now());
+    PSC_TRACE(auto traceStart = trace.now());
+
+    const char *bytes = (const char *)storage->data.getBytes() + offset;
+    uint64_t contentHash = 0;
+    if (!cacheDirectory.empty())
     {
-        AXLOG("WARNING: PhysicsBody with name \"%s\", not found!", name.c_str());
-        return nullptr; // body not found
+        contentHash = hashBytes(HASH_SEED, bytes, size);
+        bool cached = addShapesFromCache(plist, contentHash, scaleFactor);
+        PSC_TRACE(trace.record("cache", plist, traceStart));
+        PSC_TRACE(traceStart = trace.now());
+        if (cached)
+        {
+            PSC_STATS(stats.files[plist].parseMicros = microsSince(parseStart));
+            return true;
+        }
     }
-    PhysicsBody *body = PhysicsBody::create();
-    setBodyProperties(body, bd);
 
-    for (auto fd : bd->fixtures)
+    if (mode == LOAD_LAZY)
     {
-        PhysicsMaterial material(fd->density, fd->restitution, fd->friction);
-        if (fd->fixtureType == FIXTURE_CIRCLE)
+        bool indexed = indexShapesInData(plist, storage, offset, size, scaleFactor);
+        PSC_TRACE(trace.record("parse", plist, traceStart));
+        if (!indexed)
         {
-            auto shape = PhysicsShapeCircle::create(fd->radius, material, fd->center);
-            setShapeProperties(shape, fd);
-            body->addShape(shape);
+            return false;
         }
-        else if (fd->fixtureType == FIXTURE_POLYGON)
+        PSC_STATS(fileStats.parseMicros = microsSince(parseStart));
+        PSC_STATS(fileStats.numBodies = lazyFiles[plist]->numBodies);
+        PSC_STATS(stats.files[plist] = fileStats);
+        return true;
+    }
+
+    ValueMap dict = FileUtils::getInstance()->getValueMapFromData(bytes, (int)size);
+    PSC_TRACE(trace.record("parse", plist, traceStart));
+    if (dict.empty())
+    {
+        // not a plist file
+        return false;
+    }
+    PSC_STATS(fileStats.parseMicros = microsSince(parseStart));
+    PSC_STATS(auto buildStart = StatsClock::now());
+
+    ValueMap &metadata = dict["metadata"].asValueMap();
+    int format = metadata["format"].asInt();
+    if (format != 1)
+    {
+        AXASSERT(format == 1, "format not supported!");
+        return false;
+    }
+
+    ValueMap &bodydict = dict.at("bodies").asValueMap();
+
+    std::vector<BodyDef*> bodies(bodydict.size());
+    int num=0;
+
+    for (auto iter = bodydict.cbegin(); iter != bodydict.cend(); ++iter)
+    {
+        PSC_TRACE(traceStart = trace.now());
+        BodyDef *bodyDef = createBodyDef(iter->second.asValueMap(), scaleFactor, compactVertexStorage);
+        PSC_TRACE(traceBody("build", iter->first, traceStart, bodyDef));
+        if (!bodyDef)
         {
-            for (auto polygon : fd->polygons)
+            // unknown fixture type
+            for (int i = 0; i < num; i++)
             {
-                auto shape = PhysicsShapePolygon::create(polygon->vertices, polygon->numVertices, material, fd->center);
-                setShapeProperties(shape, fd);
-                body->addShape(shape);
+                releaseBodyDef(bodies[i]);
             }
+            return false;
         }
+        bodies[num++] = bodyDef;
     }
-    return body;
-}
 
+    num = 0;
+    loadCounter++;
+    auto &names = namesInFile[plist];
+    std::vector<std::pair<std::string, BodyDef *>> cacheBodies;
+    for (auto iter = bodydict.cbegin(); iter != bodydict.cend(); ++iter)
+    {
+        if (!cacheDirectory.empty())
+        {
+            cacheBodies.push_back(std::make_pair(iter->first, bodies[num]));
+        }
+        // names already loaded from another file are not replaced
+        BodyDef *bd = bodies[num++];
+        if (isBodyNameTaken(iter->first))
+        {
+            shadowBody(plist, iter->first, bd, nullptr);
+            continue;
+        }
+        auto result = bodyDefs.insert(std::make_pair(iter->first, bd));
+        names.push_back(result.first);
+        indexBodyDef(plist, iter->first, bd);
+    }
+    bodiesInFile[plist] = bodies;
 
-bool PhysicsShapeCache::setBodyOnSprite(const std::string &name, Sprite *sprite)
-{
-    PhysicsBody *body = createBodyWithName(name);
-    if (body)
+    if (!cacheDirectory.empty())
     {
-        sprite->setPhysicsBody(body);
-        sprite->setAnchorPoint(getBodyDef(name)->anchorPoint);
+        writeShapesToCache(plist, contentHash, scaleFactor, cacheBodies);
     }
-    return body != nullptr;
+
+    PSC_STATS(fileStats.buildMicros = microsSince(buildStart));
+    PSC_STATS(fileStats.numBodies = num);
+    PSC_STATS(stats.files[plist] = fileStats);
+
+    return true;
 }
 
 
-void PhysicsShapeCache::removeShapesWithFile(const std::string &plist)
+bool PhysicsShapeCache::addShapesWithPack(const std::string &name, const PhysicsShapePack::PackView &pack)
 {
-    auto bodies = bodiesInFile.at(plist);
-
-    for (auto iter = bodies.begin(); iter != bodies.end(); ++iter)
+    if (bodiesInFile.find(name) != bodiesInFile.end())
     {
-        safeDeleteBodyDef(*iter);
+        AXLOG("WARNING: shapes \"%s\" are already loaded!", name.c_str());
+        return false;
     }
 
-    bodiesInFile.erase(plist);
+    PackFile *file = new PackFile();
+    file->name = name;
+    file->view = pack;
+    file->bodies.resize(pack.numBodies);
+    file->loadNumber = ++loadCounter;
+    packFiles[name] = file;
+    packLoadOrder.push_back(file);
+    bodiesInFile[name] = std::vector<BodyDef *>();
+    indexPack(file);
 
-    return;
+    PSC_STATS(FileLoadStats fileStats = FileLoadStats());
+    PSC_STATS(fileStats.numBodies = (int)pack.numBodies);
+    PSC_STATS(stats.files[name] = fileStats);
+    return true;
 }
 
 
-void PhysicsShapeCache::removeAllShapes()
+void PhysicsShapeCache::setBinaryCacheDirectory(const std::string &directory)
 {
-    for (auto iter = bodyDefs.cbegin(); iter != bodyDefs.cend(); ++iter)
+    cacheDirectory = directory;
+    if (!cacheDirectory.empty() && cacheDirectory.back() != '/')
     {
-        safeDeleteBodyDef(iter->second);
+        cacheDirectory += '/';
     }
-    bodyDefs.clear();
-    bodiesInFile.clear();
 }
 
 
-void PhysicsShapeCache::safeDeleteBodyDef(BodyDef *bodyDef)
+/**
+ * Header of a binary cache file. It is followed by the name offsets,
+ * bodies, fixtures, polygons, vertices and names of a shape pack in the
+ * layout of the running build; the version guards against changes.
+ */
+struct CacheHeader
 {
-    for (auto fixturedata : bodyDef->fixtures)
+    char magic[8];
+    uint32_t version;
+    float scaleFactor;
+    uint64_t contentHash; // of the plist file
+    uint32_t numBodies;
+    uint32_t numFixtures;
+    uint32_t numPolygons;
+    uint32_t numVertices;
+    uint32_t namesSize;
+    uint32_t reserved;
+};
+
+static const char CACHE_MAGIC[8] = { 'P', 'S', 'C', 'C', 'A', 'C', 'H', 'E' };
+
+// increase when createBodyDef() or the pack records change
+static const uint32_t CACHE_VERSION = 1;
+
+
+static size_t cacheFileSize(const CacheHeader &header)
+{
+    return sizeof(CacheHeader)
+         + header.numBodies * (sizeof(uint32_t) + sizeof(PhysicsShapePack::Body))
+         + header.numFixtures * sizeof(PhysicsShapePack::Fixture)
+         + header.numPolygons * sizeof(PhysicsShapePack::Polygon)
+         + header.numVertices * sizeof(PhysicsShapePack::Vertex)
+         + header.namesSize;
+}
+
+
+std::string PhysicsShapeCache::getCachePath(const std::string &plist, float scaleFactor) const
+{
+    // one entry per file and scale, replaced when the file changes
+    uint64_t key = hashValue(hashBytes(HASH_SEED, plist.data(), plist.size()), scaleFactor);
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx.pscc", (unsigned long long)key);
+    return cacheDirectory + name;
+}
+
+
+bool PhysicsShapeCache::addShapesFromCache(const std::string &plist, uint64_t contentHash, float scaleFactor)
+{
+    FileUtils *fileUtils = FileUtils::getInstance();
+    std::string path = getCachePath(plist, scaleFactor);
+    if (!fileUtils->isFileExist(path))
+    {
+        return false;
+    }
+
+    Data data = fileUtils->getDataFromFile(path);
+    const unsigned char *bytes = data.getBytes();
+    CacheHeader header;
+    if (data.getSize() < (ssize_t)sizeof(header))
     {
-        for (auto polygon : fixturedata->polygons)
+        return false;
+    }
+    memcpy(&header, bytes, sizeof(header));
+    if (memcmp(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0
+        || header.version != CACHE_VERSION
+        || header.scaleFactor != scaleFactor
+        || header.contentHash != contentHash)
+    {
+        // stale, the plist is parsed and the entry replaced
+        return false;
+    }
+    if (header.numBodies > (uint32_t)data.getSize() || header.numFixtures > (uint32_t)data.getSize()
+        || header.numPolygons > (uint32_t)data.getSize() || header.numVertices > (uint32_t)data.getSize()
+        || cacheFileSize(header) != (size_t)data.getSize() || header.namesSize == 0 || bytes[data.getSize() - 1] != 0)
+    {
+        AXLOG("WARNING: damaged shape cache \"%s\"", path.c_str());
+        return false;
+    }
+
+    PhysicsShapePack::PackView view = PhysicsShapePack::PackView();
+    const unsigned char *p = bytes + sizeof(header);
+    view.numBodies = header.numBodies;
+    view.nameOffsets = (const uint32_t *)p;
+    p += header.numBodies * sizeof(uint32_t);
+    view.bodies = (const PhysicsShapePack::Body *)p;
+    p += header.numBodies * sizeof(PhysicsShapePack::Body);
+    view.fixtures = (const PhysicsShapePack::Fixture *)p;
+    p += header.numFixtures * sizeof(PhysicsShapePack::Fixture);
+    view.polygons = (const PhysicsShapePack::Polygon *)p;
+    p += header.numPolygons * sizeof(PhysicsShapePack::Polygon);
+    view.vertices = (const PhysicsShapePack::Vertex *)p;
+    p += header.numVertices * sizeof(PhysicsShapePack::Vertex);
+    view.names = (const char *)p;
+
+    // a damaged file must not make createBodyDefFromPack() read out of bounds
+    for (uint32_t i = 0; i < header.numBodies; i++)
+    {
+        const PhysicsShapePack::Body &body = view.bodies[i];
+        if (view.nameOffsets[i] >= header.namesSize
+            || (uint64_t)body.firstFixture + body.numFixtures > header.numFixtures)
         {
-            AX_SAFE_DELETE_ARRAY(polygon->vertices);
-            AX_SAFE_DELETE(polygon);
+            AXLOG("WARNING: damaged shape cache \"%s\"", path.c_str());
+            return false;
         }
-        fixturedata->polygons.clear();
-        AX_SAFE_DELETE(fixturedata);
     }
-    bodyDef->fixtures.clear();
-    AX_SAFE_DELETE(bodyDef);
+    for (uint32_t i = 0; i < header.numFixtures; i++)
+    {
+        const PhysicsShapePack::Fixture &fixture = view.fixtures[i];
+        if ((uint64_t)fixture.firstPolygon + fixture.numPolygons > header.numPolygons)
+        {
+            AXLOG("WARNING: damaged shape cache \"%s\"", path.c_str());
+            return false;
+        }
+    }
+    for (uint32_t i = 0; i < header.numPolygons; i++)
+    {
+        const PhysicsShapePack::Polygon &polygon = view.polygons[i];
+        if ((uint64_t)polygon.firstVertex + polygon.numVertices > header.numVertices)
+        {
+            AXLOG("WARNING: damaged shape cache \"%s\"", path.c_str());
+            return false;
+        }
+    }
+
+    if (!addShapesWithPack(plist, view))
+    {
+        return false;
+    }
+    // the view points into the moved buffer
+    packFiles[plist]->data = std::move(data);
+    return true;
+}
+
+
+void PhysicsShapeCache::writeShapesToCache(const std::string &plist, uint64_t contentHash, float scaleFactor, std::vector<std::pair<std::string, BodyDef *>> &bodies)
+{
+    // byte order of names, as findBody() expects
+    std::sort(bodies.begin(), bodies.end(), [](const std::pair<std::string, BodyDef *> &a, const std::pair<std::string, BodyDef *> &b) {
+        return a.first < b.first;
+    });
+
+    std::vector<uint32_t> nameOffsets;
+    std::vector<PhysicsShapePack::Body> packBodies;
+    std::vector<PhysicsShapePack::Fixture> packFixtures;
+    std::vector<PhysicsShapePack::Polygon> packPolygons;
+    std::vector<PhysicsShapePack::Vertex> packVertices;
+    std::string names;
+    const FixtureColumns &base = fixtureTable.base;
+
+    for (auto &entry : bodies)
+    {
+        const BodyDef *bd = entry.second;
+        nameOffsets.push_back((uint32_t)names.size());
+        names.append(entry.first);
+        names.push_back('\0');
+
+        PhysicsShapePack::Body body = PhysicsShapePack::Body();
+        body.anchorX              = bd->anchorPoint.x;
+        body.anchorY              = bd->anchorPoint.y;
+        body.flags                = (bd->isDynamic ? PhysicsShapePack::BODY_DYNAMIC : 0)
+                                  | (bd->affectedByGravity ? PhysicsShapePack::BODY_AFFECTED_BY_GRAVITY : 0)
+                                  | (bd->allowsRotation ? PhysicsShapePack::BODY_ALLOWS_ROTATION : 0);
+        body.linearDamping        = bd->linearDamping;
+        body.angularDamping       = bd->angularDamping;
+        body.velocityLimit        = bd->velocityLimit;
+        body.angularVelocityLimit = bd->angularVelocityLimit;
+        body.firstFixture         = (uint32_t)packFixtures.size();
+        body.numFixtures          = (uint32_t)bd->fixtures.size();
+        packBodies.push_back(body);
+
+        const Point *quantized = bd->quantizedVertices ? dequantizeVertices(bd) : nullptr;
+        for (auto fd : bd->fixtures)
+        {
+            PhysicsShapePack::Fixture fixture = PhysicsShapePack::Fixture();
+            fixture.fixtureType     = fd->fixtureType == FIXTURE_CIRCLE ? PhysicsShapePack::FIXTURE_CIRCLE : PhysicsShapePack::FIXTURE_POLYGON;
+            fixture.density         = base.density[fd->row];
+            fixture.restitution     = base.restitution[fd->row];
+            fixture.friction        = base.friction[fd->row];
+            fixture.tag             = base.tag[fd->row];
+            fixture.group           = base.group[fd->row];
+            fixture.categoryMask    = (uint32_t)base.categoryMask[fd->row];
+            fixture.collisionMask   = (uint32_t)base.collisionMask[fd->row];
+            fixture.contactTestMask = (uint32_t)base.contactTestMask[fd->row];
+            fixture.centerX         = fd->center.x;
+            fixture.centerY         = fd->center.y;
+            fixture.radius          = fd->radius;
+            fixture.firstPolygon    = (uint32_t)packPolygons.size();
+            fixture.numPolygons     = (uint32_t)fd->polygons.size();
+            packFixtures.push_back(fixture);
+
+            for (auto poly : fd->polygons)
+            {
+                PhysicsShapePack::Polygon polygon;
+                polygon.firstVertex = (uint32_t)packVertices.size();
+                polygon.numVertices = (uint32_t)poly->numVertices;
+                packPolygons.push_back(polygon);
+
+                const Point *vertices = poly->vertices ? poly->vertices : quantized + poly->firstVertex;
+                for (int i = 0; i < poly->numVertices; i++)
+                {
+                    PhysicsShapePack::Vertex vertex = { vertices[i].x, vertices[i].y };
+                    packVertices.push_back(vertex);
+                }
+            }
+        }
+    }
+
+    CacheHeader header = CacheHeader();
+    memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+    header.version     = CACHE_VERSION;
+    header.scaleFactor = scaleFactor;
+    header.contentHash = contentHash;
+    header.numBodies   = (uint32_t)packBodies.size();
+    header.numFixtures = (uint32_t)packFixtures.size();
+    header.numPolygons = (uint32_t)packPolygons.size();
+    header.numVertices = (uint32_t)packVertices.size();
+    header.namesSize   = (uint32_t)names.size();
+
+    size_t size = cacheFileSize(header);
+    unsigned char *bytes = (unsigned char *)malloc(size);
+    unsigned char *p = bytes;
+    memcpy(p, &header, sizeof(header));
+    p += sizeof(header);
+    memcpy(p, nameOffsets.data(), nameOffsets.size() * sizeof(uint32_t));
+    p += nameOffsets.size() * sizeof(uint32_t);
+    memcpy(p, packBodies.data(), packBodies.size() * sizeof(PhysicsShapePack::Body));
+    p += packBodies.size() * sizeof(PhysicsShapePack::Body);
+    memcpy(p, packFixtures.data(), packFixtures.size() * sizeof(PhysicsShapePack::Fixture));
+    p += packFixtures.size() * sizeof(PhysicsShapePack::Fixture);
+    memcpy(p, packPolygons.data(), packPolygons.size() * sizeof(PhysicsShapePack::Polygon));
+    p += packPolygons.size() * sizeof(PhysicsShapePack::Polygon);
+    memcpy(p, packVertices.data(), packVertices.size() * sizeof(PhysicsShapePack::Vertex));
+    p += packVertices.size() * sizeof(PhysicsShapePack::Vertex);
+    memcpy(p, names.data(), names.size());
+
+    Data data;
+    data.fastSet(bytes, size);
+    FileUtils *fileUtils = FileUtils::getInstance();
+    if (!fileUtils->isDirectoryExist(cacheDirectory))
+    {
+        fileUtils->createDirectory(cacheDirectory);
+    }
+    if (!fileUtils->writeDataToFile(data, getCachePath(plist, scaleFactor)))
+    {
+        AXLOG("WARNING: could not write the shape cache of \"%s\"", plist.c_str());
+    }
+}
+
+
+PhysicsShapeCache::BodyDef *PhysicsShapeCache::createBodyDefFromPack(const PhysicsShapePack::PackView &pack, int index)
+{
+    static_assert(sizeof(PhysicsShapePack::Vertex) == sizeof(Point), "pack vertices are used as Points");
+
+    const PhysicsShapePack::Body &body = pack.bodies[index];
+    BodyDef *bodyDef = new BodyDef();
+    bodyDef->refCount             = 1;
+    bodyDef->anchorPoint          = Point(body.anchorX, body.anchorY);
+    bodyDef->isDynamic            = (body.flags & PhysicsShapePack::BODY_DYNAMIC) != 0;
+    bodyDef->affectedByGravity    = (body.flags & PhysicsShapePack::BODY_AFFECTED_BY_GRAVITY) != 0;
+    bodyDef->allowsRotation       = (body.flags & PhysicsShapePack::BODY_ALLOWS_ROTATION) != 0;
+    bodyDef->linearDamping        = body.linearDamping;
+    bodyDef->angularDamping       = body.angularDamping;
+    bodyDef->velocityLimit        = body.velocityLimit;
+    bodyDef->angularVelocityLimit = body.angularVelocityLimit;
+
+    for (uint32_t i = 0; i < body.numFixtures; i++)
+    {
+        const PhysicsShapePack::Fixture &fixture = pack.fixtures[body.firstFixture + i];
+        FixtureData *fd = new FixtureData();
+        fd->refCount = 1;
+        bodyDef->fixtures.push_back(fd);
+        fd->fixtureType     = fixture.fixtureType == PhysicsShapePack::FIXTURE_CIRCLE ? FIXTURE_CIRCLE : FIXTURE_POLYGON;
+        fd->center          = Point(fixture.centerX, fixture.centerY);
+        fd->radius          = fixture.radius;
+
+        fd->row = fixtureTable.addRow();
+        FixtureColumns &base = fixtureTable.base;
+        base.density[fd->row]         = fixture.density;
+        base.restitution[fd->row]     = fixture.restitution;
+        base.friction[fd->row]        = fixture.friction;
+        base.tag[fd->row]             = fixture.tag;
+        base.group[fd->row]           = fixture.group;
+        base.categoryMask[fd->row]    = (int)fixture.categoryMask;
+        base.collisionMask[fd->row]   = (int)fixture.collisionMask;
+        base.contactTestMask[fd->row] = (int)fixture.contactTestMask;
+        applyOverrideLayers(fd->row, fd->row + 1);
+
+        for (uint32_t j = 0; j < fixture.numPolygons; j++)
+        {
+            const PhysicsShapePack::Polygon &polygon = pack.polygons[fixture.firstPolygon + j];
+            Polygon *poly = new Polygon();
+            poly->refCount = 1;
+            poly->externalVertices = true;
+            poly->numVertices = (int)polygon.numVertices;
+            // both are two floats, the shapes only read them
+            poly->vertices = reinterpret_cast<Point *>(const_cast<PhysicsShapePack::Vertex *>(pack.vertices + polygon.firstVertex));
+            fd->polygons.push_back(poly);
+        }
+    }
+
+    // pack bodies are not shared, their geometry takes no heap memory
+    return bodyDef;
+}
+
+
+PhysicsShapeCache::BodyDef *PhysicsShapeCache::createBodyDef(const ValueMap &bodyData, float scaleFactor, bool compact)
+{
+    BodyDef *bodyDef = new BodyDef();
+    bodyDef->refCount             = 1;
+    bodyDef->anchorPoint          = PointFromString(bodyData.at("anchorpoint").asString());
+    bodyDef->isDynamic            = bodyData.at("is_dynamic").asBool();
+    bodyDef->affectedByGravity    = bodyData.at("affected_by_gravity").asBool();
+    bodyDef->allowsRotation       = bodyData.at("allows_rotation").asBool();
+    bodyDef->linearDamping        = bodyData.at("linear_damping").asFloat();
+    bodyDef->angularDamping       = bodyData.at("angular_damping").asFloat();
+    bodyDef->velocityLimit        = bodyData.at("velocity_limit").asFloat();
+    bodyDef->angularVelocityLimit = bodyData.at("angular_velocity_limit").asFloat();
+
+    const ValueVector &fixtureList = bodyData.at("fixtures").asValueVector();
+    for (auto &fixtureitem : fixtureList)
+    {
+        FixtureData *fd = new FixtureData();
+        fd->refCount = 1;
+        bodyDef->fixtures.push_back(fd);
+        auto &fixturedata = fixtureitem.asValueMap();
+        fd->row = fixtureTable.addRow();
+        FixtureColumns &base = fixtureTable.base;
+        base.density[fd->row]         = fixturedata.at("density").asFloat();
+        base.restitution[fd->row]     = fixturedata.at("restitution").asFloat();
+        base.friction[fd->row]        = fixturedata.at("friction").asFloat();
+        base.tag[fd->row]             = fixturedata.at("tag").asInt();
+        base.group[fd->row]           = fixturedata.at("group").asInt();
+        base.categoryMask[fd->row]    = fixturedata.at("category_mask").asInt();
+        base.collisionMask[fd->row]   = fixturedata.at("collision_mask").asInt();
+        base.contactTestMask[fd->row] = fixturedata.at("contact_test_mask").asInt();
+        applyOverrideLayers(fd->row, fd->row + 1);
+
+        std::string fixtureType = fixturedata.at("fixture_type").asString();
+        if (fixtureType == "POLYGON")
+        {
+            fd->fixtureType = FIXTURE_POLYGON;
+            const ValueVector &polygonsArray = fixturedata.at("polygons").asValueVector();
+            for (auto &polygonitem : polygonsArray)
+            {
+                Polygon *poly = new Polygon();
+                poly->refCount = 1;
+                fd->polygons.push_back(poly);
+                auto &polygonArray = polygonitem.asValueVector();
+                poly->numVertices = (int)polygonArray.size();
+                auto *vertices = poly->vertices = new Point[poly->numVertices];
+                int vindex = 0;
+                for (auto &pointString : polygonArray)
+                {
+                    auto offset = PointFromString(pointString.asString());
+                    vertices[vindex].x = offset.x / scaleFactor;
+                    vertices[vindex].y = offset.y / scaleFactor;
+                    vindex++;
+                }
+            }
+        }
+        else if (fixtureType == "CIRCLE")
+        {
+            fd->fixtureType = FIXTURE_CIRCLE;
+            const ValueMap &circleData = fixturedata.at("circle").asValueMap();
+            fd->radius = circleData.at("radius").asFloat() / scaleFactor;
+            fd->center = PointFromString(circleData.at("position").asString()) / scaleFactor;
+        }
+        else
+        {
+            // unknown type
+            releaseBodyDef(bodyDef);
+            return nullptr;
+        }
+    }
+
+    if (compact)
+    {
+        quantizeVertices(bodyDef);
+    }
+    return shareIdenticalShapes ? shareBodyDef(bodyDef) : bodyDef;
+}
+
+
+void PhysicsShapeCache::quantizeVertices(BodyDef *bd)
+{
+    int total = 0;
+    Point lo(FLT_MAX, FLT_MAX);
+    Point hi(-FLT_MAX, -FLT_MAX);
+    for (auto fd : bd->fixtures)
+    {
+        for (auto polygon : fd->polygons)
+        {
+            for (int i = 0; i < polygon->numVertices; i++)
+            {
+                lo.x = std::min(lo.x, polygon->vertices[i].x);
+                lo.y = std::min(lo.y, polygon->vertices[i].y);
+                hi.x = std::max(hi.x, polygon->vertices[i].x);
+                hi.y = std::max(hi.y, polygon->vertices[i].y);
+            }
+            total += polygon->numVertices;
+        }
+    }
+    if (total == 0)
+    {
+        return;
+    }
+
+    bd->quantizedOrigin = lo;
+    bd->quantizedStep = Point((hi.x - lo.x) / 65535.0f, (hi.y - lo.y) / 65535.0f);
+    bd->quantizedVertices = new uint16_t[total * 2];
+    bd->numQuantizedVertices = total;
+
+    float scaleX = bd->quantizedStep.x > 0 ? 1.0f / bd->quantizedStep.x : 0.0f;
+    float scaleY = bd->quantizedStep.y > 0 ? 1.0f / bd->quantizedStep.y : 0.0f;
+    uint16_t *q = bd->quantizedVertices;
+    int index = 0;
+    for (auto fd : bd->fixtures)
+    {
+        for (auto polygon : fd->polygons)
+        {
+            polygon->firstVertex = index;
+            for (int i = 0; i < polygon->numVertices; i++, index++)
+            {
+                float x = (polygon->vertices[i].x - lo.x) * scaleX + 0.5f;
+                float y = (polygon->vertices[i].y - lo.y) * scaleY + 0.5f;
+                q[index * 2]     = (uint16_t)std::min(x, 65535.0f);
+                q[index * 2 + 1] = (uint16_t)std::min(y, 65535.0f);
+            }
+            AX_SAFE_DELETE_ARRAY(polygon->vertices);
+        }
+    }
+}
+
+
+const Point *PhysicsShapeCache::dequantizeVertices(const BodyDef *bd)
+{
+    int count = bd->numQuantizedVertices;
+    if (vertexBuffer.size() < (size_t)count)
+    {
+        vertexBuffer.resize(count);
+    }
+
+    // one flat pass over all vertices of the body, vectorized by the compiler
+    const uint16_t *q = bd->quantizedVertices;
+    const float originX = bd->quantizedOrigin.x, originY = bd->quantizedOrigin.y;
+    const float stepX = bd->quantizedStep.x, stepY = bd->quantizedStep.y;
+    Point *out = vertexBuffer.data();
+    for (int i = 0; i < count; i++)
+    {
+        out[i].x = originX + stepX * q[i * 2];
+        out[i].y = originY + stepY * q[i * 2 + 1];
+    }
+    return out;
+}
+
+
+float PhysicsShapeCache::getQuantizationError(const std::string &name)
+{
+    BodyDef *bd = getBodyDef(name);
+    if (!bd || !bd->quantizedVertices)
+    {
+        return 0.0f;
+    }
+    const Point &lo = bd->quantizedOrigin;
+    Point hi = lo + bd->quantizedStep * 65535.0f;
+    float errorX = bd->quantizedStep.x * 0.5f + 2 * FLT_EPSILON * std::max(fabsf(lo.x), fabsf(hi.x));
+    float errorY = bd->quantizedStep.y * 0.5f + 2 * FLT_EPSILON * std::max(fabsf(lo.y), fabsf(hi.y));
+    return std::max(errorX, errorY);
+}
+
+
+/**
+ * Minimal scanner for plist files written by PhysicsEditor.
+ * Locates the elements of a dictionary without creating Values,
+ * so that single bodies can be decoded later on.
+ */
+class PlistScanner
+{
+public:
+    PlistScanner(const char *begin, const char *end) : pos(begin), start(begin), end(end) {}
+
+    size_t offset() const { return pos - start; }
+
+    // skips whitespace, the xml declaration, doctype and comments
+    void skipMisc()
+    {
+        for (;;)
+        {
+            while (pos < end && isspace((unsigned char)*pos))
+            {
+                pos++;
+            }
+            if (lookingAt("<?"))
+            {
+                skipPast("?>");
+            }
+            else if (lookingAt("<!"))
+            {
+                skipPast(">");
+            }
+            else
+            {
+                return;
+            }
+        }
+    }
+
+    bool lookingAt(const char *tag) const
+    {
+        size_t len = strlen(tag);
+        return (size_t)(end - pos) >= len && memcmp(pos, tag, len) == 0;
+    }
+
+    bool expect(const char *tag)
+    {
+        skipMisc();
+        if (!lookingAt(tag))
+        {
+            return false;
+        }
+        pos += strlen(tag);
+        return true;
+    }
+
+    // accepts an opening tag with any attributes, e.g. <plist version="1.0">
+    bool expectOpening(const char *name)
+    {
+        if (!expect(name) || (pos < end && *pos != '>' && !isspace((unsigned char)*pos)))
+        {
+            return false;
+        }
+        skipPast(">");
+        return true;
+    }
+
+    // reads "<key>...</key>" and decodes the predefined xml entities
+    bool readKey(std::string &key)
+    {
+        if (!expect("<key>"))
+        {
+            return false;
+        }
+        key.clear();
+        while (pos < end && *pos != '<')
+        {
+            if (*pos == '&')
+            {
+                static const char *entities[][2] = {
+                    { "&amp;", "&" }, { "&lt;", "<" }, { "&gt;", ">" }, { "&quot;", "\"" }, { "&apos;", "'" }
+                };
+                bool found = false;
+                for (auto &entity : entities)
+                {
+                    if (lookingAt(entity[0]))
+                    {
+                        key += entity[1];
+                        pos += strlen(entity[0]);
+                        found = true;
+                        break;
+                    }
+                }
+                if (!found)
+                {
+                    return false;
+                }
+            }
+            else
+            {
+                key += *pos++;
+            }
+        }
+        return expect("</key>");
+    }
+
+    // skips one element including all children, returns false on malformed input
+    bool skipElement()
+    {
+        skipMisc();
+        int depth = 0;
+        do
+        {
+            if (pos >= end || *pos != '<')
+            {
+                return false;
+            }
+            const char *close = (const char *)memchr(pos, '>', end - pos);
+            if (!close)
+            {
+                return false;
+            }
+            if (pos[1] == '/')
+            {
+                depth--;
+            }
+            else if (close[-1] != '/' && pos[1] != '!' && pos[1] != '?')
+            {
+                depth++;
+            }
+            pos = close + 1;
+
+            // character data never contains '<'
+            const char *next = (const char *)memchr(pos, '<', end - pos);
+            if (depth > 0)
+            {
+                pos = next ? next : end;
+            }
+        } while (depth > 0);
+        return true;
+    }
+
+private:
+    void skipPast(const char *marker)
+    {
+        size_t len = strlen(marker);
+        while (pos < end && !lookingAt(marker))
+        {
+            pos++;
+        }
+        pos = std::min(end, pos + len);
+    }
+
+    const char *pos;
+    const char *start;
+    const char *end;
+};
+
+
+/**
+ * Parses a single dictionary from a plist file
+ */
+static ValueMap valueMapFromRange(const char *data, size_t offset, size_t length)
+{
+    std::string document = "<plist version=\"1.0\">";
+    document.append(data + offset, length);
+    document += "</plist>";
+    return FileUtils::getInstance()->getValueMapFromData(document.c_str(), (int)document.size());
+}
+
+
+/**
+ * Builds the body index of a lazily loaded file, a few bodies at a time
+ */
+class PhysicsShapeCache::FileIndexer
+{
+public:
+    typedef enum
+    {
+        INDEX_RUNNING,
+        INDEX_DONE,
+        INDEX_NOT_PLIST,
+        INDEX_INVALID,
+        INDEX_FORMAT_NOT_SUPPORTED
+    } Result;
+
+    FileIndexer(const std::string &plist, SharedData *storage, size_t offset, size_t size, float scaleFactor, bool compact)
+    : file(new LazyFile())
+    , scanner(nullptr, nullptr)
+    , state(STATE_START)
+    , formatOk(false)
+    {
+        storage->retain();
+        file->plist = plist;
+        file->storage = storage;
+        file->bytes = (const char *)storage->data.getBytes() + offset;
+        file->size = size;
+        file->scaleFactor = scaleFactor;
+        file->compact = compact;
+        file->numBodies = 0;
+        scanner = PlistScanner(file->bytes, file->bytes + size);
+    }
+
+    ~FileIndexer()
+    {
+        delete file; // unless taken by registerLazyFile()
+    }
+
+    // indexes bodies until the file is complete or the deadline has passed
+    Result step(const LoadClock::time_point &deadline)
+    {
+        const char *bytes = file->bytes;
+        do
+        {
+            if (state == STATE_START)
+            {
+                if (!scanner.expectOpening("<plist") || !scanner.expect("<dict>"))
+                {
+                    return INDEX_NOT_PLIST;
+                }
+                state = STATE_TOP;
+            }
+            else if (state == STATE_TOP)
+            {
+                if (!scanner.readKey(key))
+                {
+                    if (!scanner.expect("</dict>"))
+                    {
+                        return INDEX_INVALID;
+                    }
+                    return formatOk ? INDEX_DONE : INDEX_FORMAT_NOT_SUPPORTED;
+                }
+                scanner.skipMisc();
+                size_t valueStart = scanner.offset();
+                if (key == "bodies")
+                {
+                    if (!scanner.expect("<dict>"))
+                    {
+                        return INDEX_INVALID;
+                    }
+                    state = STATE_BODIES;
+                }
+                else if (!scanner.skipElement())
+                {
+                    return INDEX_INVALID;
+                }
+                else if (key == "metadata")
+                {
+                    ValueMap metadata = valueMapFromRange(bytes, valueStart, scanner.offset() - valueStart);
+                    formatOk = metadata["format"].asInt() == 1;
+                }
+            }
+            else
+            {
+                if (!scanner.readKey(key))
+                {
+                    if (!scanner.expect("</dict>"))
+                    {
+                        return INDEX_INVALID;
+                    }
+                    state = STATE_TOP;
+                    continue;
+                }
+                scanner.skipMisc();
+                LazyBody body;
+                body.file = file;
+                body.offset = scanner.offset();
+                if (!scanner.skipElement())
+                {
+                    return INDEX_INVALID;
+                }
+                body.length = scanner.offset() - body.offset;
+                index.push_back(std::make_pair(key, body));
+            }
+        } while (LoadClock::now() < deadline);
+        return INDEX_RUNNING;
+    }
+
+    // fraction of the file scanned
+    float getProgress() const
+    {
+        size_t size = file ? file->size : 0;
+        return size ? (float)scanner.offset() / size : 1.0f;
+    }
+
+    LazyFile *file;
+    std::vector<std::pair<std::string, LazyBody>> index;
+
+private:
+    enum
+    {
+        STATE_START,
+        STATE_TOP,     // in the top level dictionary
+        STATE_BODIES   // in the bodies dictionary
+    };
+
+    PlistScanner scanner;
+    int state;
+    bool formatOk;
+    std::string key;
+};
+
+
+bool PhysicsShapeCache::registerLazyFile(FileIndexer &indexer, int result)
+{
+    if (result == FileIndexer::INDEX_NOT_PLIST)
+    {
+        // not a plist file
+        return false;
+    }
+    if (result == FileIndexer::INDEX_INVALID)
+    {
+        AXLOG("WARNING: \"%s\" is not a valid PhysicsEditor plist file!", indexer.file->plist.c_str());
+        return false;
+    }
+    if (result == FileIndexer::INDEX_FORMAT_NOT_SUPPORTED)
+    {
+        AXASSERT(false, "format not supported!");
+        return false;
+    }
+
+    LazyFile *file = indexer.file;
+    indexer.file = nullptr;
+    file->numBodies = (int)indexer.index.size();
+    file->numUndecoded = file->numBodies;
+    if (file->numUndecoded == 0)
+    {
+        file->releaseStorage();
+    }
+    lazyFiles[file->plist] = file;
+    loadCounter++;
+    for (auto &entry : indexer.index)
+    {
+        // names already loaded from another file are not replaced
+        if (isBodyNameTaken(entry.first))
+        {
+            shadowBody(file->plist, entry.first, nullptr, &entry.second);
+            continue;
+        }
+        lazyBodies.insert(entry);
+        indexLazyBody(file->plist, entry.first, entry.second);
+    }
+    bodiesInFile[file->plist] = std::vector<BodyDef *>();
+    return true;
+}
+
+
+bool PhysicsShapeCache::indexShapesInData(const std::string &plist, SharedData *storage, size_t offset, size_t size, float scaleFactor)
+{
+    FileIndexer indexer(plist, storage, offset, size, scaleFactor, compactVertexStorage);
+    return registerLazyFile(indexer, indexer.step(LoadClock::time_point::max()));
+}
+
+
+PhysicsShapeCache::Loader *PhysicsShapeCache::createLoader(const std::string &plist)
+{
+    return createLoader(plist, Director::getInstance()->getContentScaleFactor());
+}
+
+
+PhysicsShapeCache::Loader *PhysicsShapeCache::createLoader(const std::string &plist, float scaleFactor)
+{
+    return new Loader(this, plist, scaleFactor);
+}
+
+
+PhysicsShapeCache::Loader::Loader(PhysicsShapeCache *cache, const std::string &plist, float scaleFactor)
+: cache(cache)
+, plist(plist)
+, scaleFactor(scaleFactor)
+, state(LOADER_READ)
+, indexer(nullptr)
+, numBuilt(0)
+#if PHYSICSSHAPECACHE_STATS
+, ioMicros(0)
+, parseMicros(0)
+, buildMicros(0)
+#endif
+{
+}
+
+
+PhysicsShapeCache::Loader::~Loader()
+{
+    AX_SAFE_DELETE(indexer);
+}
+
+
+bool PhysicsShapeCache::Loader::step(int budgetMicros)
+{
+    auto start = LoadClock::now();
+    auto deadline = start + std::chrono::microseconds(budgetMicros);
+
+    if (state == LOADER_READ)
+    {
+        if (cache->bodiesInFile.find(plist) != cache->bodiesInFile.end())
+        {
+            AXLOG("WARNING: shapes \"%s\" are already loaded!", plist.c_str());
+            state = LOADER_FAILED;
+            return true;
+        }
+        PSC_TRACE_SCOPE(cache->trace, "read", plist);
+        Data data = readShapeFile(plist);
+        if (data.isNull())
+        {
+            // plist file not found
+            state = LOADER_FAILED;
+            return true;
+        }
+        SharedData *storage = new SharedData();
+        storage->data = std::move(data);
+        indexer = new FileIndexer(plist, storage, 0, storage->data.getSize(), scaleFactor, cache->compactVertexStorage);
+        storage->release();
+        state = LOADER_INDEX;
+        PSC_STATS(ioMicros = microsSince(start));
+        PSC_STATS(start = LoadClock::now());
+    }
+
+    if (state == LOADER_INDEX)
+    {
+        PSC_TRACE(auto traceStart = cache->trace.now());
+        int result = indexer->step(deadline);
+        PSC_TRACE(cache->trace.record("parse", plist, traceStart));
+        PSC_STATS(parseMicros += microsSince(start));
+        PSC_STATS(start = LoadClock::now());
+        if (result == FileIndexer::INDEX_RUNNING)
+        {
+            return false;
+        }
+        if (cache->bodiesInFile.find(plist) != cache->bodiesInFile.end())
+        {
+            // added by other means while this loader was indexing
+            AXLOG("WARNING: shapes \"%s\" are already loaded!", plist.c_str());
+            AX_SAFE_DELETE(indexer);
+            state = LOADER_FAILED;
+            return true;
+        }
+        for (auto &entry : indexer->index)
+        {
+            names.push_back(entry.first);
+        }
+        bool ok = cache->registerLazyFile(*indexer, result);
+        AX_SAFE_DELETE(indexer);
+        if (!ok)
+        {
+            names.clear();
+            state = LOADER_FAILED;
+            return true;
+        }
+        state = LOADER_BUILD;
+    }
+
+    if (state == LOADER_BUILD)
+    {
+        // at least one body per step, so that a small budget still makes progress
+        while (numBuilt < names.size())
+        {
+            cache->findBodyDef(names[numBuilt++]);
+            if (LoadClock::now() >= deadline)
+            {
+                break;
+            }
+        }
+        PSC_STATS(buildMicros += microsSince(start));
+        if (numBuilt < names.size())
+        {
+            return false;
+        }
+        state = LOADER_DONE;
+#if PHYSICSSHAPECACHE_STATS
+        FileLoadStats fileStats = FileLoadStats();
+        fileStats.ioMicros = ioMicros;
+        fileStats.parseMicros = parseMicros;
+        fileStats.buildMicros = buildMicros;
+        fileStats.numBodies = (int)names.size();
+        cache->stats.files[plist] = fileStats;
+#endif
+    }
+    return true;
+}
+
+
+float PhysicsShapeCache::Loader::getProgress() const
+{
+    switch (state)
+    {
+        case LOADER_READ:
+            return 0.0f;
+        case LOADER_INDEX:
+            return 0.5f * indexer->getProgress();
+        case LOADER_BUILD:
+            return 0.5f + 0.5f * numBuilt / names.size();
+        default:
+            return 1.0f;
+    }
+}
+
+
+PhysicsShapeCache::BodyDef *PhysicsShapeCache::findBodyDef(const std::string &name)
+{
+    auto pos = bodyDefs.find(name);
+    if (pos != bodyDefs.end())
+    {
+        return pos->second;
+    }
+
+    auto lazy = lazyBodies.find(name);
+    if (lazy == lazyBodies.end())
+    {
+        return findPackBodyDef(name);
+    }
+
+    // first use of a lazily loaded body: decode it now and keep it
+    LazyBody &entry = lazy->second;
+    LazyFile *file = entry.file;
+    PSC_TRACE(auto traceStart = trace.now());
+    ValueMap bodyData = valueMapFromRange(file->bytes, entry.offset, entry.length);
+    BodyDef *bd = bodyData.empty() ? nullptr : createBodyDef(bodyData, file->scaleFactor, file->compact);
+    lazyBodies.erase(lazy);
+    if (--file->numUndecoded == 0)
+    {
+        file->releaseStorage();
+    }
+    PSC_TRACE(traceBody("build", name, traceStart, bd));
+    if (!bd)
+    {
+        AXLOG("WARNING: PhysicsBody \"%s\" in \"%s\" could not be decoded!", name.c_str(), file->plist.c_str());
+        return nullptr;
+    }
+    auto result = bodyDefs.insert(std::make_pair(name, bd));
+    if (result.second)
+    {
+        namesInFile[file->plist].push_back(result.first);
+    }
+    bodiesInFile[file->plist].push_back(bd);
+    return bd;
+}
+
+
+PhysicsShapeCache::PackFile *PhysicsShapeCache::findPackBody(const std::string &name, int &index) const
+{
+    // names in several packs refer to the body of the pack added first
+    for (PackFile *file : packLoadOrder)
+    {
+        index = PhysicsShapePack::findBody(file->view, name.c_str());
+        if (index >= 0)
+        {
+            return file;
+        }
+    }
+    return nullptr;
+}
+
+
+PhysicsShapeCache::BodyDef *PhysicsShapeCache::findPackBodyDef(const std::string &name)
+{
+    // pack bodies are not added to bodyDefs, the pack's name index is faster
+    int index;
+    PackFile *file = findPackBody(name, index);
+    if (!file)
+    {
+        return nullptr;
+    }
+    BodyDef *&bd = file->bodies[index];
+    if (!bd)
+    {
+        PSC_TRACE(auto traceStart = trace.now());
+        bd = createBodyDefFromPack(file->view, index);
+        PSC_TRACE(traceBody("build", name, traceStart, bd));
+        bodiesInFile[file->name].push_back(bd);
+    }
+    return bd;
+}
+
+
+const PhysicsShapeCache::BodyDef *PhysicsShapeCache::findDecodedPackBodyDef(const std::string &name) const
+{
+    int index;
+    const PackFile *file = findPackBody(name, index);
+    return file ? file->bodies[index] : nullptr;
+}
+
+
+PhysicsShapeCache::BodyDef *PhysicsShapeCache::getBodyDef(const std::string &name)
+{
+    PSC_TRACE_SCOPE(trace, "lookup", name);
+    BodyDef *bd = findBodyDef(name);
+    if (bd)
+    {
+        PSC_STATS(stats.lookupHits++);
+        return bd;
+    }
+
+    bd = findBodyDef(name.substr(0, name.rfind('.'))); // remove file suffix and try again...
+    if (bd)
+    {
+        PSC_STATS(stats.lookupAliasHits++);
+        return bd;
+    }
+
+    PSC_STATS(stats.lookupMisses++);
+    return nullptr;
+}
+
+
+void PhysicsShapeCache::setBodyProperties(PhysicsBody *body, BodyDef *bd)
+{
+    body->setGravityEnable(bd->affectedByGravity);
+    body->setDynamic(bd->isDynamic);
+    body->setRotationEnable(bd->allowsRotation);
+    body->setLinearDamping(bd->linearDamping);
+    body->setAngularDamping(bd->angularDamping);
+    body->setVelocityLimit(bd->velocityLimit);
+    body->setAngularVelocityLimit(bd->angularVelocityLimit);
+}
+
+
+void PhysicsShapeCache::setShapeProperties(PhysicsShape *shape, int row)
+{
+    const FixtureColumns &values = fixtureTable.effective;
+    shape->setGroup(values.group[row]);
+    shape->setCategoryBitmask(values.categoryMask[row]);
+    shape->setCollisionBitmask(values.collisionMask[row]);
+    shape->setContactTestBitmask(values.contactTestMask[row]);
+    shape->setTag(values.tag[row]);
+}
+
+
+PhysicsBody *PhysicsShapeCache::createBodyWithName(const std::string &name)
+{
+    PSC_STATS(auto start = StatsClock::now());
+    PSC_TRACE(auto traceStart = trace.now());
+    BodyDef *bd = getBodyDef(name);
+    if (!bd)
+    {
+        AXLOG("WARNING: PhysicsBody with name \"%s\", not found!", name.c_str());
+        return nullptr; // body not found
+    }
+    PhysicsBody *body = createBody(bd);
+    PSC_TRACE(traceBody("createBodyWithName", name, traceStart, bd));
+    PSC_STATS(recordInstantiation(name, microsSince(start)));
+    return body;
+}
+
+
+PhysicsBody *PhysicsShapeCache::createBodyWithName(const std::string &name, const BodyTransform &transform)
+{
+    PSC_STATS(auto start = StatsClock::now());
+    PSC_TRACE(auto traceStart = trace.now());
+    BodyDef *bd = getBodyDef(name);
+    if (!bd)
+    {
+        AXLOG("WARNING: PhysicsBody with name \"%s\", not found!", name.c_str());
+        return nullptr; // body not found
+    }
+    PhysicsBody *body = createBody(getTransformedBodyDef(bd, transform));
+    PSC_TRACE(traceBody("createBodyWithName", name, traceStart, bd));
+    PSC_STATS(recordInstantiation(name, microsSince(start)));
+    return body;
+}
+
+
+PhysicsBody *PhysicsShapeCache::createBody(BodyDef *bd)
+{
+    auto pool = bodyPools.find(bd);
+    if (pool != bodyPools.end() && !pool->second.empty())
+    {
+        // hand over the pool's reference, like PhysicsBody::create()
+        PhysicsBody *body = pool->second.back();
+        pool->second.pop_back();
+        body->autorelease();
+        return body;
+    }
+    return buildBody(bd);
+}
+
+
+void PhysicsShapeCache::createShapes(BodyDef *bd, Vector<PhysicsShape *> &shapes)
+{
+    const Point *bodyVertices = bd->quantizedVertices ? dequantizeVertices(bd) : nullptr;
+    const FixtureColumns &values = fixtureTable.effective;
+    for (auto fd : bd->fixtures)
+    {
+        PhysicsMaterial material(values.density[fd->row], values.restitution[fd->row], values.friction[fd->row]);
+        if (fd->fixtureType == FIXTURE_CIRCLE)
+        {
+            auto shape = PhysicsShapeCircle::create(fd->radius, material, fd->center);
+            setShapeProperties(shape, fd->row);
+            shapes.pushBack(shape);
+            if (liveOverrides)
+            {
+                trackLiveShape(shape, fd->row);
+            }
+        }
+        else if (fd->fixtureType == FIXTURE_POLYGON)
+        {
+            for (auto polygon : fd->polygons)
+            {
+                const Point *vertices = bodyVertices ? bodyVertices + polygon->firstVertex : polygon->vertices;
+                auto shape = PhysicsShapePolygon::create(vertices, polygon->numVertices, material, fd->center);
+                setShapeProperties(shape, fd->row);
+                shapes.pushBack(shape);
+                if (liveOverrides)
+                {
+                    trackLiveShape(shape, fd->row);
+                }
+            }
+        }
+    }
+}
+
+
+PhysicsBody *PhysicsShapeCache::buildBody(BodyDef *bd)
+{
+    PhysicsBody *body = PhysicsBody::create();
+    setBodyProperties(body, bd);
+
+    createShapes(bd, shapeBuffer);
+    for (auto shape : shapeBuffer)
+    {
+        body->addShape(shape);
+    }
+    shapeBuffer.clear();
+    PSC_STATS(stats.bodiesBuilt++);
+    return body;
+}
+
+
+PhysicsShapeCache::WarmUpReport PhysicsShapeCache::warmUp(const std::vector<WarmUpEntry> &manifest)
+{
+    WarmUpReport report = WarmUpReport();
+    std::unordered_set<const BodyDef *> prepared;
+    for (auto &entry : manifest)
+    {
+        BodyDef *bd = getBodyDef(entry.name);
+        if (!bd)
+        {
+            report.missing.push_back(entry.name);
+            continue;
+        }
+        bd = getTransformedBodyDef(bd, entry.transform);
+        if (prepared.insert(bd).second)
+        {
+            report.numBodyDefs++;
+        }
+        if (entry.debugGeometry)
+        {
+            buildDebugGeometry(bd);
+        }
+        if ((size_t)bd->numQuantizedVertices > vertexBuffer.size())
+        {
+            vertexBuffer.resize(bd->numQuantizedVertices);
+        }
+
+        // top up, entries with the same body share one pool
+        std::vector<PhysicsBody *> &pool = bodyPools[bd];
+        while ((int)pool.size() < entry.peakCount)
+        {
+            PhysicsBody *body = buildBody(bd);
+            body->retain();
+            pool.push_back(body);
+            report.numPooledBodies++;
+        }
+    }
+    return report;
+}
+
+
+void PhysicsShapeCache::releasePool(const BodyDef *bd)
+{
+    auto pool = bodyPools.find(bd);
+    if (pool != bodyPools.end())
+    {
+        for (auto body : pool->second)
+        {
+            body->release();
+        }
+        bodyPools.erase(pool);
+    }
+}
+
+
+void PhysicsShapeCache::clearPools()
+{
+    for (auto &pool : bodyPools)
+    {
+        for (auto body : pool.second)
+        {
+            body->release();
+        }
+    }
+    bodyPools.clear();
+}
+
+
+const PhysicsShapeCache::DebugGeometry *PhysicsShapeCache::getDebugGeometry(const std::string &name)
+{
+    BodyDef *bd = getBodyDef(name);
+    return bd ? buildDebugGeometry(bd) : nullptr;
+}
+
+
+const PhysicsShapeCache::DebugGeometry *PhysicsShapeCache::getDebugGeometry(const std::string &name, const BodyTransform &transform)
+{
+    BodyDef *bd = getBodyDef(name);
+    return bd ? buildDebugGeometry(getTransformedBodyDef(bd, transform)) : nullptr;
+}
+
+
+// outline and fan of the last count vertices, all shapes are convex
+static void addDebugLoop(PhysicsShapeCache::DebugGeometry *geometry, size_t count)
+{
+    uint16_t first = (uint16_t)(geometry->vertices.size() - count);
+    for (size_t i = 0; i < count; i++)
+    {
+        geometry->lineIndices.push_back((uint16_t)(first + i));
+        geometry->lineIndices.push_back((uint16_t)(first + (i + 1) % count));
+    }
+    for (size_t i = 1; i + 1 < count; i++)
+    {
+        geometry->triangleIndices.push_back(first);
+        geometry->triangleIndices.push_back((uint16_t)(first + i));
+        geometry->triangleIndices.push_back((uint16_t)(first + i + 1));
+    }
+}
+
+
+const PhysicsShapeCache::DebugGeometry *PhysicsShapeCache::buildDebugGeometry(BodyDef *bd)
+{
+    auto pos = debugGeometry.find(bd);
+    if (pos != debugGeometry.end())
+    {
+        return pos->second;
+    }
+
+    size_t numVertices = 0;
+    for (auto fd : bd->fixtures)
+    {
+        if (fd->fixtureType == FIXTURE_CIRCLE)
+        {
+            numVertices += DEBUG_CIRCLE_SEGMENTS;
+        }
+        else if (fd->fixtureType == FIXTURE_POLYGON)
+        {
+            for (auto polygon : fd->polygons)
+            {
+                numVertices += polygon->numVertices;
+            }
+        }
+    }
+    if (numVertices > DEBUG_MAX_VERTICES)
+    {
+        AXLOG("WARNING: %zu vertices are too many for 16 bit debug geometry indices!", numVertices);
+        return nullptr;
+    }
+
+    DebugGeometry *geometry = new DebugGeometry();
+    geometry->vertices.reserve(numVertices);
+    const Point *bodyVertices = bd->quantizedVertices ? dequantizeVertices(bd) : nullptr;
+    for (auto fd : bd->fixtures)
+    {
+        if (fd->fixtureType == FIXTURE_CIRCLE)
+        {
+            for (int i = 0; i < DEBUG_CIRCLE_SEGMENTS; i++)
+            {
+                float angle = AX_DEGREES_TO_RADIANS(360.0f * i / DEBUG_CIRCLE_SEGMENTS);
+                geometry->vertices.push_back(fd->center + Vec2(cosf(angle), sinf(angle)) * fd->radius);
+            }
+            addDebugLoop(geometry, DEBUG_CIRCLE_SEGMENTS);
+        }
+        else if (fd->fixtureType == FIXTURE_POLYGON)
+        {
+            for (auto polygon : fd->polygons)
+            {
+                const Point *vertices = bodyVertices ? bodyVertices + polygon->firstVertex : polygon->vertices;
+                for (int i = 0; i < polygon->numVertices; i++)
+                {
+                    geometry->vertices.push_back(vertices[i] + fd->center);
+                }
+                addDebugLoop(geometry, polygon->numVertices);
+            }
+        }
+    }
+    debugGeometry.insert(std::make_pair(bd, geometry));
+    return geometry;
+}
+
+
+void PhysicsShapeCache::releaseDebugGeometry(const BodyDef *bd)
+{
+    auto pos = debugGeometry.find(bd);
+    if (pos != debugGeometry.end())
+    {
+        delete pos->second;
+        debugGeometry.erase(pos);
+    }
+}
+
+
+void PhysicsShapeCache::FixtureColumns::resize(size_t rows)
+{
+    density.resize(rows);
+    restitution.resize(rows);
+    friction.resize(rows);
+    tag.resize(rows);
+    group.resize(rows);
+    categoryMask.resize(rows);
+    collisionMask.resize(rows);
+    contactTestMask.resize(rows);
+}
+
+
+void PhysicsShapeCache::FixtureColumns::copyRow(int dst, const FixtureColumns &src, int srcRow)
+{
+    density[dst]         = src.density[srcRow];
+    restitution[dst]     = src.restitution[srcRow];
+    friction[dst]        = src.friction[srcRow];
+    tag[dst]             = src.tag[srcRow];
+    group[dst]           = src.group[srcRow];
+    categoryMask[dst]    = src.categoryMask[srcRow];
+    collisionMask[dst]   = src.collisionMask[srcRow];
+    contactTestMask[dst] = src.contactTestMask[srcRow];
+}
+
+
+int PhysicsShapeCache::FixtureTable::addRow()
+{
+    if (!freeRows.empty())
+    {
+        int row = freeRows.back();
+        freeRows.pop_back();
+        return row;
+    }
+    size_t rows = generation.size() + 1;
+    base.resize(rows);
+    effective.resize(rows);
+    generation.resize(rows, 0);
+    return (int)rows - 1;
+}
+
+
+void PhysicsShapeCache::FixtureTable::releaseRow(int row)
+{
+    generation[row]++;
+    freeRows.push_back(row);
+}
+
+
+// column[i] = value where match[i] is -1, compiles to vector selects
+template <typename T>
+static void overrideColumn(std::vector<T> &column, const std::vector<int> &match, T value, size_t first, size_t last)
+{
+    T *values = column.data();
+    const int *selected = match.data();
+    for (size_t i = first; i < last; i++)
+    {
+        values[i] = selected[i] ? value : values[i];
+    }
+}
+
+
+template <typename T>
+static void copyColumn(const std::vector<T> &src, std::vector<T> &dst, size_t first, size_t last)
+{
+    std::copy(src.begin() + first, src.begin() + last, dst.begin() + first);
+}
+
+
+void PhysicsShapeCache::applyOverrideLayers(size_t first, size_t last)
+{
+    const FixtureColumns &base = fixtureTable.base;
+    FixtureColumns &values = fixtureTable.effective;
+    copyColumn(base.density, values.density, first, last);
+    copyColumn(base.restitution, values.restitution, first, last);
+    copyColumn(base.friction, values.friction, first, last);
+    copyColumn(base.tag, values.tag, first, last);
+    copyColumn(base.group, values.group, first, last);
+    copyColumn(base.categoryMask, values.categoryMask, first, last);
+    copyColumn(base.collisionMask, values.collisionMask, first, last);
+    copyColumn(base.contactTestMask, values.contactTestMask, first, last);
+    if (overrideLayers.empty())
+    {
+        return;
+    }
+
+    overrideMatch.resize(fixtureTable.size());
+    for (auto &entry : overrideLayers)
+    {
+        const FixtureOverride &layer = entry.second;
+        const int *category = base.categoryMask.data();
+        const int *tag = base.tag.data();
+        int *match = overrideMatch.data();
+        int anyTag = layer.matchTag == FixtureOverride::ANY_TAG ? -1 : 0;
+        for (size_t i = first; i < last; i++)
+        {
+            match[i] = -(int)((category[i] & layer.matchCategories) != 0) & (anyTag | -(int)(tag[i] == layer.matchTag));
+        }
+
+        if (layer.fields & FixtureOverride::DENSITY)
+        {
+            overrideColumn(values.density, overrideMatch, layer.density, first, last);
+        }
+        if (layer.fields & FixtureOverride::RESTITUTION)
+        {
+            overrideColumn(values.restitution, overrideMatch, layer.restitution, first, last);
+        }
+        if (layer.fields & FixtureOverride::FRICTION)
+        {
+            overrideColumn(values.friction, overrideMatch, layer.friction, first, last);
+        }
+        if (layer.fields & FixtureOverride::GROUP)
+        {
+            overrideColumn(values.group, overrideMatch, layer.group, first, last);
+        }
+        if (layer.fields & FixtureOverride::CATEGORY_MASK)
+        {
+            overrideColumn(values.categoryMask, overrideMatch, layer.categoryMask, first, last);
+        }
+        if (layer.fields & FixtureOverride::COLLISION_MASK)
+        {
+            overrideColumn(values.collisionMask, overrideMatch, layer.collisionMask, first, last);
+        }
+        if (layer.fields & FixtureOverride::CONTACT_TEST_MASK)
+        {
+            overrideColumn(values.contactTestMask, overrideMatch, layer.contactTestMask, first, last);
+        }
+    }
+}
+
+
+void PhysicsShapeCache::updateOverriddenShapes()
+{
+    const FixtureColumns &values = fixtureTable.effective;
+    auto update = [this, &values](PhysicsShape *shape, int row) {
+        shape->setMaterial(PhysicsMaterial(values.density[row], values.restitution[row], values.friction[row]));
+        setShapeProperties(shape, row);
+    };
+
+    // shapes of pooled bodies are in the order of the fixtures and polygons
+    for (auto &pool : bodyPools)
+    {
+        for (auto body : pool.second)
+        {
+            const Vector<PhysicsShape *> &shapes = body->getShapes();
+            ssize_t index = 0;
+            for (auto fd : pool.first->fixtures)
+            {
+                ssize_t count = fd->fixtureType == FIXTURE_CIRCLE ? 1 : (ssize_t)fd->polygons.size();
+                for (ssize_t i = 0; i < count && index < shapes.size(); i++)
+                {
+                    update(shapes.at(index++), fd->row);
+                }
+            }
+        }
+    }
+
+    if (liveOverrides)
+    {
+        pruneLiveShapes();
+        for (auto &live : liveShapes)
+        {
+            update(live.shape, live.row);
+        }
+    }
+}
+
+
+void PhysicsShapeCache::trackLiveShape(PhysicsShape *shape, int row)
+{
+    shape->retain();
+    LiveShape live = { shape, row, fixtureTable.generation[row] };
+    liveShapes.push_back(live);
+
+    // drop shapes released by the game from time to time
+    if (liveShapes.size() >= livePruneThreshold)
+    {
+        pruneLiveShapes();
+    }
+}
+
+
+void PhysicsShapeCache::pruneLiveShapes()
+{
+    size_t live = 0;
+    for (auto &entry : liveShapes)
+    {
+        // the fixture can be gone with its file and the row reused
+        if (entry.shape->getReferenceCount() > 1 && entry.generation == fixtureTable.generation[entry.row])
+        {
+            liveShapes[live++] = entry;
+        }
+        else
+        {
+            entry.shape->release();
+        }
+    }
+    liveShapes.resize(live);
+    livePruneThreshold = std::max<size_t>(1024, live * 2);
+}
+
+
+void PhysicsShapeCache::setOverrideLayer(const std::string &name, const FixtureOverride &layer)
+{
+    auto iter = std::find_if(overrideLayers.begin(), overrideLayers.end(), [&name](const std::pair<std::string, FixtureOverride> &entry) {
+        return entry.first == name;
+    });
+    if (iter != overrideLayers.end())
+    {
+        iter->second = layer;
+    }
+    else
+    {
+        overrideLayers.push_back(std::make_pair(name, layer));
+    }
+    applyOverrideLayers(0, fixtureTable.size());
+    updateOverriddenShapes();
+}
+
+
+void PhysicsShapeCache::removeOverrideLayer(const std::string &name)
+{
+    auto iter = std::find_if(overrideLayers.begin(), overrideLayers.end(), [&name](const std::pair<std::string, FixtureOverride> &entry) {
+        return entry.first == name;
+    });
+    if (iter == overrideLayers.end())
+    {
+        return;
+    }
+    overrideLayers.erase(iter);
+    applyOverrideLayers(0, fixtureTable.size());
+    updateOverriddenShapes();
+}
+
+
+void PhysicsShapeCache::removeAllOverrideLayers()
+{
+    if (overrideLayers.empty())
+    {
+        return;
+    }
+    overrideLayers.clear();
+    applyOverrideLayers(0, fixtureTable.size());
+    updateOverriddenShapes();
+}
+
+
+void PhysicsShapeCache::setLiveOverridesEnabled(bool enable)
+{
+    liveOverrides = enable;
+    if (!enable)
+    {
+        for (auto &live : liveShapes)
+        {
+            live.shape->release();
+        }
+        liveShapes.clear();
+    }
+}
+
+
+static void addToSet(std::vector<uint64_t> &set, int slot)
+{
+    size_t word = (size_t)slot / 64;
+    if (set.size() <= word)
+    {
+        set.resize(word + 1, 0);
+    }
+    set[word] |= 1ULL << (slot % 64);
+}
+
+
+static void removeFromSet(std::vector<uint64_t> &set, int slot)
+{
+    size_t word = (size_t)slot / 64;
+    if (word < set.size())
+    {
+        set[word] &= ~(1ULL << (slot % 64));
+    }
+}
+
+
+static bool isEmptySet(const std::vector<uint64_t> &set)
+{
+    for (uint64_t bits : set)
+    {
+        if (bits)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+// set &= other, other is shorter if the last slots are not in it
+static void intersectSets(std::vector<uint64_t> &set, const std::vector<uint64_t> &other)
+{
+    if (set.size() > other.size())
+    {
+        set.resize(other.size());
+    }
+    for (size_t i = 0; i < set.size(); i++)
+    {
+        set[i] &= other[i];
+    }
+}
+
+
+static void uniteSets(std::vector<uint64_t> &set, const std::vector<uint64_t> &other)
+{
+    if (set.size() < other.size())
+    {
+        set.resize(other.size(), 0);
+    }
+    for (size_t i = 0; i < other.size(); i++)
+    {
+        set[i] |= other[i];
+    }
+}
+
+
+int PhysicsShapeCache::BodyIndex::addSlot()
+{
+    int slot;
+    if (!freeSlots.empty())
+    {
+        slot = freeSlots.back();
+        freeSlots.pop_back();
+    }
+    else
+    {
+        slot = (int)entries.size();
+        entries.push_back(Entry());
+    }
+    addToSet(all, slot);
+    return slot;
+}
+
+
+int PhysicsShapeCache::BodyIndex::addBody(const std::string &name)
+{
+    int slot = addSlot();
+    entries[slot].name = name;
+    return slot;
+}
+
+
+// pack bodies are referenced by index, their names are not copied
+int PhysicsShapeCache::BodyIndex::addPackBody(const PackFile *pack, uint32_t body)
+{
+    int slot = addSlot();
+    entries[slot].pack = pack;
+    entries[slot].packBody = body;
+    return slot;
+}
+
+
+void PhysicsShapeCache::BodyIndex::addTag(int slot, int tag)
+{
+    addToSet(byTag[tag], slot);
+}
+
+
+void PhysicsShapeCache::BodyIndex::addGroup(int slot, int group)
+{
+    addToSet(byGroup[group], slot);
+}
+
+
+void PhysicsShapeCache::BodyIndex::addCategories(int slot, int categoryMask)
+{
+    for (int bit = 0; bit < 32; bit++)
+    {
+        if ((unsigned int)categoryMask & (1u << bit))
+        {
+            addToSet(byCategory[bit], slot);
+        }
+    }
+}
+
+
+void PhysicsShapeCache::BodyIndex::removeBodies(const std::vector<int> &slots)
+{
+    // sets of tags and groups no longer used are dropped so that removing
+    // files doesn't get slower over time
+    for (auto *index : { &byTag, &byGroup })
+    {
+        for (auto iter = index->begin(); iter != index->end(); )
+        {
+            for (int slot : slots)
+            {
+                removeFromSet(iter->second, slot);
+            }
+            if (isEmptySet(iter->second))
+            {
+                iter = index->erase(iter);
+            }
+            else
+            {
+                ++iter;
+            }
+        }
+    }
+    for (int slot : slots)
+    {
+        for (auto &set : byCategory)
+        {
+            removeFromSet(set, slot);
+        }
+        removeFromSet(all, slot);
+        entries[slot] = Entry();
+        freeSlots.push_back(slot);
+    }
+}
+
+
+void PhysicsShapeCache::BodyIndex::clear()
+{
+    entries.clear();
+    freeSlots.clear();
+    all.clear();
+    byTag.clear();
+    byGroup.clear();
+    for (auto &set : byCategory)
+    {
+        set.clear();
+    }
+}
+
+
+void PhysicsShapeCache::indexBodyDef(const std::string &plist, const std::string &name, const BodyDef *bd)
+{
+    int slot = bodyIndex.addBody(name);
+    indexSlotsInFile[plist].push_back(slot);
+    for (auto fd : bd->fixtures)
+    {
+        bodyIndex.addTag(slot, fixtureTable.base.tag[fd->row]);
+        bodyIndex.addGroup(slot, fixtureTable.base.group[fd->row]);
+        bodyIndex.addCategories(slot, fixtureTable.base.categoryMask[fd->row]);
+    }
+}
+
+
+// reads the <integer> element following a key, without strtol because
+// the file contents are not NUL terminated
+static bool readIntegerValue(const char *pos, const char *end, int &value)
+{
+    static const char INTEGER[] = "<integer>";
+    static const size_t INTEGER_LENGTH = sizeof(INTEGER) - 1;
+
+    while (pos < end && isspace((unsigned char)*pos))
+    {
+        pos++;
+    }
+    if ((size_t)(end - pos) < INTEGER_LENGTH || memcmp(pos, INTEGER, INTEGER_LENGTH) != 0)
+    {
+        return false;
+    }
+    pos += INTEGER_LENGTH;
+    bool negative = pos < end && *pos == '-';
+    if (negative)
+    {
+        pos++;
+    }
+    if (pos >= end || !isdigit((unsigned char)*pos))
+    {
+        return false;
+    }
+    long long number = 0;
+    while (pos < end && isdigit((unsigned char)*pos) && number < 0x100000000LL)
+    {
+        number = number * 10 + (*pos++ - '0');
+    }
+    // masks above INT_MAX become negative ints
+    value = (int)(unsigned int)(negative ? -number : number);
+    return true;
+}
+
+
+void PhysicsShapeCache::indexLazyBody(const std::string &plist, const std::string &name, const LazyBody &body)
+{
+    int slot = bodyIndex.addBody(name);
+    indexSlotsInFile[plist].push_back(slot);
+
+    // the body is not decoded, the keys are only used in the fixtures
+    static const char *const keys[] = { "<key>tag</key>", "<key>group</key>", "<key>category_mask</key>" };
+    const char *pos = body.file->bytes + body.offset;
+    const char *end = pos + body.length;
+    while (pos < end)
+    {
+        pos = (const char *)memchr(pos, '<', end - pos);
+        if (!pos)
+        {
+            break;
+        }
+        for (int i = 0; i < 3; i++)
+        {
+            size_t length = strlen(keys[i]);
+            int value;
+            if ((size_t)(end - pos) >= length && memcmp(pos, keys[i], length) == 0
+                && readIntegerValue(pos + length, end, value))
+            {
+                if (i == 0)
+                {
+                    bodyIndex.addTag(slot, value);
+                }
+                else if (i == 1)
+                {
+                    bodyIndex.addGroup(slot, value);
+                }
+                else
+                {
+                    bodyIndex.addCategories(slot, value);
+                }
+                break;
+            }
+        }
+        pos++;
+    }
+}
+
+
+void PhysicsShapeCache::indexPack(const PackFile *file)
+{
+    const PhysicsShapePack::PackView &pack = file->view;
+    auto &slots = indexSlotsInFile[file->name];
+    for (uint32_t i = 0; i < pack.numBodies; i++)
+    {
+        int slot = bodyIndex.addPackBody(file, i);
+        slots.push_back(slot);
+        const PhysicsShapePack::Body &body = pack.bodies[i];
+        for (uint32_t j = 0; j < body.numFixtures; j++)
+        {
+            const PhysicsShapePack::Fixture &fixture = pack.fixtures[body.firstFixture + j];
+            bodyIndex.addTag(slot, fixture.tag);
+            bodyIndex.addGroup(slot, fixture.group);
+            bodyIndex.addCategories(slot, (int)fixture.categoryMask);
+        }
+    }
+}
+
+
+size_t PhysicsShapeCache::findBodies(const BodyFilter &filter, std::vector<std::string> &names) const
+{
+    names.clear();
+    const BodySet none;
+    BodySet matches = bodyIndex.all;
+    if (filter.matchTag != BodyFilter::ANY)
+    {
+        auto tag = bodyIndex.byTag.find(filter.matchTag);
+        intersectSets(matches, tag != bodyIndex.byTag.end() ? tag->second : none);
+    }
+    if (filter.matchGroup != BodyFilter::ANY)
+    {
+        auto group = bodyIndex.byGroup.find(filter.matchGroup);
+        intersectSets(matches, group != bodyIndex.byGroup.end() ? group->second : none);
+    }
+    if (filter.matchCategories != -1)
+    {
+        BodySet categories;
+        for (int bit = 0; bit < 32; bit++)
+        {
+            if ((unsigned int)filter.matchCategories & (1u << bit))
+            {
+                uniteSets(categories, bodyIndex.byCategory[bit]);
+            }
+        }
+        intersectSets(matches, categories);
+    }
+
+    for (size_t word = 0; word < matches.size(); word++)
+    {
+        size_t slot = word * 64;
+        for (uint64_t bits = matches[word]; bits; bits >>= 1, slot++)
+        {
+            if (!(bits & 1))
+            {
+                continue;
+            }
+            const BodyIndex::Entry &entry = bodyIndex.entries[slot];
+            if (!entry.pack)
+            {
+                names.push_back(entry.name);
+                continue;
+            }
+            // pack bodies hidden by a file loaded earlier are skipped,
+            // the visible body has its own entry
+            std::string name = entry.pack->view.names + entry.pack->view.nameOffsets[entry.packBody];
+            int index;
+            if (bodyDefs.find(name) == bodyDefs.end() && lazyBodies.find(name) == lazyBodies.end()
+                && findPackBody(name, index) == entry.pack && index == (int)entry.packBody)
+            {
+                names.push_back(std::move(name));
+            }
+        }
+    }
+    return names.size();
+}
+
+
+bool PhysicsShapeCache::setBodyOnSprite(const std::string &name, Sprite *sprite)
+{
+    PhysicsBody *body = createBodyWithName(name);
+    if (body)
+    {
+        sprite->setPhysicsBody(body);
+        sprite->setAnchorPoint(getBodyDef(name)->anchorPoint);
+    }
+    return body != nullptr;
+}
+
+
+bool PhysicsShapeCache::setBodyOnSprite(const std::string &name, Sprite *sprite, const BodyTransform &transform)
+{
+    PhysicsBody *body = createBodyWithName(name, transform);
+    if (body)
+    {
+        sprite->setPhysicsBody(body);
+        sprite->setAnchorPoint(getTransformedBodyDef(getBodyDef(name), transform)->anchorPoint);
+    }
+    return body != nullptr;
+}
+
+
+const char *const PhysicsShapeCache::FrameBodies::NAME = "PhysicsShapeCache::FrameBodies";
+
+
+void PhysicsShapeCache::FrameBodies::update(float delta)
+{
+    // once per tick, usually the frame did not change
+    Sprite *sprite = static_cast<Sprite *>(_owner);
+    SpriteFrame *frame = sprite->getSpriteFrame();
+    if (frame == currentFrame)
+    {
+        return;
+    }
+    currentFrame = frame;
+
+    auto iter = frames.find(frame);
+    PhysicsBody *body = sprite->getPhysicsBody();
+    if (iter == frames.end() || !body)
+    {
+        return;
+    }
+
+    // the first shapes set the mass and moment, later frames keep them
+    bool first = body->getShapes().empty();
+    body->removeAllShapes(false);
+    for (auto shape : iter->second.shapes)
+    {
+        body->addShape(shape, first);
+    }
+    sprite->setAnchorPoint(iter->second.anchorPoint);
+}
+
+
+bool PhysicsShapeCache::setFrameBodiesOnSprite(Sprite *sprite, const std::map<std::string, std::string> &frameBodies)
+{
+    FrameBodies *component = new FrameBodies();
+    component->autorelease();
+    component->init();
+    component->setName(FrameBodies::NAME);
+
+    BodyDef *currentBodyDef = nullptr;
+    FrameBodies::Frame *currentShapes = nullptr;
+    for (auto &entry : frameBodies)
+    {
+        SpriteFrame *frame = SpriteFrameCache::getInstance()->getSpriteFrameByName(entry.first);
+        BodyDef *bd = getBodyDef(entry.second);
+        if (!frame || !bd)
+        {
+            AXLOG("WARNING: frame \"%s\" or body \"%s\" not found", entry.first.c_str(), entry.second.c_str());
+            continue;
+        }
+        if (component->frames.find(frame) == component->frames.end())
+        {
+            component->retainedFrames.pushBack(frame);
+        }
+        FrameBodies::Frame &shapes = component->frames[frame];
+        shapes.shapes.clear();
+        createShapes(bd, shapes.shapes);
+        shapes.anchorPoint = bd->anchorPoint;
+        if (!currentBodyDef || frame == sprite->getSpriteFrame())
+        {
+            currentBodyDef = bd;
+            currentShapes = &shapes;
+        }
+    }
+    if (!currentBodyDef)
+    {
+        return false;
+    }
+
+    PhysicsBody *body = sprite->getPhysicsBody();
+    if (body)
+    {
+        body->removeAllShapes();
+    }
+    else
+    {
+        body = PhysicsBody::create();
+        sprite->setPhysicsBody(body);
+    }
+    setBodyProperties(body, currentBodyDef);
+
+    // the displayed frame, or the first one until a mapped frame is shown
+    for (auto shape : currentShapes->shapes)
+    {
+        body->addShape(shape);
+    }
+    sprite->setAnchorPoint(currentShapes->anchorPoint);
+    component->currentFrame = sprite->getSpriteFrame();
+
+    sprite->removeComponent(FrameBodies::NAME);
+    sprite->addComponent(component);
+    return true;
+}
+
+
+PhysicsShapeCache::BodyDef *PhysicsShapeCache::getQueryBodyDef(const std::string &name, const QueryTransform &transform, int count)
+{
+    BodyDef *bd = getBodyDef(name);
+    if (!bd)
+    {
+        return nullptr;
+    }
+    if (queryX.size() < (size_t)count)
+    {
+        queryX.resize(count);
+        queryY.resize(count);
+        queryHits.resize(count);
+        queryInside.resize(count);
+    }
+    return getTransformedBodyDef(bd, transform.shape);
+}
+
+
+// rotation of a node, counter-clockwise in radians
+static void queryRotation(const PhysicsShapeCache::QueryTransform &transform, float &c, float &s)
+{
+    float angle = -AX_DEGREES_TO_RADIANS(transform.rotation);
+    c = cosf(angle);
+    s = sinf(angle);
+}
+
+
+// four query points at a time. GCC doesn't vectorize the loops below at
+// -O2 and without __restrict has to assume that the output aliases the
+// points, so the SSE2 and NEON paths are written out. Masks are 0 or ~0.
+#if PSC_QUERY_SSE2
+#define PSC_QUERY_SIMD 1
+typedef __m128 QueryFloats;
+typedef __m128 QueryMask;
+static inline QueryFloats queryLoad(const float *p) { return _mm_loadu_ps(p); }
+static inline QueryFloats querySplat(float v) { return _mm_set1_ps(v); }
+static inline QueryFloats queryAdd(QueryFloats a, QueryFloats b) { return _mm_add_ps(a, b); }
+static inline QueryFloats querySub(QueryFloats a, QueryFloats b) { return _mm_sub_ps(a, b); }
+static inline QueryFloats queryMul(QueryFloats a, QueryFloats b) { return _mm_mul_ps(a, b); }
+static inline QueryMask queryLess(QueryFloats a, QueryFloats b) { return _mm_cmplt_ps(a, b); }
+static inline QueryMask queryLessEqual(QueryFloats a, QueryFloats b) { return _mm_cmple_ps(a, b); }
+static inline QueryMask queryAnd(QueryMask a, QueryMask b) { return _mm_and_ps(a, b); }
+static inline QueryMask queryOr(QueryMask a, QueryMask b) { return _mm_or_ps(a, b); }
+static inline QueryMask queryXor(QueryMask a, QueryMask b) { return _mm_xor_ps(a, b); }
+static inline QueryMask queryLoadMask(const uint32_t *p) { return _mm_loadu_ps((const float *)p); }
+static inline void queryStoreMask(uint32_t *p, QueryMask m) { _mm_storeu_ps((float *)p, m); }
+#elif PSC_QUERY_NEON
+#define PSC_QUERY_SIMD 1
+typedef float32x4_t QueryFloats;
+typedef uint32x4_t QueryMask;
+static inline QueryFloats queryLoad(const float *p) { return vld1q_f32(p); }
+static inline QueryFloats querySplat(float v) { return vdupq_n_f32(v); }
+static inline QueryFloats queryAdd(QueryFloats a, QueryFloats b) { return vaddq_f32(a, b); }
+static inline QueryFloats querySub(QueryFloats a, QueryFloats b) { return vsubq_f32(a, b); }
+static inline QueryFloats queryMul(QueryFloats a, QueryFloats b) { return vmulq_f32(a, b); }
+static inline QueryMask queryLess(QueryFloats a, QueryFloats b) { return vcltq_f32(a, b); }
+static inline QueryMask queryLessEqual(QueryFloats a, QueryFloats b) { return vcleq_f32(a, b); }
+static inline QueryMask queryAnd(QueryMask a, QueryMask b) { return vandq_u32(a, b); }
+static inline QueryMask queryOr(QueryMask a, QueryMask b) { return vorrq_u32(a, b); }
+static inline QueryMask queryXor(QueryMask a, QueryMask b) { return veorq_u32(a, b); }
+static inline QueryMask queryLoadMask(const uint32_t *p) { return vld1q_u32(p); }
+static inline void queryStoreMask(uint32_t *p, QueryMask m) { vst1q_u32(p, m); }
+#else
+#define PSC_QUERY_SIMD 0
+#endif
+
+#if defined(_MSC_VER)
+#define PSC_RESTRICT __restrict
+#else
+#define PSC_RESTRICT __restrict__
+#endif
+
+
+static inline uint32_t queryMask(bool value)
+{
+    return 0u - (uint32_t)value;
+}
+
+
+static void overlapCircle(const Point &center, float radius, const float *PSC_RESTRICT xs, const float *PSC_RESTRICT ys, int count, uint32_t *PSC_RESTRICT hits)
+{
+    const float cx = center.x, cy = center.y, r2 = radius * radius;
+    int k = 0;
+#if PSC_QUERY_SIMD
+    const QueryFloats vcx = querySplat(cx), vcy = querySplat(cy), vr2 = querySplat(r2);
+    for (; k + 4 <= count; k += 4)
+    {
+        QueryFloats dx = querySub(queryLoad(xs + k), vcx), dy = querySub(queryLoad(ys + k), vcy);
+        QueryMask hit = queryLessEqual(queryAdd(queryMul(dx, dx), queryMul(dy, dy)), vr2);
+        queryStoreMask(hits + k, queryOr(queryLoadMask(hits + k), hit));
+    }
+#endif
+    for (; k < count; k++)
+    {
+        float dx = xs[k] - cx, dy = ys[k] - cy;
+        hits[k] |= queryMask(dx * dx + dy * dy <= r2);
+    }
+}
+
+
+// edge by edge, so that the loops over the points have no branches
+static void overlapPolygon(const Point *vertices, int numVertices, float radius, const float *PSC_RESTRICT xs, const float *PSC_RESTRICT ys, int count, uint32_t *PSC_RESTRICT inside, uint32_t *PSC_RESTRICT hits)
+{
+    const float r2 = radius * radius;
+    memset(inside, 0, count * sizeof(uint32_t));
+    for (int i = 0, j = numVertices - 1; i < numVertices; j = i++)
+    {
+        const float xi = vertices[i].x, yi = vertices[i].y;
+        const float ex = vertices[j].x - xi, ey = vertices[j].y - yi;
+
+        // even-odd crossing test, the slope is only used if the edge spans y
+        const float slope = ey != 0.0f ? ex / ey : 0.0f;
+        const float yj = vertices[j].y;
+        int k = 0;
+#if PSC_QUERY_SIMD
+        const QueryFloats vxi = querySplat(xi), vyi = querySplat(yi), vyj = querySplat(yj), vslope = querySplat(slope);
+        for (; k + 4 <= count; k += 4)
+        {
+            QueryFloats x = queryLoad(xs + k), y = queryLoad(ys + k);
+            QueryMask spans = queryXor(queryLess(y, vyi), queryLess(y, vyj));
+            QueryMask left = queryLess(x, queryAdd(vxi, queryMul(vslope, querySub(y, vyi))));
+            queryStoreMask(inside + k, queryXor(queryLoadMask(inside + k), queryAnd(spans, left)));
+        }
+#endif
+        for (; k < count; k++)
+        {
+            inside[k] ^= queryMask(((yi > ys[k]) != (yj > ys[k])) & (xs[k] < xi + slope * (ys[k] - yi)));
+        }
+
+        if (radius > 0.0f)
+        {
+            // near the edge's inner part or its first vertex, comparisons
+            // instead of clamping keep the loop branch-free
+            const float length2 = ex * ex + ey * ey;
+            k = 0;
+#if PSC_QUERY_SIMD
+            const QueryFloats vex = querySplat(ex), vey = querySplat(ey), vlength2 = querySplat(length2);
+            const QueryFloats vr2 = querySplat(r2), vr2length2 = querySplat(r2 * length2), zero = querySplat(0.0f);
+            for (; k + 4 <= count; k += 4)
+            {
+                QueryFloats dx = querySub(queryLoad(xs + k), vxi), dy = querySub(queryLoad(ys + k), vyi);
+                QueryFloats along = queryAdd(queryMul(dx, vex), queryMul(dy, vey));
+                QueryFloats across = querySub(queryMul(dx, vey), queryMul(dy, vex));
+                QueryMask nearEdge = queryAnd(queryAnd(queryLessEqual(zero, along), queryLessEqual(along, vlength2)),
+                                              queryLessEqual(queryMul(across, across), vr2length2));
+                QueryMask nearVertex = queryLessEqual(queryAdd(queryMul(dx, dx), queryMul(dy, dy)), vr2);
+                queryStoreMask(hits + k, queryOr(queryLoadMask(hits + k), queryOr(nearEdge, nearVertex)));
+            }
+#endif
+            for (; k < count; k++)
+            {
+                float dx = xs[k] - xi, dy = ys[k] - yi;
+                float along = dx * ex + dy * ey, across = dx * ey - dy * ex;
+                hits[k] |= queryMask(((along >= 0.0f) & (along <= length2) & (across * across <= r2 * length2))
+                                     | (dx * dx + dy * dy <= r2));
+            }
+        }
+    }
+    for (int k = 0; k < count; k++)
+    {
+        hits[k] |= inside[k];
+    }
+}
+
+
+bool PhysicsShapeCache::queryShapes(const std::string &name, const QueryTransform &transform, const Point *points, int count, float radius, bool *results)
+{
+    BodyDef *bd = getQueryBodyDef(name, transform, count);
+    if (!bd)
+    {
+        return false;
+    }
+
+    // into body space, structure of arrays for the kernels
+    float c, s;
+    queryRotation(transform, c, s);
+    float *xs = queryX.data(), *ys = queryY.data();
+    uint32_t *hits = queryHits.data();
+    for (int k = 0; k < count; k++)
+    {
+        float dx = points[k].x - transform.position.x, dy = points[k].y - transform.position.y;
+        xs[k] = c * dx + s * dy;
+        ys[k] = c * dy - s * dx;
+        hits[k] = 0;
+    }
+
+    const Point *bodyVertices = bd->quantizedVertices ? dequantizeVertices(bd) : nullptr;
+    for (auto fd : bd->fixtures)
+    {
+        if (fd->fixtureType == FIXTURE_CIRCLE)
+        {
+            overlapCircle(fd->center, fd->radius + radius, xs, ys, count, hits);
+        }
+        else
+        {
+            for (auto polygon : fd->polygons)
+            {
+                const Point *vertices = bodyVertices ? bodyVertices + polygon->firstVertex : polygon->vertices;
+                overlapPolygon(vertices, polygon->numVertices, radius, xs, ys, count, queryInside.data(), hits);
+            }
+        }
+    }
+
+    for (int k = 0; k < count; k++)
+    {
+        results[k] = hits[k] != 0;
+    }
+    return true;
+}
+
+
+bool PhysicsShapeCache::containsPoint(const std::string &name, const QueryTransform &transform, const Point &point)
+{
+    bool result = false;
+    return queryShapes(name, transform, &point, 1, 0.0f, &result) && result;
+}
+
+
+bool PhysicsShapeCache::containsPoints(const std::string &name, const QueryTransform &transform, const Point *points, int count, bool *results)
+{
+    return queryShapes(name, transform, points, count, 0.0f, results);
+}
+
+
+bool PhysicsShapeCache::overlapsCircle(const std::string &name, const QueryTransform &transform, const Point &center, float radius)
+{
+    bool result = false;
+    return queryShapes(name, transform, &center, 1, radius, &result) && result;
+}
+
+
+bool PhysicsShapeCache::overlapsCircles(const std::string &name, const QueryTransform &transform, const Point *centers, int count, float radius, bool *results)
+{
+    return queryShapes(name, transform, centers, count, radius, results);
+}
+
+
+bool PhysicsShapeCache::rayCast(const std::string &name, const QueryTransform &transform, const Point &start, const Point &end, RayCastHit &hit)
+{
+    BodyDef *bd = getQueryBodyDef(name, transform, 0);
+    if (!bd)
+    {
+        return false;
+    }
+
+    float c, s;
+    queryRotation(transform, c, s);
+    Point p0 = start - transform.position;
+    Point p = Point(c * p0.x + s * p0.y, c * p0.y - s * p0.x);
+    Point d0 = end - start;
+    Point d = Point(c * d0.x + s * d0.y, c * d0.y - s * d0.x);
+
+    float best = FLT_MAX;
+    Point bestNormal;
+    const FixtureData *bestFixture = nullptr;
+    const Point *bodyVertices = bd->quantizedVertices ? dequantizeVertices(bd) : nullptr;
+    for (auto fd : bd->fixtures)
+    {
+        if (fd->fixtureType == FIXTURE_CIRCLE)
+        {
+            Point m = p - fd->center;
+            float a = d.dot(d), b = m.dot(d), rest = m.dot(m) - fd->radius * fd->radius;
+            float discriminant = b * b - a * rest;
+            if (rest < 0.0f || a <= 0.0f || discriminant < 0.0f)
+            {
+                // starts inside, no segment or misses
+                continue;
+            }
+            float t = (-b - sqrtf(discriminant)) / a;
+            if (t >= 0.0f && t <= 1.0f && t < best)
+            {
+                best = t;
+                bestNormal = (m + d * t).getNormalized();
+                bestFixture = fd;
+            }
+            continue;
+        }
+
+        for (auto polygon : fd->polygons)
+        {
+            // counter-clockwise, only edges the segment enters count
+            const Point *vertices = bodyVertices ? bodyVertices + polygon->firstVertex : polygon->vertices;
+            for (int i = 0, j = polygon->numVertices - 1; i < polygon->numVertices; j = i++)
+            {
+                Point edge = vertices[i] - vertices[j];
+                Point normal = Point(edge.y, -edge.x);
+                float denominator = d.dot(normal);
+                if (denominator >= 0.0f)
+                {
+                    continue;
+                }
+                float t = (vertices[j] - p).dot(normal) / denominator;
+                if (t < 0.0f || t > 1.0f || t >= best)
+                {
+                    continue;
+                }
+                float u = (p + d * t - vertices[j]).dot(edge);
+                if (u < 0.0f || u > edge.dot(edge))
+                {
+                    continue;
+                }
+                best = t;
+                bestNormal = normal.getNormalized();
+                bestFixture = fd;
+            }
+        }
+    }
+
+    if (!bestFixture)
+    {
+        return false;
+    }
+    hit.fraction = best;
+    hit.point = start + d0 * best;
+    hit.normal = Point(c * bestNormal.x - s * bestNormal.y, s * bestNormal.x + c * bestNormal.y);
+    hit.tag = fixtureTable.effective.tag[bestFixture->row];
+    return true;
+}
+
+
+PhysicsShapeCache::BodyDef *PhysicsShapeCache::getTransformedBodyDef(BodyDef *bd, const BodyTransform &transform)
+{
+    float sx = transform.flipX ? -transform.scaleX : transform.scaleX;
+    float sy = transform.flipY ? -transform.scaleY : transform.scaleY;
+    if (sx == 1.0f && sy == 1.0f)
+    {
+        return bd;
+    }
+
+    TransformKey key(bd, std::make_pair(sx, sy));
+    auto pos = transformedBodyDefs.find(key);
+    if (pos != transformedBodyDefs.end())
+    {
+        return pos->second;
+    }
+
+    BodyDef *result = new BodyDef();
+    result->refCount             = 1;
+    result->anchorPoint          = Point(sx < 0 ? 1.0f - bd->anchorPoint.x : bd->anchorPoint.x,
+                                         sy < 0 ? 1.0f - bd->anchorPoint.y : bd->anchorPoint.y);
+    result->isDynamic            = bd->isDynamic;
+    result->affectedByGravity    = bd->affectedByGravity;
+    result->allowsRotation       = bd->allowsRotation;
+    result->linearDamping        = bd->linearDamping;
+    result->angularDamping       = bd->angularDamping;
+    result->velocityLimit        = bd->velocityLimit;
+    result->angularVelocityLimit = bd->angularVelocityLimit;
+
+    // mirroring on one axis turns counter-clockwise polygons clockwise
+    bool reverse = (sx < 0) != (sy < 0);
+    float radiusScale = sqrtf(fabsf(sx * sy));
+
+    const Point *bodyVertices = bd->quantizedVertices ? dequantizeVertices(bd) : nullptr;
+    for (auto fd : bd->fixtures)
+    {
+        FixtureData *tfd = new FixtureData(*fd);
+        tfd->refCount = 1;
+        tfd->hash = 0;
+        tfd->row = fixtureTable.addRow();
+        fixtureTable.base.copyRow(tfd->row, fixtureTable.base, fd->row);
+        fixtureTable.effective.copyRow(tfd->row, fixtureTable.effective, fd->row);
+        tfd->center = Point(fd->center.x * sx, fd->center.y * sy);
+        tfd->radius = fd->radius * radiusScale;
+        for (auto &polygon : tfd->polygons)
+        {
+            const Point *vertices = bodyVertices ? bodyVertices + polygon->firstVertex : polygon->vertices;
+            Polygon *tpoly = new Polygon();
+            tpoly->refCount = 1;
+            tpoly->numVertices = polygon->numVertices;
+            tpoly->vertices = new Point[polygon->numVertices];
+            for (int i = 0; i < polygon->numVertices; i++)
+            {
+                int dst = reverse ? polygon->numVertices - 1 - i : i;
+                tpoly->vertices[dst] = Point(vertices[i].x * sx, vertices[i].y * sy);
+            }
+            polygon = tpoly;
+        }
+        result->fixtures.push_back(tfd);
+    }
+
+    transformedBodyDefs.insert(std::make_pair(key, result));
+    return result;
+}
+
+
+void PhysicsShapeCache::removeShapesWithFile(const std::string &plist)
+{
+    auto file = bodiesInFile.find(plist);
+    if (file == bodiesInFile.end())
+    {
+        return;
+    }
+
+    // the file's names, other names can point to the same shared bodies
+    std::vector<std::string> removedNames;
+    auto names = namesInFile.find(plist);
+    if (names != namesInFile.end())
+    {
+        for (auto entry : names->second)
+        {
+            removedNames.push_back(entry->first);
+            bodyDefs.erase(entry);
+        }
+        namesInFile.erase(names);
+    }
+
+    for (auto bd : file->second)
+    {
+        releaseBodyDef(bd);
+    }
+    bodiesInFile.erase(file);
+    residency.erase(plist);
+
+    auto slots = indexSlotsInFile.find(plist);
+    if (slots != indexSlotsInFile.end())
+    {
+        bodyIndex.removeBodies(slots->second);
+        indexSlotsInFile.erase(slots);
+    }
+
+    auto lazyFile = lazyFiles.find(plist);
+    if (lazyFile != lazyFiles.end())
+    {
+        // drop the index entries of bodies that were never used
+        for (auto iter = lazyBodies.begin(); iter != lazyBodies.end(); )
+        {
+            if (iter->second.file == lazyFile->second)
+            {
+                removedNames.push_back(iter->first);
+                iter = lazyBodies.erase(iter);
+            }
+            else
+            {
+                ++iter;
+            }
+        }
+        delete lazyFile->second;
+        lazyFiles.erase(lazyFile);
+    }
+
+    auto packFile = packFiles.find(plist);
+    if (packFile != packFiles.end())
+    {
+        // names of the pack that no other file hides
+        PackFile *pack = packFile->second;
+        const PhysicsShapePack::PackView &view = pack->view;
+        for (uint32_t i = 0; i < view.numBodies; i++)
+        {
+            std::string name = view.names + view.nameOffsets[i];
+            int index;
+            if (bodyDefs.find(name) == bodyDefs.end() && lazyBodies.find(name) == lazyBodies.end()
+                && findPackBody(name, index) == pack)
+            {
+                removedNames.push_back(name);
+            }
+        }
+        packLoadOrder.erase(std::find(packLoadOrder.begin(), packLoadOrder.end(), pack));
+        delete pack;
+        packFiles.erase(packFile);
+    }
+
+    unshadowBodies(plist, removedNames);
+    return;
+}
+
+
+bool PhysicsShapeCache::isBodyNameTaken(const std::string &name) const
+{
+    int index;
+    return bodyDefs.find(name) != bodyDefs.end() || lazyBodies.find(name) != lazyBodies.end()
+        || findPackBody(name, index) != nullptr;
+}
+
+
+void PhysicsShapeCache::shadowBody(const std::string &plist, const std::string &name, BodyDef *bd, const LazyBody *lazy)
+{
+    ShadowedBody shadowed;
+    shadowed.plist = plist;
+    shadowed.bodyDef = bd;
+    shadowed.lazy = lazy ? *lazy : LazyBody();
+    shadowed.loadNumber = loadCounter;
+    shadowedBodies[name].push_back(shadowed);
+}
+
+
+void PhysicsShapeCache::unshadowBodies(const std::string &plist, const std::vector<std::string> &names)
+{
+    // forget the removed file's hidden bodies, they are released with the file
+    for (auto iter = shadowedBodies.begin(); iter != shadowedBodies.end(); )
+    {
+        auto &candidates = iter->second;
+        candidates.erase(std::remove_if(candidates.begin(), candidates.end(),
+                                        [&plist](const ShadowedBody &shadowed) { return shadowed.plist == plist; }),
+                         candidates.end());
+        iter = candidates.empty() ? shadowedBodies.erase(iter) : std::next(iter);
+    }
+
+    // the names point to the body of the next file loaded, unless a pack
+    // loaded before that file still has them
+    for (auto &name : names)
+    {
+        auto iter = shadowedBodies.find(name);
+        if (iter == shadowedBodies.end() || bodyDefs.find(name) != bodyDefs.end()
+            || lazyBodies.find(name) != lazyBodies.end())
+        {
+            continue;
+        }
+        int index;
+        const PackFile *pack = findPackBody(name, index);
+        if (pack && pack->loadNumber < iter->second.front().loadNumber)
+        {
+            continue;
+        }
+        ShadowedBody shadowed = iter->second.front();
+        iter->second.erase(iter->second.begin());
+        if (iter->second.empty())
+        {
+            shadowedBodies.erase(iter);
+        }
+
+        if (shadowed.bodyDef)
+        {
+            auto result = bodyDefs.insert(std::make_pair(name, shadowed.bodyDef));
+            namesInFile[shadowed.plist].push_back(result.first);
+            indexBodyDef(shadowed.plist, name, shadowed.bodyDef);
+        }
+        else
+        {
+            lazyBodies.insert(std::make_pair(name, shadowed.lazy));
+            indexLazyBody(shadowed.plist, name, shadowed.lazy);
+        }
+    }
+}
+
+
+PhysicsShapeCache::FileHandle::FileHandle(PhysicsShapeCache *cache, const std::string &plist)
+: cache(cache)
+, plist(plist)
+{
+    cache->retainFile(plist);
+}
+
+
+PhysicsShapeCache::FileHandle::FileHandle(const FileHandle &other)
+: cache(other.cache)
+, plist(other.plist)
+{
+    if (cache)
+    {
+        cache->retainFile(plist);
+    }
+}
+
+
+PhysicsShapeCache::FileHandle &PhysicsShapeCache::FileHandle::operator=(const FileHandle &other)
+{
+    if (other.cache)
+    {
+        other.cache->retainFile(other.plist);
+    }
+    reset();
+    cache = other.cache;
+    plist = other.plist;
+    return *this;
+}
+
+
+PhysicsShapeCache::FileHandle::~FileHandle()
+{
+    reset();
+}
+
+
+void PhysicsShapeCache::FileHandle::reset()
+{
+    if (cache)
+    {
+        PhysicsShapeCache *owner = cache;
+        cache = nullptr;
+        owner->releaseFile(plist); // can evict and call back into the game
+    }
+}
+
+
+PhysicsShapeCache::FileHandle PhysicsShapeCache::acquireFile(const std::string &plist)
+{
+    return acquireFile(plist, Director::getInstance()->getContentScaleFactor(), LOAD_EAGER);
+}
+
+
+PhysicsShapeCache::FileHandle PhysicsShapeCache::acquireFile(const std::string &plist, float scaleFactor, LoadMode mode)
+{
+    if (bodiesInFile.find(plist) == bodiesInFile.end())
+    {
+        if (!addShapesWithFile(plist, scaleFactor, mode))
+        {
+            return FileHandle();
+        }
+        Residency &file = residency[plist];
+        file.handles = 0;
+        file.lastUse = 0;
+        file.bytes = getFileMemoryUsage(plist).bytes;
+    }
+
+    // files loaded with addShapesWithFile() have no residency and stay loaded
+    FileHandle handle(this, plist);
+    trimToMemoryBudget();
+    return handle;
+}
+
+
+void PhysicsShapeCache::retainFile(const std::string &plist)
+{
+    auto file = residency.find(plist);
+    if (file != residency.end())
+    {
+        file->second.handles++;
+    }
+}
+
+
+void PhysicsShapeCache::releaseFile(const std::string &plist)
+{
+    auto file = residency.find(plist);
+    if (file == residency.end() || --file->second.handles > 0)
+    {
+        return;
+    }
+    file->second.lastUse = ++releaseCounter;
+    file->second.bytes = getFileMemoryUsage(plist).bytes; // lazy files grow with use
+    trimToMemoryBudget();
+}
+
+
+void PhysicsShapeCache::setMemoryBudget(size_t bytes)
+{
+    memoryBudget = bytes;
+    trimToMemoryBudget();
+}
+
+
+void PhysicsShapeCache::trimToMemoryBudget()
+{
+    if (memoryBudget == 0)
+    {
+        return;
+    }
+
+    size_t total = 0;
+    for (auto &file : residency)
+    {
+        total += file.second.bytes;
+    }
+
+    while (total > memoryBudget)
+    {
+        auto victim = residency.end();
+        for (auto iter = residency.begin(); iter != residency.end(); ++iter)
+        {
+            if (iter->second.handles == 0 && (victim == residency.end() || iter->second.lastUse < victim->second.lastUse))
+            {
+                victim = iter;
+            }
+        }
+        if (victim == residency.end())
+        {
+            // everything left is in use
+            return;
+        }
+
+        total -= victim->second.bytes;
+        std::string plist = victim->first;
+        removeShapesWithFile(plist);
+        if (evictionCallback)
+        {
+            evictionCallback(plist);
+        }
+    }
+}
+
+
+void PhysicsShapeCache::removeAllShapes()
+{
+    // bodyDefs can hold the same body under several names, bodiesInFile
+    // holds each reference exactly once
+    for (auto iter = bodiesInFile.cbegin(); iter != bodiesInFile.cend(); ++iter)
+    {
+        for (auto bd : iter->second)
+        {
+            releaseBodyDef(bd);
+        }
+    }
+    bodyDefs.clear();
+    bodiesInFile.clear();
+    namesInFile.clear();
+    residency.clear();
+    bodyIndex.clear();
+    indexSlotsInFile.clear();
+
+    for (auto iter = lazyFiles.cbegin(); iter != lazyFiles.cend(); ++iter)
+    {
+        delete iter->second;
+    }
+    lazyFiles.clear();
+    lazyBodies.clear();
+    shadowedBodies.clear();
+
+    for (auto iter = packFiles.cbegin(); iter != packFiles.cend(); ++iter)
+    {
+        delete iter->second;
+    }
+    packFiles.clear();
+    packLoadOrder.clear();
+}
+
+
+void PhysicsShapeCache::releaseBodyDef(BodyDef *bodyDef)
+{
+    if (--bodyDef->refCount > 0)
+    {
+        return;
+    }
+    releasePool(bodyDef);
+    releaseDebugGeometry(bodyDef);
+
+    // mirrored and scaled copies
+    auto first = transformedBodyDefs.lower_bound(TransformKey(bodyDef, std::make_pair(-FLT_MAX, -FLT_MAX)));
+    auto last = first;
+    while (last != transformedBodyDefs.end() && last->first.first == bodyDef)
+    {
+        releaseBodyDef(last->second);
+        ++last;
+    }
+    transformedBodyDefs.erase(first, last);
+
+    auto range = sharedBodies.equal_range(bodyDef->hash);
+    for (auto iter = range.first; iter != range.second; ++iter)
+    {
+        if (iter->second == bodyDef)
+        {
+            sharedBodies.erase(iter);
+            break;
+        }
+    }
+
+    for (auto fixturedata : bodyDef->fixtures)
+    {
+        releaseFixtureData(fixturedata);
+    }
+    bodyDef->fixtures.clear();
+    AX_SAFE_DELETE_ARRAY(bodyDef->quantizedVertices);
+    AX_SAFE_DELETE(bodyDef);
+}
+
+
+void PhysicsShapeCache::releaseFixtureData(FixtureData *fd)
+{
+    if (--fd->refCount > 0)
+    {
+        return;
+    }
+
+    auto range = sharedFixtures.equal_range(fd->hash);
+    for (auto iter = range.first; iter != range.second; ++iter)
+    {
+        if (iter->second == fd)
+        {
+            sharedFixtures.erase(iter);
+            break;
+        }
+    }
+
+    for (auto polygon : fd->polygons)
+    {
+        releasePolygon(polygon);
+    }
+    fd->polygons.clear();
+    fixtureTable.releaseRow(fd->row);
+    AX_SAFE_DELETE(fd);
+}
+
+
+void PhysicsShapeCache::releasePolygon(Polygon *polygon)
+{
+    if (--polygon->refCount > 0)
+    {
+        return;
+    }
+
+    auto range = sharedPolygons.equal_range(polygon->hash);
+    for (auto iter = range.first; iter != range.second; ++iter)
+    {
+        if (iter->second == polygon)
+        {
+            sharedPolygons.erase(iter);
+            break;
+        }
+    }
+
+    if (!polygon->externalVertices)
+    {
+        AX_SAFE_DELETE_ARRAY(polygon->vertices);
+    }
+    AX_SAFE_DELETE(polygon);
+}
+
+
+bool PhysicsShapeCache::samePolygon(const Polygon *a, const Polygon *b)
+{
+    if (a == b)
+    {
+        return true;
+    }
+    if (a->numVertices != b->numVertices || !a->vertices != !b->vertices)
+    {
+        return false;
+    }
+    if (!a->vertices)
+    {
+        // compact storage, vertices are compared with the body
+        return a->firstVertex == b->firstVertex;
+    }
+    return memcmp(a->vertices, b->vertices, a->numVertices * sizeof(Point)) == 0;
+}
+
+
+bool PhysicsShapeCache::sameFixtureData(const FixtureData *a, const FixtureData *b) const
+{
+    if (a == b)
+    {
+        return true;
+    }
+    const FixtureColumns &base = fixtureTable.base;
+    int ra = a->row, rb = b->row;
+    if (a->fixtureType != b->fixtureType
+        || base.density[ra] != base.density[rb] || base.restitution[ra] != base.restitution[rb]
+        || base.friction[ra] != base.friction[rb] || base.tag[ra] != base.tag[rb] || base.group[ra] != base.group[rb]
+        || base.categoryMask[ra] != base.categoryMask[rb] || base.collisionMask[ra] != base.collisionMask[rb]
+        || base.contactTestMask[ra] != base.contactTestMask[rb]
+        || a->center != b->center || a->radius != b->radius
+        || a->polygons.size() != b->polygons.size())
+    {
+        return false;
+    }
+    for (size_t i = 0; i < a->polygons.size(); i++)
+    {
+        if (!samePolygon(a->polygons[i], b->polygons[i]))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+bool PhysicsShapeCache::sameBodyDef(const BodyDef *a, const BodyDef *b) const
+{
+    if (a->anchorPoint != b->anchorPoint
+        || a->isDynamic != b->isDynamic || a->affectedByGravity != b->affectedByGravity
+        || a->allowsRotation != b->allowsRotation
+        || a->linearDamping != b->linearDamping || a->angularDamping != b->angularDamping
+        || a->velocityLimit != b->velocityLimit || a->angularVelocityLimit != b->angularVelocityLimit
+        || a->numQuantizedVertices != b->numQuantizedVertices
+        || a->quantizedOrigin != b->quantizedOrigin || a->quantizedStep != b->quantizedStep
+        || a->fixtures.size() != b->fixtures.size())
+    {
+        return false;
+    }
+    if (a->numQuantizedVertices &&
+        memcmp(a->quantizedVertices, b->quantizedVertices, a->numQuantizedVertices * 2 * sizeof(uint16_t)) != 0)
+    {
+        return false;
+    }
+    for (size_t i = 0; i < a->fixtures.size(); i++)
+    {
+        if (!sameFixtureData(a->fixtures[i], b->fixtures[i]))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+PhysicsShapeCache::Polygon *PhysicsShapeCache::sharePolygon(Polygon *polygon)
+{
+    polygon->hash = hashBytes(hashValue(HASH_SEED, polygon->numVertices),
+                              polygon->vertices, polygon->numVertices * sizeof(Point));
+
+    auto range = sharedPolygons.equal_range(polygon->hash);
+    for (auto iter = range.first; iter != range.second; ++iter)
+    {
+        if (samePolygon(iter->second, polygon))
+        {
+            iter->second->refCount++;
+            releasePolygon(polygon);
+            return iter->second;
+        }
+    }
+    sharedPolygons.insert(std::make_pair(polygon->hash, polygon));
+    return polygon;
+}
+
+
+PhysicsShapeCache::FixtureData *PhysicsShapeCache::shareFixtureData(FixtureData *fd)
+{
+    for (auto &polygon : fd->polygons)
+    {
+        polygon = sharePolygon(polygon);
+    }
+
+    uint64_t hash = HASH_SEED;
+    hash = hashValue(hash, fd->fixtureType);
+    const FixtureColumns &base = fixtureTable.base;
+    hash = hashValue(hash, base.density[fd->row]);
+    hash = hashValue(hash, base.restitution[fd->row]);
+    hash = hashValue(hash, base.friction[fd->row]);
+    hash = hashValue(hash, base.tag[fd->row]);
+    hash = hashValue(hash, base.group[fd->row]);
+    hash = hashValue(hash, base.categoryMask[fd->row]);
+    hash = hashValue(hash, base.collisionMask[fd->row]);
+    hash = hashValue(hash, base.contactTestMask[fd->row]);
+    hash = hashValue(hash, fd->center);
+    hash = hashValue(hash, fd->radius);
+    for (auto polygon : fd->polygons)
+    {
+        hash = hashValue(hash, polygon->hash);
+    }
+    fd->hash = hash;
+
+    auto range = sharedFixtures.equal_range(fd->hash);
+    for (auto iter = range.first; iter != range.second; ++iter)
+    {
+        if (sameFixtureData(iter->second, fd))
+        {
+            iter->second->refCount++;
+            releaseFixtureData(fd);
+            return iter->second;
+        }
+    }
+    sharedFixtures.insert(std::make_pair(fd->hash, fd));
+    return fd;
+}
+
+
+PhysicsShapeCache::BodyDef *PhysicsShapeCache::shareBodyDef(BodyDef *bodyDef)
+{
+    uint64_t hash = HASH_SEED;
+    for (auto &fd : bodyDef->fixtures)
+    {
+        if (!bodyDef->quantizedVertices)
+        {
+            // compact polygons refer to the body's vertex array and can't be shared
+            fd = shareFixtureData(fd);
+        }
+        hash = hashValue(hash, fd->hash);
+    }
+    hash = hashValue(hash, bodyDef->anchorPoint);
+    hash = hashValue(hash, bodyDef->isDynamic);
+    hash = hashValue(hash, bodyDef->affectedByGravity);
+    hash = hashValue(hash, bodyDef->allowsRotation);
+    hash = hashValue(hash, bodyDef->linearDamping);
+    hash = hashValue(hash, bodyDef->angularDamping);
+    hash = hashValue(hash, bodyDef->velocityLimit);
+    hash = hashValue(hash, bodyDef->angularVelocityLimit);
+    hash = hashBytes(hash, bodyDef->quantizedVertices, bodyDef->numQuantizedVertices * 2 * sizeof(uint16_t));
+    bodyDef->hash = hash;
+
+    auto range = sharedBodies.equal_range(bodyDef->hash);
+    for (auto iter = range.first; iter != range.second; ++iter)
+    {
+        if (sameBodyDef(iter->second, bodyDef))
+        {
+            iter->second->refCount++;
+            releaseBodyDef(bodyDef);
+            return iter->second;
+        }
+    }
+    sharedBodies.insert(std::make_pair(bodyDef->hash, bodyDef));
+    return bodyDef;
+}
+
+
+static size_t stringHeapSize(const std::string &s)
+{
+    // short strings are stored inside the string object itself
+    return s.capacity() > std::string().capacity() ? s.capacity() + 1 : 0;
+}
+
+
+// base and effective values and generation of a fixtureTable row
+static const size_t FIXTURE_ROW_BYTES = 2 * (3 * sizeof(float) + 5 * sizeof(int)) + sizeof(unsigned int);
+
+
+static bool compareMemoryUsage(const PhysicsShapeCache::MemoryUsage &a, const PhysicsShapeCache::MemoryUsage &b)
+{
+    return a.bytes > b.bytes;
+}
+
+
+void PhysicsShapeCache::addBodyDefMemoryUsage(MemoryUsage &usage, const BodyDef *bd, std::unordered_set<const void *> &counted) const
+{
+    usage.numBodies++;
+    if (!counted.insert(bd).second)
+    {
+        return;
+    }
+    usage.bytes += sizeof(BodyDef) + bd->fixtures.capacity() * sizeof(FixtureData *)
+                 + bd->numQuantizedVertices * 2 * sizeof(uint16_t);
+    for (auto fd : bd->fixtures)
+    {
+        usage.numFixtures++;
+        if (counted.insert(fd).second)
+        {
+            usage.bytes += sizeof(FixtureData) + fd->polygons.capacity() * sizeof(Polygon *) + FIXTURE_ROW_BYTES;
+        }
+        for (auto polygon : fd->polygons)
+        {
+            usage.numPolygons++;
+            usage.numVertices += polygon->numVertices;
+            if (counted.insert(polygon).second)
+            {
+                bool ownsVertices = polygon->vertices && !polygon->externalVertices;
+                usage.bytes += sizeof(Polygon) + (ownsVertices ? polygon->numVertices * sizeof(Point) : 0);
+            }
+        }
+    }
+}
+
+
+PhysicsShapeCache::MemoryUsage PhysicsShapeCache::getBodyMemoryUsage(const std::string &name) const
+{
+    MemoryUsage usage = MemoryUsage();
+    usage.name = name;
+    auto pos = bodyDefs.find(name);
+    if (pos != bodyDefs.end())
+    {
+        std::unordered_set<const void *> counted;
+        addBodyDefMemoryUsage(usage, pos->second, counted);
+        usage.bytes += MAP_NODE_OVERHEAD + sizeof(*pos) + stringHeapSize(pos->first);
+    }
+    else if (const BodyDef *bd = findDecodedPackBodyDef(name))
+    {
+        std::unordered_set<const void *> counted;
+        addBodyDefMemoryUsage(usage, bd, counted);
+    }
+    return usage;
+}
+
+
+PhysicsShapeCache::MemoryUsage PhysicsShapeCache::getFileMemoryUsage(const std::string &plist) const
+{
+    MemoryUsage usage = MemoryUsage();
+    usage.name = plist;
+    auto pos = bodiesInFile.find(plist);
+    if (pos == bodiesInFile.end())
+    {
+        return usage;
+    }
+
+    const std::vector<BodyDef *> &bodies = pos->second;
+    usage.bytes += MAP_NODE_OVERHEAD + sizeof(*pos) + stringHeapSize(pos->first)
+                 + bodies.capacity() * sizeof(BodyDef *);
+    std::unordered_set<const void *> counted;
+    for (auto bd : bodies)
+    {
+        addBodyDefMemoryUsage(usage, bd, counted);
+    }
+
+    auto lazyFile = lazyFiles.find(plist);
+    if (lazyFile != lazyFiles.end())
+    {
+        usage.bytes += MAP_NODE_OVERHEAD + sizeof(*lazyFile) + stringHeapSize(lazyFile->first)
+                     + sizeof(LazyFile) + stringHeapSize(lazyFile->second->plist)
+                     + (lazyFile->second->storage ? lazyFile->second->size : 0);
+        for (auto &entry : lazyBodies)
+        {
+            if (entry.second.file == lazyFile->second)
+            {
+                usage.bytes += MAP_NODE_OVERHEAD + sizeof(entry) + stringHeapSize(entry.first);
+            }
+        }
+    }
+
+    auto packFile = packFiles.find(plist);
+    if (packFile != packFiles.end())
+    {
+        usage.bytes += MAP_NODE_OVERHEAD + sizeof(*packFile) + stringHeapSize(packFile->first)
+                     + sizeof(PackFile) + stringHeapSize(packFile->second->name)
+                     + packFile->second->bodies.capacity() * sizeof(BodyDef *)
+                     + packFile->second->data.getSize();
+    }
+
+    // name index entries pointing to the file's bodies
+    std::unordered_set<const BodyDef *> fileBodies(bodies.begin(), bodies.end());
+    for (auto &entry : bodyDefs)
+    {
+        if (fileBodies.count(entry.second))
+        {
+            usage.bytes += MAP_NODE_OVERHEAD + sizeof(entry) + stringHeapSize(entry.first);
+        }
+    }
+    return usage;
+}
+
+
+PhysicsShapeCache::MemoryReport PhysicsShapeCache::getMemoryReport(size_t maxEntries) const
+{
+    MemoryReport report = MemoryReport();
+    report.totalBytes = sizeof(PhysicsShapeCache);
+
+    for (auto &entry : bodyDefs)
+    {
+        report.totalBytes += MAP_NODE_OVERHEAD + sizeof(entry) + stringHeapSize(entry.first);
+        report.bodies.push_back(getBodyMemoryUsage(entry.first));
+    }
+
+    // shared data is counted once
+    MemoryUsage all = MemoryUsage();
+    std::unordered_set<const void *> counted;
+    for (auto &entry : bodiesInFile)
+    {
+        for (auto bd : entry.second)
+        {
+            addBodyDefMemoryUsage(all, bd, counted);
+        }
+        report.totalBytes += MAP_NODE_OVERHEAD + sizeof(entry) + stringHeapSize(entry.first)
+                           + entry.second.capacity() * sizeof(BodyDef *);
+        report.files.push_back(getFileMemoryUsage(entry.first));
+    }
+    for (auto &entry : namesInFile)
+    {
+        report.totalBytes += MAP_NODE_OVERHEAD + sizeof(entry) + stringHeapSize(entry.first)
+                           + entry.second.capacity() * sizeof(entry.second[0]);
+    }
+    for (auto &entry : residency)
+    {
+        report.totalBytes += MAP_NODE_OVERHEAD + sizeof(entry) + stringHeapSize(entry.first);
+    }
+    for (auto &entry : transformedBodyDefs)
+    {
+        addBodyDefMemoryUsage(all, entry.second, counted);
+        report.totalBytes += MAP_NODE_OVERHEAD + sizeof(entry);
+    }
+    report.totalBytes += all.bytes;
+
+    // hash tables used to find identical shapes: one node and one bucket per entry
+    size_t sharedEntries = sharedBodies.size() + sharedFixtures.size() + sharedPolygons.size();
+    report.totalBytes += sharedEntries * (sizeof(void *) * 2 + sizeof(std::pair<uint64_t, void *>) + sizeof(void *));
+    for (auto &entry : lazyFiles)
+    {
+        report.totalBytes += MAP_NODE_OVERHEAD + sizeof(entry) + stringHeapSize(entry.first)
+                           + sizeof(LazyFile) + stringHeapSize(entry.second->plist) + entry.second->size;
+    }
+    for (auto &entry : lazyBodies)
+    {
+        report.totalBytes += MAP_NODE_OVERHEAD + sizeof(entry) + stringHeapSize(entry.first);
+    }
+    for (auto &entry : packFiles)
+    {
+        report.totalBytes += MAP_NODE_OVERHEAD + sizeof(entry) + stringHeapSize(entry.first)
+                           + sizeof(PackFile) + stringHeapSize(entry.second->name)
+                           + entry.second->bodies.capacity() * sizeof(BodyDef *)
+                           + entry.second->data.getSize();
+        const PhysicsShapePack::PackView &pack = entry.second->view;
+        for (size_t i = 0; i < entry.second->bodies.size(); i++)
+        {
+            if (entry.second->bodies[i])
+            {
+                report.bodies.push_back(getBodyMemoryUsage(pack.names + pack.nameOffsets[i]));
+            }
+        }
+    }
+
+    // indices of findBodies()
+    for (auto &entry : bodyIndex.entries)
+    {
+        report.totalBytes += sizeof(entry) + stringHeapSize(entry.name);
+    }
+    report.totalBytes += bodyIndex.freeSlots.capacity() * sizeof(int) + bodyIndex.all.capacity() * sizeof(uint64_t);
+    for (auto *index : { &bodyIndex.byTag, &bodyIndex.byGroup })
+    {
+        for (auto &entry : *index)
+        {
+            report.totalBytes += sizeof(void *) * 2 + sizeof(entry) + entry.second.capacity() * sizeof(uint64_t);
+        }
+    }
+    for (auto &set : bodyIndex.byCategory)
+    {
+        report.totalBytes += set.capacity() * sizeof(uint64_t);
+    }
+    for (auto &entry : indexSlotsInFile)
+    {
+        report.totalBytes += MAP_NODE_OVERHEAD + sizeof(entry) + stringHeapSize(entry.first)
+                           + entry.second.capacity() * sizeof(int);
+    }
+
+    std::sort(report.files.begin(), report.files.end(), compareMemoryUsage);
+    std::sort(report.bodies.begin(), report.bodies.end(), compareMemoryUsage);
+    if (report.files.size() > maxEntries)
+    {
+        report.files.resize(maxEntries);
+    }
+    if (report.bodies.size() > maxEntries)
+    {
+        report.bodies.resize(maxEntries);
+    }
+    return report;
+}
+
+
+#if PHYSICSSHAPECACHE_STATS
+void PhysicsShapeCache::recordInstantiation(const std::string &name, double micros)
+{
+    BodyStats &bs = stats.bodies[name];
+    bs.instantiations++;
+    bs.totalMicros += micros;
+    bs.maxMicros = std::max(bs.maxMicros, micros);
+
+    int bucket = 0;
+    while (bucket < LATENCY_BUCKETS - 1 && micros >= (double)(2u << bucket))
+    {
+        bucket++;
+    }
+    bs.histogram[bucket]++;
+}
+
+
+PhysicsShapeCache::Stats PhysicsShapeCache::getStats()
+{
+    stats.liveBodyDefs = (int)bodyDefs.size();
+    for (auto iter = packFiles.cbegin(); iter != packFiles.cend(); ++iter)
+    {
+        stats.liveBodyDefs += (int)bodiesInFile[iter->first].size();
+    }
+    stats.pooledBodies = 0;
+    for (auto &pool : bodyPools)
+    {
+        stats.pooledBodies += (unsigned int)pool.second.size();
+    }
+    return stats;
+}
+
+
+void PhysicsShapeCache::resetStats()
+{
+    stats.files.clear();
+    stats.bodies.clear();
+    stats.lookupHits = 0;
+    stats.lookupAliasHits = 0;
+    stats.lookupMisses = 0;
+    stats.bodiesBuilt = 0;
+}
+#endif
+
+
+#if PHYSICSSHAPECACHE_TRACE
+void PhysicsShapeCache::traceBody(const char *span, const std::string &name, ShapeCacheTrace::Clock::time_point start, const BodyDef *bd)
+{
+    if (!trace.isEnabled() || !bd)
+    {
+        trace.record(span, name, start);
+        return;
+    }
+
+    int numVertices = bd->numQuantizedVertices;
+    if (!bd->quantizedVertices)
+    {
+        for (auto fd : bd->fixtures)
+        {
+            for (auto polygon : fd->polygons)
+            {
+                numVertices += polygon->numVertices;
+            }
+        }
+    }
+    trace.record(span, name, start, (int)bd->fixtures.size(), numVertices);
+}
+
+
+bool PhysicsShapeCache::writeTrace(const std::string &path) const
+{
+    return FileUtils::getInstance()->writeStringToFile(trace.toJson(), path);
 }
+#endif
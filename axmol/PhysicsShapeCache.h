@@ -30,13 +30,52 @@
 #ifndef __PhysicsShapeCache_h__
 #define __PhysicsShapeCache_h__
 #include "axmol.h"
+#include "PhysicsShapePack.h"
+#include <climits>
+#include <functional>
+#include <unordered_set>
 
 USING_NS_AX;
 
+/**
+ * Set to 1 to record load timings, lookup counters and instantiation
+ * latencies. When 0, no instrumentation code is compiled in.
+ */
+#ifndef PHYSICSSHAPECACHE_STATS
+#define PHYSICSSHAPECACHE_STATS 0
+#endif
+
+/**
+ * Set to 1 to record trace spans of file reading, parsing, body building,
+ * lookups and instantiation, see setTraceEnabled(). When 0, no tracing
+ * code is compiled in.
+ */
+#ifndef PHYSICSSHAPECACHE_TRACE
+#define PHYSICSSHAPECACHE_TRACE 0
+#endif
+
+/**
+ * Set to 1 to read files compressed with pe_shape_pack.py compress (.pscz).
+ * Needs shape-pack/PhysicsShapeInflate.cpp and zlib. When 0, .pscz files
+ * are read like any other file and fail to parse.
+ */
+#ifndef PHYSICSSHAPECACHE_COMPRESSED
+#define PHYSICSSHAPECACHE_COMPRESSED 0
+#endif
+
+#if PHYSICSSHAPECACHE_TRACE
+#include "ShapeCacheTrace.h"
+#endif
+
 
 class PhysicsShapeCache
 {
 public:
+    typedef enum
+    {
+        LOAD_EAGER, ///< build all bodies when the file is added
+        LOAD_LAZY   ///< index the body names only, build each body on first use
+    } LoadMode;
 
     /**
      * Get pointer to the PhysicsShapeCache singleton instance
@@ -68,12 +107,280 @@ public:
     bool addShapesWithFile(const std::string &plist, float scaleFactor);
 
     /**
-     * Removes all shapes loaded from the given file
+     * Adds all physics shapes from a plist file.
+     *
+     * With LOAD_LAZY only the names and the location of the bodies are
+     * read. The file's contents are kept in memory until each body has
+     * been decoded the first time it is requested.
+     *
+     * With PHYSICSSHAPECACHE_COMPRESSED, files compressed with
+     * pe_shape_pack.py compress (.pscz) are inflated while they are read,
+     * from the APK too on Android.
+     *
+     * @param plist name of the shape definitions file to load
+     * @param scaleFactor scale factor to apply for all shapes
+     * @param mode when to build the body definitions
+     *
+     * @retval true if ok
+     * @retval false on error
+     */
+    bool addShapesWithFile(const std::string &plist, float scaleFactor, LoadMode mode);
+
+    /**
+     * Adds several shape files in one pass. Shapes are scaled by
+     * contentScaleFactor
+     *
+     * @param plists names of the shape definitions files to load
+     *
+     * @retval true if all files were loaded
+     * @retval false if a file could not be loaded, the others are added
+     */
+    bool addShapesWithFiles(const std::vector<std::string> &plists);
+
+    /**
+     * Adds several shape files in one pass. The sizes are looked up first,
+     * then the files are read one after the other into a single buffer.
+     * Lazily loaded files keep sharing the buffer until the last of them
+     * is removed. Each file can still be removed on its own with
+     * removeShapesWithFile(). Compressed files are not supported here,
+     * use a compressed bundle instead.
+     *
+     * @param plists names of the shape definitions files to load
+     * @param scaleFactor scale factor to apply for all shapes
+     * @param mode when to build the body definitions
+     *
+     * @retval true if all files were loaded
+     * @retval false if a file could not be loaded, the others are added
+     */
+    bool addShapesWithFiles(const std::vector<std::string> &plists, float scaleFactor, LoadMode mode);
+
+    /**
+     * Adds all files of a bundle made with shape-pack/pe_shape_pack.py.
+     * Shapes are scaled by contentScaleFactor
+     *
+     * @param bundle name of the bundle file
+     *
+     * @retval true if all files were loaded
+     * @retval false if the bundle or a file in it could not be loaded
+     */
+    bool addShapesWithBundle(const std::string &bundle);
+
+    /**
+     * Adds all files of a bundle made with shape-pack/pe_shape_pack.py,
+     * read with a single file access. The files are added under the names
+     * stored in the bundle and can be removed one by one. The bundle can
+     * be compressed with pe_shape_pack.py compress, see
+     * PHYSICSSHAPECACHE_COMPRESSED.
+     *
+     * @param bundle name of the bundle file
+     * @param scaleFactor scale factor to apply for all shapes
+     * @param mode when to build the body definitions
+     *
+     * @retval true if all files were loaded
+     * @retval false if the bundle or a file in it could not be loaded
+     */
+    bool addShapesWithBundle(const std::string &bundle, float scaleFactor, LoadMode mode);
+
+    /**
+     * Adds the shapes of a pack compiled into the application, see
+     * shape-pack/pe_shape_pack.py. Nothing is parsed or copied and no
+     * name strings are allocated: bodies are found with the pack's
+     * precomputed name index, built on first use, and their polygons use
+     * the pack's vertex array directly. The coordinates are not scaled,
+     * pass --scale to the generator instead. Names already loaded from
+     * another file or pack keep referring to that body, names of the pack
+     * hide those of files loaded later.
+     *
+     * @param name name to remove the shapes with, like a plist file name
+     * @param pack shape records, must stay valid until the shapes are removed
+     *
+     * @retval true if ok
+     * @retval false if shapes with this name are already loaded
+     */
+    bool addShapesWithPack(const std::string &name, const PhysicsShapePack::PackView &pack);
+
+private:
+    class FileIndexer;
+
+public:
+    /**
+     * Loads a shape file in steps on the calling thread, for platforms
+     * where worker threads are not available. Call step() once per frame
+     * until it returns true. Bodies can be created as soon as the file is
+     * indexed, bodies that are not built yet are built on first use.
+     */
+    class Loader
+    {
+    public:
+        ~Loader();
+
+        /**
+         * Continues loading for about budgetMicros microseconds.
+         * The first step reads the whole file at once. A step can exceed
+         * the budget by the time needed to build a single body.
+         *
+         * @param budgetMicros time to spend in this call
+         *
+         * @retval true if loading is finished or failed
+         * @retval false if more steps are needed
+         */
+        bool step(int budgetMicros);
+
+        bool isDone() const { return state == LOADER_DONE || state == LOADER_FAILED; }
+        bool hasFailed() const { return state == LOADER_FAILED; }
+
+        /**
+         * @retval true if the file is indexed and its bodies can be created
+         */
+        bool isIndexed() const { return state == LOADER_BUILD || state == LOADER_DONE; }
+
+        /**
+         * @return progress from 0 to 1, indexing is the first half
+         */
+        float getProgress() const;
+
+        const std::string &getFile() const { return plist; }
+
+    private:
+        friend class PhysicsShapeCache;
+
+        typedef enum
+        {
+            LOADER_READ,
+            LOADER_INDEX,
+            LOADER_BUILD,
+            LOADER_DONE,
+            LOADER_FAILED
+        } State;
+
+        Loader(PhysicsShapeCache *cache, const std::string &plist, float scaleFactor);
+        Loader(const Loader &);
+        Loader &operator=(const Loader &);
+
+        PhysicsShapeCache *cache;
+        std::string plist;
+        float scaleFactor;
+        State state;
+        FileIndexer *indexer;
+        std::vector<std::string> names; // of the indexed bodies, in file order
+        size_t numBuilt;
+#if PHYSICSSHAPECACHE_STATS
+        double ioMicros;
+        double parseMicros;
+        double buildMicros;
+#endif
+    };
+
+    /**
+     * Starts loading a shape file in steps, see Loader.
+     * Shapes are scaled by contentScaleFactor
+     *
+     * Delete the loader when it is done. Deleting it before the file is
+     * indexed cancels loading, afterwards the remaining bodies are built
+     * on first use.
+     *
+     * @param plist name of the shape definitions file to load
+     *
+     * @return new Loader
+     */
+    Loader *createLoader(const std::string &plist);
+
+    /**
+     * Starts loading a shape file in steps, see Loader.
+     *
+     * @param plist name of the shape definitions file to load
+     * @param scaleFactor scale factor to apply for all shapes
+     *
+     * @return new Loader
+     */
+    Loader *createLoader(const std::string &plist, float scaleFactor);
+
+    /**
+     * Removes all shapes loaded from the given file. Names also defined
+     * by another loaded file then refer to the body of the file that was
+     * loaded first.
      *
      * @param plist name of the body definitions file
      */
     void removeShapesWithFile(const std::string &plist);
 
+    /**
+     * Keeps a file loaded with acquireFile() in memory. Copies share the
+     * file, it becomes unused when the last handle is reset or destroyed.
+     */
+    class FileHandle
+    {
+    public:
+        FileHandle() : cache(nullptr) {}
+        FileHandle(const FileHandle &other);
+        FileHandle &operator=(const FileHandle &other);
+        ~FileHandle();
+
+        bool isValid() const { return cache != nullptr; }
+        const std::string &getFile() const { return plist; }
+
+        /**
+         * Releases the file, the handle becomes invalid
+         */
+        void reset();
+
+    private:
+        friend class PhysicsShapeCache;
+        FileHandle(PhysicsShapeCache *cache, const std::string &plist);
+
+        PhysicsShapeCache *cache;
+        std::string plist;
+    };
+
+    typedef std::function<void(const std::string &plist)> EvictionCallback;
+
+    /**
+     * Loads a shape file if needed and returns a handle that keeps it
+     * loaded. Files loaded this way are evicted automatically when they
+     * have no handles and the memory budget is exceeded.
+     * Files loaded with addShapesWithFile() are never evicted.
+     * Shapes are scaled by contentScaleFactor
+     *
+     * @param plist name of the shape definitions file to load
+     *
+     * @return FileHandle, invalid if the file could not be loaded
+     */
+    FileHandle acquireFile(const std::string &plist);
+
+    /**
+     * Loads a shape file if needed and returns a handle that keeps it loaded
+     *
+     * @param plist name of the shape definitions file to load
+     * @param scaleFactor scale factor to apply for all shapes
+     * @param mode when to build the body definitions
+     *
+     * @return FileHandle, invalid if the file could not be loaded
+     */
+    FileHandle acquireFile(const std::string &plist, float scaleFactor, LoadMode mode);
+
+    /**
+     * Sets the memory the files loaded with acquireFile() may use, as
+     * measured by getFileMemoryUsage() when each file was loaded or
+     * released. Unused files are evicted, least recently used first.
+     *
+     * @param bytes memory budget, 0 for no limit (default)
+     */
+    void setMemoryBudget(size_t bytes);
+
+    size_t getMemoryBudget() const { return memoryBudget; }
+
+    /**
+     * Sets a function called with the file name after a file was evicted
+     *
+     * @param callback function to call, nullptr to remove it
+     */
+    void setEvictionCallback(const EvictionCallback &callback) { evictionCallback = callback; }
+
+    /**
+     * Evicts unused files until the memory budget is met
+     */
+    void trimToMemoryBudget();
+
     /**
      * Removes all shapes
      */
@@ -100,6 +407,595 @@ public:
      */
     bool setBodyOnSprite(const std::string &name, Sprite *sprite);
 
+    /**
+     * Mirroring and scaling applied to a body when it is created
+     */
+    class BodyTransform
+    {
+    public:
+        BodyTransform(float scaleX = 1.0f, float scaleY = 1.0f, bool flipX = false, bool flipY = false)
+        : scaleX(scaleX), scaleY(scaleY), flipX(flipX), flipY(flipY) {}
+
+        float scaleX;
+        float scaleY;
+        bool flipX;   ///< mirror at the vertical axis, like Sprite::setFlippedX()
+        bool flipY;   ///< mirror at the horizontal axis, like Sprite::setFlippedY()
+    };
+
+    /**
+     * Creates a PhysicsBody with the given name, mirrored and/or scaled.
+     * Polygons of mirrored bodies keep their counter-clockwise winding.
+     * Circles are scaled by the geometric mean of scaleX and scaleY.
+     * The transformed shapes are cached, creating more bodies with the
+     * same transform does not compute them again.
+     *
+     * @param name name of the body to create
+     * @param transform mirroring and scale to apply
+     *
+     * @return new PhysicsBody
+     * @retval nullptr if body is not found
+     */
+    PhysicsBody *createBodyWithName(const std::string &name, const BodyTransform &transform);
+
+    /**
+     * Creates a new mirrored and/or scaled PhysicsBody and attaches it to
+     * the given sprite. The anchor point is mirrored too, flip the sprite
+     * itself to match.
+     *
+     * @param name name of the body to attach
+     * @param sprite sprite to attach the body to
+     * @param transform mirroring and scale to apply
+     *
+     * @retval true if body was attached to the sprite
+     * @retval false if body was not found
+     */
+    bool setBodyOnSprite(const std::string &name, Sprite *sprite, const BodyTransform &transform);
+
+    /**
+     * Exchanges the shapes of a sprite's PhysicsBody when the sprite
+     * shows another frame, added by setFrameBodiesOnSprite()
+     */
+    class FrameBodies : public Component
+    {
+    public:
+        static const char *const NAME; ///< component name
+
+        FrameBodies() : currentFrame(nullptr) {}
+
+        /**
+         * Compares the displayed frame with the last one, the shapes are
+         * only exchanged when it changed
+         */
+        virtual void update(float delta) override;
+
+    private:
+        friend class PhysicsShapeCache;
+
+        class Frame
+        {
+        public:
+            Vector<PhysicsShape *> shapes;
+            Point anchorPoint;
+        };
+
+        std::unordered_map<SpriteFrame *, Frame> frames;
+        Vector<SpriteFrame *> retainedFrames; // keeps the keys of frames valid
+        SpriteFrame *currentFrame;
+    };
+
+    /**
+     * Gives an animated sprite a PhysicsBody whose shapes follow the
+     * displayed sprite frame. The shapes of all frames are created once.
+     * When the frame changes only the shapes of the body are exchanged,
+     * so velocity, position and joints are kept. Mass and moment are
+     * those of the first frame shown. Frames without a body keep the
+     * previous shapes.
+     *
+     * @param sprite sprite to attach the body to
+     * @param frameBodies sprite frame name -> name of the body to use
+     *
+     * @retval true if the body was attached to the sprite
+     * @retval false if none of the frames and bodies was found
+     */
+    bool setFrameBodiesOnSprite(Sprite *sprite, const std::map<std::string, std::string> &frameBodies);
+
+    /**
+     * Placement of a body for the geometric queries, like the node the
+     * body would be attached to
+     */
+    class QueryTransform
+    {
+    public:
+        QueryTransform(const Point &position = Point::ZERO, float rotation = 0.0f, const BodyTransform &shape = BodyTransform())
+        : position(position), rotation(rotation), shape(shape) {}
+
+        Point position;
+        float rotation;       ///< in degrees, clockwise like Node::setRotation()
+        BodyTransform shape;  ///< mirroring and scale, as for createBodyWithName()
+    };
+
+    /**
+     * Result of rayCast()
+     */
+    class RayCastHit
+    {
+    public:
+        float fraction; ///< of the way from start to end
+        Point point;
+        Point normal;   ///< of the surface at point, unit length
+        int tag;        ///< of the fixture that was hit
+    };
+
+    /**
+     * Tests if a point is inside one of the body's shapes, without
+     * creating a PhysicsBody. Bodies that are never simulated, e.g. for
+     * picking, need no physics world.
+     *
+     * @param name name of the body
+     * @param transform placement of the body
+     * @param point point to test
+     *
+     * @retval true if the point is inside the body
+     * @retval false if not or the body is not found
+     */
+    bool containsPoint(const std::string &name, const QueryTransform &transform, const Point &point);
+
+    /**
+     * Tests many points against one body. The points are moved into
+     * the body's space once and tested against each shape four at a
+     * time with SSE2 or NEON.
+     *
+     * @param name name of the body
+     * @param transform placement of the body
+     * @param points points to test
+     * @param count number of points
+     * @param results true for each point inside the body
+     *
+     * @retval false if the body is not found, results are not set
+     */
+    bool containsPoints(const std::string &name, const QueryTransform &transform, const Point *points, int count, bool *results);
+
+    /**
+     * Tests if a circle touches or overlaps one of the body's shapes
+     *
+     * @param name name of the body
+     * @param transform placement of the body
+     * @param center center of the circle
+     * @param radius radius of the circle
+     *
+     * @retval true if the circle overlaps the body
+     * @retval false if not or the body is not found
+     */
+    bool overlapsCircle(const std::string &name, const QueryTransform &transform, const Point &center, float radius);
+
+    /**
+     * Tests many circles of the same radius against one body, see
+     * containsPoints()
+     *
+     * @param name name of the body
+     * @param transform placement of the body
+     * @param centers centers of the circles
+     * @param count number of circles
+     * @param radius radius of all circles
+     * @param results true for each circle overlapping the body
+     *
+     * @retval false if the body is not found, results are not set
+     */
+    bool overlapsCircles(const std::string &name, const QueryTransform &transform, const Point *centers, int count, float radius, bool *results);
+
+    /**
+     * Finds the first shape of the body hit by a line segment. Shapes
+     * that contain the start point are not hit, like in Box2D.
+     *
+     * @param name name of the body
+     * @param transform placement of the body
+     * @param start start of the segment
+     * @param end end of the segment
+     * @param hit set to the closest hit
+     *
+     * @retval true if the segment hits the body
+     * @retval false if not or the body is not found
+     */
+    bool rayCast(const std::string &name, const QueryTransform &transform, const Point &start, const Point &end, RayCastHit &hit);
+
+    /**
+     * Bulk change of fixture properties, e.g. low friction for an ice
+     * level or no collisions with enemies in a ghost mode. Fixtures are
+     * selected by the category mask and tag set in PhysicsEditor, the
+     * fields listed in 'fields' are replaced.
+     */
+    class FixtureOverride
+    {
+    public:
+        enum
+        {
+            DENSITY           = 1 << 0,
+            RESTITUTION       = 1 << 1,
+            FRICTION          = 1 << 2,
+            GROUP             = 1 << 3,
+            CATEGORY_MASK     = 1 << 4,
+            COLLISION_MASK    = 1 << 5,
+            CONTACT_TEST_MASK = 1 << 6
+        };
+        static const int ANY_TAG = INT_MIN;
+
+        FixtureOverride()
+        : matchCategories(-1), matchTag(ANY_TAG), fields(0)
+        , density(0.0f), restitution(0.0f), friction(0.0f)
+        , group(0), categoryMask(0), collisionMask(0), contactTestMask(0) {}
+
+        int matchCategories; ///< fixtures with one of these category bits, default all
+        int matchTag;        ///< fixtures with this tag, default ANY_TAG
+        int fields;          ///< combination of DENSITY, RESTITUTION, ...
+
+        float density;
+        float restitution;
+        float friction;
+        int group;
+        int categoryMask;
+        int collisionMask;
+        int contactTestMask;
+    };
+
+    /**
+     * Adds an override layer or replaces the layer with the same name.
+     * Layers apply in the order they were added, later layers win.
+     * Matching uses the values from the shape files, not the values of
+     * other layers. Bodies created afterwards and bodies prepared with
+     * warmUp() get the new values, see setLiveOverridesEnabled() for
+     * bodies that already exist.
+     *
+     * @param name name of the layer, e.g. "ice"
+     * @param layer fixtures to change and their new values
+     */
+    void setOverrideLayer(const std::string &name, const FixtureOverride &layer);
+
+    /**
+     * Removes an override layer, fixtures get their previous values back
+     *
+     * @param name name of the layer
+     */
+    void removeOverrideLayer(const std::string &name);
+
+    /**
+     * Removes all override layers
+     */
+    void removeAllOverrideLayers();
+
+    /**
+     * Remembers the shapes of bodies created afterwards so that changes
+     * of the override layers also update them. The shapes are retained
+     * until their body is gone and the layers change again, disabling
+     * releases them. Disabled by default.
+     *
+     * @param enable true to update existing bodies
+     */
+    void setLiveOverridesEnabled(bool enable);
+
+    /**
+     * Selects bodies by the properties of their fixtures, see findBodies().
+     * A body matches if it has a fixture with the tag, one in the group
+     * and one in the categories, not necessarily the same fixture.
+     */
+    class BodyFilter
+    {
+    public:
+        static const int ANY = INT_MIN;
+
+        BodyFilter() : matchCategories(-1), matchTag(ANY), matchGroup(ANY) {}
+
+        int matchCategories; ///< bodies with a fixture in one of these category bits, default all
+        int matchTag;        ///< bodies with a fixture with this tag, default ANY
+        int matchGroup;      ///< bodies with a fixture in this group, default ANY
+    };
+
+    /**
+     * Finds loaded bodies by the tag, group and category mask of their
+     * fixtures without decoding or creating them. The indices are built
+     * when a file is added, from the values in the file; override layers
+     * don't change them.
+     *
+     * @param filter properties to look for
+     * @param names receives the names of the matching bodies in no particular order,
+     *              for createBodyWithName() and the other functions taking a name
+     *
+     * @return number of matching bodies
+     */
+    size_t findBodies(const BodyFilter &filter, std::vector<std::string> &names) const;
+
+    /**
+     * A body to prepare with warmUp()
+     */
+    class WarmUpEntry
+    {
+    public:
+        WarmUpEntry(const std::string &name, int peakCount = 0, const BodyTransform &transform = BodyTransform(), bool debugGeometry = false)
+        : name(name), peakCount(peakCount), transform(transform), debugGeometry(debugGeometry) {}
+
+        std::string name;
+        int peakCount;            ///< PhysicsBodies to create in advance
+        BodyTransform transform;  ///< variant to prepare, default is the body as loaded
+        bool debugGeometry;       ///< also build the buffers of getDebugGeometry()
+    };
+
+    /**
+     * Result of warmUp()
+     */
+    class WarmUpReport
+    {
+    public:
+        std::vector<std::string> missing; ///< names not found in the loaded files
+        int numBodyDefs;                  ///< body definitions decoded or derived
+        int numPooledBodies;              ///< PhysicsBodies created in advance
+    };
+
+    /**
+     * Prepares bodies during a loading screen so that creating them
+     * later is fast: decodes lazily loaded and packed bodies, computes
+     * mirrored and scaled variants and creates up to peakCount
+     * PhysicsBodies per entry. createBodyWithName() and setBodyOnSprite()
+     * hand out these bodies before creating new ones.
+     *
+     * @param manifest bodies to prepare
+     *
+     * @return WarmUpReport with the names that were not found
+     */
+    WarmUpReport warmUp(const std::vector<WarmUpEntry> &manifest);
+
+    /**
+     * Releases the PhysicsBodies created by warmUp() that were not used
+     */
+    void clearPools();
+
+    /**
+     * Outline and fill geometry of a body for debug drawing, in body
+     * space like the shapes of createBodyWithName(). Upload the buffers
+     * once and draw them with the transform of each body instead of
+     * rebuilding the outlines from the live shapes every frame.
+     */
+    class DebugGeometry
+    {
+    public:
+        std::vector<Vec2> vertices;
+        std::vector<uint16_t> lineIndices;     ///< pairs of vertices, outlines of all shapes
+        std::vector<uint16_t> triangleIndices; ///< triples of vertices, filled shapes
+    };
+
+    /**
+     * Returns the debug geometry of a body, built on first use and kept
+     * until the body's file is removed. Circles are drawn with
+     * DEBUG_CIRCLE_SEGMENTS segments, polygons are filled as fans.
+     *
+     * @param name name of the body
+     *
+     * @return geometry, nullptr if the body is not found or has more than
+     *         DEBUG_MAX_VERTICES vertices
+     */
+    const DebugGeometry *getDebugGeometry(const std::string &name);
+
+    /**
+     * Returns the debug geometry of a mirrored or scaled body, see
+     * createBodyWithName()
+     *
+     * @param name name of the body
+     * @param transform mirroring and scale of the shapes
+     *
+     * @return geometry, nullptr if the body is not found or has more than
+     *         DEBUG_MAX_VERTICES vertices
+     */
+    const DebugGeometry *getDebugGeometry(const std::string &name, const BodyTransform &transform);
+
+    static const int DEBUG_CIRCLE_SEGMENTS = 24;
+    static const size_t DEBUG_MAX_VERTICES = 65536; ///< limit of the 16 bit indices
+
+    /**
+     * Stores the polygon vertices of files loaded afterwards as 16 bit
+     * fixed point values relative to each body's bounding box.
+     * This halves the memory used by the vertices. The vertices are
+     * converted back to floats when a body is created, see
+     * getQuantizationError() for the precision.
+     *
+     * @param enable true to use compact storage
+     */
+    void setCompactVertexStorage(bool enable) { compactVertexStorage = enable; }
+
+    /**
+     * Returns the largest difference between a stored vertex coordinate
+     * and the value in the shape file: half of the body's bounding box
+     * size divided by 65535, plus float rounding of 2 * FLT_EPSILON
+     * times the largest coordinate. 0 without compact vertex storage.
+     *
+     * @param name name of the body
+     *
+     * @return maximum error per coordinate, in scaled points
+     */
+    float getQuantizationError(const std::string &name);
+
+    /**
+     * Stores identical polygons, fixtures and bodies only once, even if
+     * they are loaded from different files or under different names.
+     * Shared data is freed when the last file using it is removed.
+     * Enabled by default, applies to files loaded afterwards.
+     *
+     * @param enable true to share identical shapes
+     */
+    void setShareIdenticalShapes(bool enable) { shareIdenticalShapes = enable; }
+
+    /**
+     * Keeps a compiled binary copy of each plist file loaded afterwards,
+     * so that later launches skip the XML parsing. A copy is written when
+     * a file was loaded with LOAD_EAGER and used in all load modes while
+     * the file content, the scale factor and the cache format match.
+     * Otherwise the plist is parsed and the copy is replaced.
+     * Files loaded from the cache behave like shape packs: their bodies
+     * are built on first use and are not shared with other files. Names
+     * also defined by other files resolve as if the plist was parsed.
+     *
+     * @param directory writable directory, e.g. getWritablePath() + "shapes/",
+     *                  empty to disable the cache (the default)
+     */
+    void setBinaryCacheDirectory(const std::string &directory);
+
+    /**
+     * Returns the directory set with setBinaryCacheDirectory()
+     *
+     * @return directory, empty if the cache is disabled
+     */
+    const std::string &getBinaryCacheDirectory() const { return cacheDirectory; }
+
+    /**
+     * Memory used by a loaded file or a single body definition.
+     * Counts the requested sizes of all allocations (body, fixtures,
+     * polygons, vertex arrays, name strings and map nodes) but not the
+     * bookkeeping overhead of the heap allocator.
+     * Data shared with other files or bodies is included in the usage of
+     * each of them, but only once in MemoryReport::totalBytes.
+     */
+    class MemoryUsage
+    {
+    public:
+        std::string name;
+        size_t bytes;
+        int numBodies;
+        int numFixtures;
+        int numPolygons;
+        int numVertices;
+    };
+
+    /**
+     * Memory used by the whole cache, largest files and bodies first
+     */
+    class MemoryReport
+    {
+    public:
+        size_t totalBytes;
+        std::vector<MemoryUsage> files;
+        std::vector<MemoryUsage> bodies;
+    };
+
+    /**
+     * Returns the memory used by all shapes loaded from the given file
+     *
+     * @param plist name of the body definitions file
+     *
+     * @return MemoryUsage, bytes is 0 if the file is not loaded
+     */
+    MemoryUsage getFileMemoryUsage(const std::string &plist) const;
+
+    /**
+     * Returns the memory used by a single body definition
+     *
+     * @param name name of the body
+     *
+     * @return MemoryUsage, bytes is 0 if the body is not found
+     */
+    MemoryUsage getBodyMemoryUsage(const std::string &name) const;
+
+    /**
+     * Lists the memory used by the cache
+     *
+     * @param maxEntries maximum number of files and bodies to list
+     *
+     * @return MemoryReport
+     */
+    MemoryReport getMemoryReport(size_t maxEntries = 10) const;
+
+#if PHYSICSSHAPECACHE_STATS
+    enum { LATENCY_BUCKETS = 16 };
+
+    /**
+     * Load timings of a single shape definitions file, in microseconds
+     */
+    class FileLoadStats
+    {
+    public:
+        double ioMicros;
+        double parseMicros;
+        double buildMicros;
+        int numBodies;
+    };
+
+    /**
+     * Instantiation statistics of a single body name.
+     * histogram[i] counts calls that took less than 2^(i+1) microseconds,
+     * the last bucket also holds all slower calls.
+     */
+    class BodyStats
+    {
+    public:
+        unsigned int instantiations;
+        double totalMicros;
+        double maxMicros;
+        unsigned int histogram[LATENCY_BUCKETS];
+    };
+
+    /**
+     * Snapshot of all counters
+     */
+    class Stats
+    {
+    public:
+        std::map<std::string, FileLoadStats> files;
+        std::map<std::string, BodyStats> bodies;
+
+        unsigned int lookupHits;      ///< found by exact name
+        unsigned int lookupAliasHits; ///< found after removing the file suffix
+        unsigned int lookupMisses;
+
+        int liveBodyDefs;             ///< body definitions currently loaded
+        unsigned int bodiesBuilt;     ///< PhysicsBodies built, for warmUp() too
+        unsigned int pooledBodies;    ///< PhysicsBodies built by warmUp() and not yet handed out
+    };
+
+    /**
+     * Returns a copy of the current counters
+     *
+     * @return Stats
+     */
+    Stats getStats();
+
+    /**
+     * Resets all counters except liveBodyDefs and pooledBodies
+     */
+    void resetStats();
+#endif
+
+#if PHYSICSSHAPECACHE_TRACE
+    /**
+     * Starts or stops recording trace spans. Disabled by default.
+     *
+     * @param enabled true to record
+     */
+    void setTraceEnabled(bool enabled) { trace.setEnabled(enabled); }
+
+    /**
+     * Sets the number of spans kept, older spans are overwritten.
+     * Drops all recorded spans. Default is 4096.
+     *
+     * @param numSpans size of the ring buffer
+     */
+    void setTraceCapacity(size_t numSpans) { trace.setCapacity(numSpans); }
+
+    void clearTrace() { trace.clear(); }
+
+    /**
+     * Returns the recorded spans as Chrome trace-event JSON, which
+     * chrome://tracing and Perfetto can open
+     *
+     * @return std::string
+     */
+    std::string getTraceJson() const { return trace.toJson(); }
+
+    /**
+     * Writes getTraceJson() to a file
+     *
+     * @param path file to write
+     *
+     * @retval true if the file was written
+     */
+    bool writeTrace(const std::string &path) const;
+#endif
+
 private:
     typedef enum
     {
@@ -111,8 +1007,13 @@ private:
     class Polygon
     {
     public:
-        Point* vertices;
+        Point* vertices;     // nullptr with compact vertex storage
         int numVertices;
+        int firstVertex;     // index into BodyDef::quantizedVertices
+        bool externalVertices; // vertices belong to a shape pack
+
+        uint64_t hash;
+        int refCount;        // number of fixtures using this polygon
     };
 
 
@@ -120,16 +1021,7 @@ private:
     {
     public:
         FixtureType fixtureType;
-
-        float density;
-        float restitution;
-        float friction;
-
-        int tag;
-        int group;
-        int categoryMask;
-        int collisionMask;
-        int contactTestMask;
+        int row;             // of the properties in fixtureTable
 
         // for circles
         Point center;
@@ -137,6 +1029,87 @@ private:
 
 
         std::vector<Polygon *> polygons;
+
+        uint64_t hash;
+        int refCount;        // number of bodies using this fixture
+    };
+
+
+    // fixture properties, one array per property so that override
+    // layers are applied with a loop per property
+    class FixtureColumns
+    {
+    public:
+        void resize(size_t rows);
+        void copyRow(int dst, const FixtureColumns &src, int srcRow);
+
+        std::vector<float> density;
+        std::vector<float> restitution;
+        std::vector<float> friction;
+
+        std::vector<int> tag;
+        std::vector<int> group;
+        std::vector<int> categoryMask;
+        std::vector<int> collisionMask;
+        std::vector<int> contactTestMask;
+    };
+
+
+    class FixtureTable
+    {
+    public:
+        int addRow();
+        void releaseRow(int row);
+        size_t size() const { return generation.size(); }
+
+        FixtureColumns base;       // values from the shape files
+        FixtureColumns effective;  // with the override layers applied
+        std::vector<unsigned int> generation; // incremented when the row is released
+        std::vector<int> freeRows;
+    };
+
+
+    class LiveShape
+    {
+    public:
+        PhysicsShape *shape;   // retained
+        int row;
+        unsigned int generation;
+    };
+
+
+    // one bit per body, by slot in BodyIndex
+    typedef std::vector<uint64_t> BodySet;
+
+    class PackFile;
+
+    // bodies by fixture tag, group and category bit for findBodies()
+    class BodyIndex
+    {
+    public:
+        class Entry
+        {
+        public:
+            std::string name;     // empty for pack bodies and free slots
+            const PackFile *pack; // nullptr unless a pack body
+            uint32_t packBody;    // body index in the pack
+        };
+
+        int addSlot();
+        int addBody(const std::string &name);
+        int addPackBody(const PackFile *pack, uint32_t body);
+        void addTag(int slot, int tag);
+        void addGroup(int slot, int group);
+        void addCategories(int slot, int categoryMask);
+        void removeBodies(const std::vector<int> &slots);
+        void clear();
+
+        std::vector<Entry> entries; // by slot
+        std::vector<int> freeSlots;
+        BodySet all;
+        std::unordered_map<int, BodySet> byTag;
+        std::unordered_map<int, BodySet> byGroup;
+        BodySet byCategory[32];
     };
 
 
@@ -154,17 +1127,189 @@ private:
         float angularDamping;
         float velocityLimit;
         float angularVelocityLimit;
+
+        // compact vertex storage: x, y pairs of all polygons,
+        // vertex = quantizedOrigin + quantized * quantizedStep
+        uint16_t *quantizedVertices;
+        int numQuantizedVertices;
+        Point quantizedOrigin;
+        Point quantizedStep;
+
+        uint64_t hash;
+        int refCount;        // number of entries in bodiesInFile
+    };
+
+    // file contents kept for lazy decoding, shared by the files of a bundle
+    class SharedData
+    {
+    public:
+        SharedData() : refCount(1) {}
+        void retain() { refCount++; }
+        void release() { if (--refCount == 0) delete this; }
+
+        Data data;
+
+    private:
+        int refCount;
+    };
+
+
+    class LazyFile
+    {
+    public:
+        LazyFile() : storage(nullptr), bytes(nullptr), size(0), numUndecoded(0) {}
+        ~LazyFile() { releaseStorage(); }
+        void releaseStorage() { if (storage) storage->release(); storage = nullptr; bytes = nullptr; }
+
+        std::string plist;
+        SharedData *storage;
+        const char *bytes; // start of the file in storage
+        size_t size;
+        float scaleFactor;
+        bool compact;
+        int numBodies;
+        int numUndecoded; // hidden bodies included, the storage is released at 0
+    };
+
+
+    class LazyBody
+    {
+    public:
+        LazyFile *file;
+        size_t offset; // of the body's <dict> element in file->bytes
+        size_t length;
+    };
+
+
+    class PackFile
+    {
+    public:
+        std::string name;
+        PhysicsShapePack::PackView view;
+        std::vector<BodyDef *> bodies; // by body index, nullptr until first use
+        Data data; // records of a binary cache file, empty for compiled in packs
+        unsigned long long loadNumber; // see loadCounter
+    };
+
+
+    // body hidden by a body of the same name from a file loaded earlier
+    class ShadowedBody
+    {
+    public:
+        std::string plist;
+        BodyDef *bodyDef; // nullptr if not yet decoded
+        LazyBody lazy;
+        unsigned long long loadNumber; // of its file, see loadCounter
     };
 
     PhysicsShapeCache();
     ~PhysicsShapeCache();
-    void safeDeleteBodyDef(BodyDef *bodyDef);
+    void releaseBodyDef(BodyDef *bodyDef);
+    void releaseFixtureData(FixtureData *fd);
+    void releasePolygon(Polygon *polygon);
+    BodyDef *shareBodyDef(BodyDef *bodyDef);
+    FixtureData *shareFixtureData(FixtureData *fd);
+    Polygon *sharePolygon(Polygon *polygon);
+    static bool samePolygon(const Polygon *a, const Polygon *b);
+    bool sameFixtureData(const FixtureData *a, const FixtureData *b) const;
+    bool sameBodyDef(const BodyDef *a, const BodyDef *b) const;
+    BodyDef *createBodyDef(const ValueMap &bodyData, float scaleFactor, bool compact);
+    void quantizeVertices(BodyDef *bd);
+    const Point *dequantizeVertices(const BodyDef *bd);
+    bool addShapesWithData(const std::string &plist, SharedData *storage, size_t offset, size_t size, float scaleFactor, LoadMode mode);
+    bool indexShapesInData(const std::string &plist, SharedData *storage, size_t offset, size_t size, float scaleFactor);
+    bool registerLazyFile(FileIndexer &indexer, int result);
+    std::string getCachePath(const std::string &plist, float scaleFactor) const;
+    bool addShapesFromCache(const std::string &plist, uint64_t contentHash, float scaleFactor);
+    void writeShapesToCache(const std::string &plist, uint64_t contentHash, float scaleFactor, std::vector<std::pair<std::string, BodyDef *>> &bodies);
+    BodyDef *createBodyDefFromPack(const PhysicsShapePack::PackView &pack, int index);
+    BodyDef *findBodyDef(const std::string &name);
+    PackFile *findPackBody(const std::string &name, int &index) const;
+    BodyDef *findPackBodyDef(const std::string &name);
+    const BodyDef *findDecodedPackBodyDef(const std::string &name) const;
     BodyDef *getBodyDef(const std::string &name);
+    BodyDef *getTransformedBodyDef(BodyDef *bd, const BodyTransform &transform);
+    PhysicsBody *createBody(BodyDef *bd);
+    PhysicsBody *buildBody(BodyDef *bd);
+    void createShapes(BodyDef *bd, Vector<PhysicsShape *> &shapes);
+    void releasePool(const BodyDef *bd);
+    void retainFile(const std::string &plist);
+    void releaseFile(const std::string &plist);
     void setBodyProperties(PhysicsBody *body, BodyDef *bd);
-    void setShapeProperties(PhysicsShape *shape, FixtureData *fd);
+    void setShapeProperties(PhysicsShape *shape, int row);
+    void applyOverrideLayers(size_t first, size_t last);
+    void updateOverriddenShapes();
+    void trackLiveShape(PhysicsShape *shape, int row);
+    void pruneLiveShapes();
+    void indexBodyDef(const std::string &plist, const std::string &name, const BodyDef *bd);
+    void indexLazyBody(const std::string &plist, const std::string &name, const LazyBody &body);
+    void indexPack(const PackFile *file);
+    bool isBodyNameTaken(const std::string &name) const;
+    void shadowBody(const std::string &plist, const std::string &name, BodyDef *bd, const LazyBody *lazy);
+    void unshadowBodies(const std::string &plist, const std::vector<std::string> &names);
+    void addBodyDefMemoryUsage(MemoryUsage &usage, const BodyDef *bd, std::unordered_set<const void *> &counted) const;
+    BodyDef *getQueryBodyDef(const std::string &name, const QueryTransform &transform, int count);
+    bool queryShapes(const std::string &name, const QueryTransform &transform, const Point *points, int count, float radius, bool *results);
+    const DebugGeometry *buildDebugGeometry(BodyDef *bd);
+    void releaseDebugGeometry(const BodyDef *bd);
+
+    class Residency
+    {
+    public:
+        int handles;
+        unsigned long long lastUse; // releaseCounter when the last handle was released
+        size_t bytes;
+    };
 
     std::map<std::string, BodyDef *> bodyDefs;
     std::map<std::string, std::vector<BodyDef *>> bodiesInFile;
+    std::map<std::string, std::vector<std::map<std::string, BodyDef *>::iterator>> namesInFile; // bodyDefs entries added by each file
+    std::map<std::string, Residency> residency; // files loaded with acquireFile()
+    size_t memoryBudget;
+    unsigned long long releaseCounter;
+    unsigned long long loadCounter; // counts registered files, orders them when names clash
+    EvictionCallback evictionCallback;
+    std::map<std::string, LazyFile *> lazyFiles;
+    std::map<std::string, LazyBody> lazyBodies; // not yet decoded
+    std::map<std::string, std::vector<ShadowedBody>> shadowedBodies; // by name, in load order
+    std::map<std::string, PackFile *> packFiles;
+    std::vector<PackFile *> packLoadOrder; // names in several packs refer to the first
+    bool compactVertexStorage;
+    bool shareIdenticalShapes;
+    std::string cacheDirectory; // binary copies of plist files, disabled if empty
+    std::unordered_multimap<uint64_t, BodyDef *> sharedBodies;      // by content hash
+    std::unordered_multimap<uint64_t, FixtureData *> sharedFixtures;
+    std::unordered_multimap<uint64_t, Polygon *> sharedPolygons;
+    std::vector<Point> vertexBuffer; // dequantized vertices of the body being created
+    Vector<PhysicsShape *> shapeBuffer; // shapes of the body being created
+    std::vector<float> queryX, queryY; // query points in body space
+    std::vector<uint32_t> queryHits, queryInside; // 0 or ~0 per point
+    std::unordered_map<const BodyDef *, std::vector<PhysicsBody *>> bodyPools; // filled by warmUp(), retained
+    std::unordered_map<const BodyDef *, DebugGeometry *> debugGeometry;
+    FixtureTable fixtureTable;
+    std::vector<std::pair<std::string, FixtureOverride>> overrideLayers;
+    std::vector<int> overrideMatch; // per row, -1 if the layer being applied matches
+    bool liveOverrides;
+    std::vector<LiveShape> liveShapes;
+    size_t livePruneThreshold;
+    BodyIndex bodyIndex;
+    std::map<std::string, std::vector<int>> indexSlotsInFile;
+
+    // mirrored and scaled bodies by source body and signed scale
+    typedef std::pair<const BodyDef *, std::pair<float, float>> TransformKey;
+    std::map<TransformKey, BodyDef *> transformedBodyDefs;
+
+#if PHYSICSSHAPECACHE_TRACE
+    void traceBody(const char *span, const std::string &name, ShapeCacheTrace::Clock::time_point start, const BodyDef *bd);
+
+    ShapeCacheTrace::Recorder trace;
+#endif
+
+#if PHYSICSSHAPECACHE_STATS
+    void recordInstantiation(const std::string &name, double micros);
+
+    Stats stats;
+#endif
 };
 
 
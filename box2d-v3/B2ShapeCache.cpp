@@ -0,0 +1,319 @@
+//
+//  B2ShapeCache.cpp
+//
+//  Shape cache for Box2D v3.1, no engine required.
+//
+//  Loads physics sprites created with https://www.codeandweb.com/physicseditor
+//
+//  Copyright (c) 2026 CodeAndWeb GmbH. All rights reserved.
+//  https://www.codeandweb.com
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+
+#include "B2ShapeCache.h"
+#include <algorithm>
+#include <cstdio>
+
+// polygons with more vertices are split into fans of convex pieces
+static const int MAX_PIECE_VERTICES = B2_MAX_POLYGON_VERTICES;
+
+
+// number of pieces a convex polygon is split into
+static int numPolygonPieces(int count)
+{
+    return count <= MAX_PIECE_VERTICES ? 1 : (count - 2 + MAX_PIECE_VERTICES - 3) / (MAX_PIECE_VERTICES - 2);
+}
+
+
+B2ShapeCache *B2ShapeCache::getInstance()
+{
+    static B2ShapeCache instance;
+    return &instance;
+}
+
+
+B2ShapeCache::B2ShapeCache()
+: ptmRatio(32.0f)
+{
+}
+
+
+B2ShapeCache::~B2ShapeCache()
+{
+    removeAllShapes();
+}
+
+
+bool B2ShapeCache::addShapesWithPack(const std::string &name, const PhysicsShapePack::PackView &pack)
+{
+    if (packFiles.find(name) != packFiles.end())
+    {
+        return false;
+    }
+    if (pack.ptmRatio > 0)
+    {
+        ptmRatio = pack.ptmRatio;
+    }
+
+    PackFile *file = new PackFile();
+    file->view = pack;
+    file->bodies.resize(pack.numBodies);
+
+    size_t numShapes = 0;
+    for (uint32_t i = 0; i < pack.numBodies; i++)
+    {
+        const PhysicsShapePack::Body &body = pack.bodies[i];
+        for (uint32_t j = 0; j < body.numFixtures; j++)
+        {
+            const PhysicsShapePack::Fixture &fixture = pack.fixtures[body.firstFixture + j];
+            if (fixture.fixtureType == PhysicsShapePack::FIXTURE_CIRCLE)
+            {
+                numShapes++;
+                continue;
+            }
+            for (uint32_t k = 0; k < fixture.numPolygons; k++)
+            {
+                numShapes += numPolygonPieces((int)pack.polygons[fixture.firstPolygon + k].numVertices);
+            }
+        }
+    }
+    file->shapes.reserve(numShapes);
+
+    b2Vec2 points[B2_MAX_POLYGON_VERTICES];
+    for (uint32_t i = 0; i < pack.numBodies; i++)
+    {
+        const PhysicsShapePack::Body &body = pack.bodies[i];
+        BodyDef &bodyDef = file->bodies[i];
+        bodyDef.anchorPoint = b2Vec2{ body.anchorX, body.anchorY };
+        bodyDef.firstShape = file->shapes.size();
+
+        for (uint32_t j = 0; j < body.numFixtures; j++)
+        {
+            const PhysicsShapePack::Fixture &fixture = pack.fixtures[body.firstFixture + j];
+            ShapeDef shape = ShapeDef();
+            shape.def = b2DefaultShapeDef();
+            shape.def.density              = fixture.density;
+            shape.def.material.friction    = fixture.friction;
+            shape.def.material.restitution = fixture.restitution;
+            shape.def.filter.categoryBits  = fixture.categoryMask;
+            shape.def.filter.maskBits      = fixture.collisionMask;
+            shape.def.filter.groupIndex    = fixture.group;
+            shape.def.isSensor             = fixture.isSensor != 0;
+            // the mass is computed once per body, see addShapesToBody()
+            shape.def.updateBodyMass       = false;
+
+            if (fixture.fixtureType == PhysicsShapePack::FIXTURE_CIRCLE)
+            {
+                shape.isCircle = true;
+                shape.circle.center = b2Vec2{ fixture.centerX, fixture.centerY };
+                shape.circle.radius = fixture.radius;
+                file->shapes.push_back(shape);
+                continue;
+            }
+
+            for (uint32_t k = 0; k < fixture.numPolygons; k++)
+            {
+                const PhysicsShapePack::Polygon &polygon = pack.polygons[fixture.firstPolygon + k];
+                const PhysicsShapePack::Vertex *vertices = pack.vertices + polygon.firstVertex;
+                int count = (int)polygon.numVertices;
+                if (count < 3)
+                {
+                    fprintf(stderr, "B2ShapeCache: skipping degenerate polygon in \"%s\"\n",
+                            pack.names + pack.nameOffsets[i]);
+                    continue;
+                }
+                if (count > MAX_PIECE_VERTICES)
+                {
+                    // PhysicsEditor's Box2D exporter keeps to 8 vertices, XML files
+                    // and other exporters don't; the polygons are convex
+                    fprintf(stderr, "B2ShapeCache: splitting polygon with %d vertices in \"%s\"\n",
+                            count, pack.names + pack.nameOffsets[i]);
+                }
+
+                // fan pieces share the first vertex and one edge with the next piece
+                for (int first = 1; first < count - 1; first += MAX_PIECE_VERTICES - 2)
+                {
+                    int pieceCount = std::min(MAX_PIECE_VERTICES - 1, count - first);
+                    points[0] = b2Vec2{ vertices[0].x, vertices[0].y };
+                    for (int v = 0; v < pieceCount; v++)
+                    {
+                        points[v + 1] = b2Vec2{ vertices[first + v].x, vertices[first + v].y };
+                    }
+
+                    b2Hull hull = b2ComputeHull(points, pieceCount + 1);
+                    if (hull.count == 0)
+                    {
+                        // collinear or too small for Box2D
+                        fprintf(stderr, "B2ShapeCache: skipping degenerate polygon in \"%s\"\n",
+                                pack.names + pack.nameOffsets[i]);
+                        continue;
+                    }
+                    shape.isCircle = false;
+                    shape.polygon = b2MakePolygon(&hull, 0.0f);
+                    file->shapes.push_back(shape);
+                }
+            }
+        }
+        bodyDef.numShapes = file->shapes.size() - bodyDef.firstShape;
+    }
+
+    packFiles[name] = file;
+    loadOrder.push_back(file);
+    return true;
+}
+
+
+bool B2ShapeCache::addShapesWithXmlFile(const std::string &file)
+{
+    FILE *fp = fopen(file.c_str(), "rb");
+    if (!fp)
+    {
+        fprintf(stderr, "B2ShapeCache: can't open \"%s\"\n", file.c_str());
+        return false;
+    }
+    std::vector<char> data;
+    char buffer[65536];
+    size_t read;
+    while ((read = fread(buffer, 1, sizeof(buffer), fp)) > 0)
+    {
+        data.insert(data.end(), buffer, buffer + read);
+    }
+    fclose(fp);
+
+    return addShapesWithXml(file, data.data(), data.size());
+}
+
+
+bool B2ShapeCache::addShapesWithXml(const std::string &name, const char *data, size_t size)
+{
+    if (packFiles.find(name) != packFiles.end())
+    {
+        return false;
+    }
+
+    PhysicsShapePack::XmlPack *xml = new PhysicsShapePack::XmlPack();
+    if (!xml->parse(data, size))
+    {
+        fprintf(stderr, "B2ShapeCache: \"%s\" %s\n", name.c_str(), xml->getError().c_str());
+        delete xml;
+        return false;
+    }
+    addShapesWithPack(name, xml->getView());
+    packFiles[name]->xml = xml;
+    return true;
+}
+
+
+void B2ShapeCache::removeShapesWithFile(const std::string &name)
+{
+    auto pos = packFiles.find(name);
+    if (pos != packFiles.end())
+    {
+        loadOrder.erase(std::find(loadOrder.begin(), loadOrder.end(), pos->second));
+        delete pos->second;
+        packFiles.erase(pos);
+    }
+}
+
+
+void B2ShapeCache::removeAllShapes()
+{
+    for (auto iter = packFiles.cbegin(); iter != packFiles.cend(); ++iter)
+    {
+        delete iter->second;
+    }
+    packFiles.clear();
+    loadOrder.clear();
+}
+
+
+const B2ShapeCache::BodyDef *B2ShapeCache::findBodyDef(const std::string &name, const PackFile **file) const
+{
+    // names in several files refer to the body of the file added first
+    for (const PackFile *pack : loadOrder)
+    {
+        int index = PhysicsShapePack::findBody(pack->view, name.c_str());
+        if (index >= 0)
+        {
+            *file = pack;
+            return &pack->bodies[index];
+        }
+    }
+    return nullptr;
+}
+
+
+int B2ShapeCache::addShapesToBody(b2BodyId bodyId, const std::string &name) const
+{
+    const PackFile *file;
+    const BodyDef *bd = findBodyDef(name, &file);
+    if (!bd)
+    {
+        return -1;
+    }
+    createShapes(bodyId, file, bd);
+    return (int)bd->numShapes;
+}
+
+
+void B2ShapeCache::createShapes(b2BodyId bodyId, const PackFile *file, const BodyDef *bd) const
+{
+    const ShapeDef *shape = file->shapes.data() + bd->firstShape;
+    const ShapeDef *end = shape + bd->numShapes;
+    for (; shape != end; ++shape)
+    {
+        if (shape->isCircle)
+        {
+            b2CreateCircleShape(bodyId, &shape->def, &shape->circle);
+        }
+        else
+        {
+            b2CreatePolygonShape(bodyId, &shape->def, &shape->polygon);
+        }
+    }
+    b2Body_ApplyMassFromShapes(bodyId);
+}
+
+
+b2BodyId B2ShapeCache::createBody(b2WorldId worldId, const std::string &name, const b2BodyDef &bodyDef) const
+{
+    const PackFile *file;
+    const BodyDef *bd = findBodyDef(name, &file);
+    if (!bd)
+    {
+        return b2_nullBodyId;
+    }
+    b2BodyId bodyId = b2CreateBody(worldId, &bodyDef);
+    createShapes(bodyId, file, bd);
+    return bodyId;
+}
+
+
+bool B2ShapeCache::getAnchorPoint(const std::string &name, b2Vec2 &anchorPoint) const
+{
+    const PackFile *file;
+    const BodyDef *bd = findBodyDef(name, &file);
+    if (!bd)
+    {
+        return false;
+    }
+    anchorPoint = bd->anchorPoint;
+    return true;
+}
@@ -0,0 +1,191 @@
+//
+//  B2ShapeCache.h
+//
+//  Shape cache for Box2D v3.1, no engine required.
+//
+//  Loads physics sprites created with https://www.codeandweb.com/physicseditor
+//
+//  Copyright (c) 2026 CodeAndWeb GmbH. All rights reserved.
+//  https://www.codeandweb.com
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+
+#ifndef __B2ShapeCache_h__
+#define __B2ShapeCache_h__
+#include "box2d/box2d.h"
+#include "PhysicsShapePack.h"
+#include "PhysicsShapeXml.h"
+#include <map>
+#include <string>
+#include <vector>
+
+
+class B2ShapeCache
+{
+public:
+    /**
+     * Get pointer to the B2ShapeCache singleton instance.
+     * Separate instances can be created as well, e.g. one per world.
+     *
+     * @return B2ShapeCache*
+     */
+    static B2ShapeCache *getInstance();
+
+    B2ShapeCache();
+    ~B2ShapeCache();
+
+    /**
+     * Adds the shapes of a pack generated from a "Box2D generic (PLIST)"
+     * file with shape-pack/pe_shape_pack.py. The Box2D polygons of all
+     * bodies are computed here, creating a body only copies them.
+     * Polygons with more than B2_MAX_POLYGON_VERTICES vertices are split
+     * into several convex shapes. Bodies with a name added before keep
+     * their shapes until that file is removed.
+     *
+     * @param name name to remove the shapes with, like a plist file name
+     * @param pack shape records, must stay valid until the shapes are removed
+     *
+     * @retval true if ok
+     * @retval false if shapes with this name are already loaded
+     */
+    bool addShapesWithPack(const std::string &name, const PhysicsShapePack::PackView &pack);
+
+    /**
+     * Adds the shapes of a PhysicsEditor XML export (<bodydef>, the format
+     * gdx-pe-loader reads). Coordinates are divided by the file's ptm_ratio.
+     * The format has no anchor points, getAnchorPoint() returns (0, 0).
+     *
+     * @param file path of the XML file, also the name to remove the shapes with
+     *
+     * @retval true if ok
+     * @retval false if the file can't be read or parsed, or is already loaded
+     */
+    bool addShapesWithXmlFile(const std::string &file);
+
+    /**
+     * Adds the shapes of a PhysicsEditor XML export already in memory
+     *
+     * @param name name to remove the shapes with
+     * @param data file contents, not needed after the call
+     * @param size size of data in bytes
+     *
+     * @retval true if ok
+     * @retval false if the data can't be parsed or the name is already loaded
+     */
+    bool addShapesWithXml(const std::string &name, const char *data, size_t size);
+
+    /**
+     * Removes all shapes loaded with the given name
+     *
+     * @param name name passed to addShapesWithPack() or addShapesWithXml(),
+     *             or the file passed to addShapesWithXmlFile()
+     */
+    void removeShapesWithFile(const std::string &name);
+
+    /**
+     * Removes all shapes
+     */
+    void removeAllShapes();
+
+    /**
+     * Creates all shapes of the named body on an existing body. The mass
+     * of the body is computed once, after the last shape was added.
+     * Only reads the cache, bodies in different worlds can be filled from
+     * several threads at once.
+     *
+     * @param bodyId body to add the shapes to
+     * @param name name of the body in the shape file
+     *
+     * @return number of shapes created
+     * @retval -1 if the body is not found
+     */
+    int addShapesToBody(b2BodyId bodyId, const std::string &name) const;
+
+    /**
+     * Creates a body and all of its shapes
+     *
+     * @param worldId world to create the body in
+     * @param name name of the body in the shape file
+     * @param bodyDef type, position and other properties of the body
+     *
+     * @return new body
+     * @retval b2_nullBodyId if the body is not found
+     */
+    b2BodyId createBody(b2WorldId worldId, const std::string &name, const b2BodyDef &bodyDef) const;
+
+    /**
+     * Returns the anchor point set in PhysicsEditor, relative to the sprite size
+     *
+     * @param name name of the body
+     * @param anchorPoint receives the anchor point
+     *
+     * @retval false if the body is not found
+     */
+    bool getAnchorPoint(const std::string &name, b2Vec2 &anchorPoint) const;
+
+    /**
+     * Pixels per meter of the last pack added
+     */
+    float getPtmRatio() const { return ptmRatio; }
+
+private:
+    class ShapeDef
+    {
+    public:
+        b2ShapeDef def;
+        bool isCircle;
+        b2Polygon polygon;
+        b2Circle circle;
+    };
+
+
+    class BodyDef
+    {
+    public:
+        b2Vec2 anchorPoint;
+        size_t firstShape; // index into PackFile::shapes
+        size_t numShapes;
+    };
+
+
+    class PackFile
+    {
+    public:
+        PackFile() : xml(nullptr) {}
+        ~PackFile() { delete xml; }
+
+        PhysicsShapePack::XmlPack *xml; // owns the records of XML files
+        PhysicsShapePack::PackView view;
+        std::vector<BodyDef> bodies;  // by body index
+        std::vector<ShapeDef> shapes; // of all bodies, in body order
+    };
+
+    B2ShapeCache(const B2ShapeCache &);
+    B2ShapeCache &operator=(const B2ShapeCache &);
+    const BodyDef *findBodyDef(const std::string &name, const PackFile **file) const;
+    void createShapes(b2BodyId bodyId, const PackFile *file, const BodyDef *bd) const;
+
+    std::map<std::string, PackFile *> packFiles;
+    std::vector<PackFile *> loadOrder; // packFiles in the order they were added
+    float ptmRatio;
+};
+
+
+#endif // __B2ShapeCache_h__
@@ -0,0 +1,145 @@
+//
+//  spawn_v2.cpp
+//
+//  Spawn throughput of the Box2D 2.x path for comparison with
+//  spawn_v3.cpp: fixture definitions are built once like in
+//  GB2ShapeCache-x and each body gets one CreateFixture() per fixture.
+//  GB2ShapeCache-x itself needs cocos2d-x, so its loop is reproduced here.
+//
+//  Generate the shapes from a "Box2D generic (PLIST)" file:
+//    ../../shape-pack/pe_shape_pack.py header shapes.plist -o benchmark_pack.h --name benchmark_pack
+//
+//  Build:
+//    c++ -O2 -std=c++11 -pthread -I. -I../../shape-pack -I<box2d-2.4>/include spawn_v2.cpp <box2d-2.4>/build/src/libbox2d.a -o spawn_v2
+//
+
+#include "box2d/box2d.h"
+#include "PhysicsShapePack.h"
+#include "benchmark_pack.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <map>
+#include <string>
+#include <vector>
+
+static const int NUM_BODIES = 10000;
+static const int NUM_RUNS = 5;
+static const int MAX_PIECE_VERTICES = b2_maxPolygonVertices;
+
+
+class FixtureList
+{
+public:
+    ~FixtureList()
+    {
+        for (auto &fixture : fixtures)
+        {
+            delete fixture.shape;
+        }
+    }
+
+    std::vector<b2FixtureDef> fixtures;
+};
+
+
+static void buildFixtures(const PhysicsShapePack::PackView &pack, uint32_t index, FixtureList &list)
+{
+    const PhysicsShapePack::Body &body = pack.bodies[index];
+    b2Vec2 vertices[b2_maxPolygonVertices];
+    for (uint32_t j = 0; j < body.numFixtures; j++)
+    {
+        const PhysicsShapePack::Fixture &fixture = pack.fixtures[body.firstFixture + j];
+        b2FixtureDef def;
+        def.filter.categoryBits = (uint16)fixture.categoryMask;
+        def.filter.maskBits = (uint16)fixture.collisionMask;
+        def.filter.groupIndex = (int16)fixture.group;
+        def.friction = fixture.friction;
+        def.density = fixture.density;
+        def.restitution = fixture.restitution;
+        def.isSensor = fixture.isSensor != 0;
+
+        if (fixture.fixtureType == PhysicsShapePack::FIXTURE_CIRCLE)
+        {
+            b2CircleShape *circle = new b2CircleShape();
+            circle->m_radius = fixture.radius;
+            circle->m_p.Set(fixture.centerX, fixture.centerY);
+            def.shape = circle;
+            list.fixtures.push_back(def);
+            continue;
+        }
+        for (uint32_t k = 0; k < fixture.numPolygons; k++)
+        {
+            const PhysicsShapePack::Polygon &polygon = pack.polygons[fixture.firstPolygon + k];
+            const PhysicsShapePack::Vertex *polygonVertices = pack.vertices + polygon.firstVertex;
+            int count = (int)polygon.numVertices;
+            if (count < 3)
+            {
+                continue;
+            }
+            // a fan of convex pieces like B2ShapeCache and GB2ShapeCache-x,
+            // so that both benchmarks create the same shapes
+            for (int first = 1; first < count - 1; first += MAX_PIECE_VERTICES - 2)
+            {
+                int pieceCount = std::min(MAX_PIECE_VERTICES - 1, count - first);
+                vertices[0].Set(polygonVertices[0].x, polygonVertices[0].y);
+                for (int v = 0; v < pieceCount; v++)
+                {
+                    vertices[v + 1].Set(polygonVertices[first + v].x, polygonVertices[first + v].y);
+                }
+                b2PolygonShape *shape = new b2PolygonShape();
+                shape->Set(vertices, pieceCount + 1);
+                def.shape = shape;
+                list.fixtures.push_back(def);
+            }
+        }
+    }
+}
+
+
+int main()
+{
+    const PhysicsShapePack::PackView &pack = benchmark_pack::pack;
+    std::map<std::string, FixtureList> shapeObjects;
+    std::vector<std::string> names;
+    for (uint32_t i = 0; i < pack.numBodies; i++)
+    {
+        names.push_back(pack.names + pack.nameOffsets[i]);
+        buildFixtures(pack, i, shapeObjects[names.back()]);
+    }
+    if (names.empty())
+    {
+        return 1;
+    }
+
+    double best = 1e30;
+    long shapes = 0;
+    for (int run = 0; run < NUM_RUNS; run++)
+    {
+        b2World *world = new b2World(b2Vec2(0.0f, -10.0f));
+        b2BodyDef bodyDef;
+        bodyDef.type = b2_dynamicBody;
+
+        shapes = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < NUM_BODIES; i++)
+        {
+            bodyDef.position.Set((float)(i % 100) * 4.0f, (float)(i / 100) * 4.0f);
+            b2Body *body = world->CreateBody(&bodyDef);
+            // same lookup as GB2ShapeCache::addFixturesToBody()
+            const FixtureList &list = shapeObjects.find(names[i % names.size()])->second;
+            for (auto &fixture : list.fixtures)
+            {
+                body->CreateFixture(&fixture);
+                shapes++;
+            }
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        best = std::min(best, seconds);
+        delete world;
+    }
+
+    printf("box2d 2.x   %d bodies, %ld shapes: %.0f bodies/s, %.2f us/body\n",
+           NUM_BODIES, shapes, NUM_BODIES / best, best * 1e6 / NUM_BODIES);
+    return 0;
+}
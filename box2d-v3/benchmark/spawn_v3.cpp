@@ -0,0 +1,68 @@
+//
+//  spawn_v3.cpp
+//
+//  Spawn throughput of B2ShapeCache with Box2D v3.1.
+//  Compare with spawn_v2.cpp, which creates the same bodies the way
+//  GB2ShapeCache-x does with Box2D 2.4.
+//
+//  Generate the shapes from a "Box2D generic (PLIST)" file:
+//    ../../shape-pack/pe_shape_pack.py header shapes.plist -o benchmark_pack.h --name benchmark_pack
+//
+//  Build:
+//    c++ -O2 -std=c++11 -pthread -I. -I.. -I../../shape-pack -I<box2d-v3>/include spawn_v3.cpp ../B2ShapeCache.cpp ../../shape-pack/PhysicsShapeXml.cpp <box2d-v3>/build/src/libbox2d.a -o spawn_v3
+//
+
+#include "B2ShapeCache.h"
+#include "benchmark_pack.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+static const int NUM_BODIES = 10000;
+static const int NUM_RUNS = 5;
+
+
+int main()
+{
+    const PhysicsShapePack::PackView &pack = benchmark_pack::pack;
+    B2ShapeCache cache;
+    cache.addShapesWithPack("benchmark", pack);
+
+    std::vector<std::string> names;
+    for (uint32_t i = 0; i < pack.numBodies; i++)
+    {
+        names.push_back(pack.names + pack.nameOffsets[i]);
+    }
+    if (names.empty())
+    {
+        return 1;
+    }
+
+    double best = 1e30;
+    long shapes = 0;
+    for (int run = 0; run < NUM_RUNS; run++)
+    {
+        b2WorldDef worldDef = b2DefaultWorldDef();
+        b2WorldId world = b2CreateWorld(&worldDef);
+        b2BodyDef bodyDef = b2DefaultBodyDef();
+        bodyDef.type = b2_dynamicBody;
+
+        shapes = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < NUM_BODIES; i++)
+        {
+            bodyDef.position = b2Vec2{ (float)(i % 100) * 4.0f, (float)(i / 100) * 4.0f };
+            b2BodyId body = b2CreateBody(world, &bodyDef);
+            shapes += cache.addShapesToBody(body, names[i % names.size()]);
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        best = std::min(best, seconds);
+        b2DestroyWorld(world);
+    }
+
+    printf("box2d v3.1  %d bodies, %ld shapes: %.0f bodies/s, %.2f us/body\n",
+           NUM_BODIES, shapes, NUM_BODIES / best, best * 1e6 / NUM_BODIES);
+    return 0;
+}
@@ -0,0 +1,686 @@
+//
+//  CpShapeCache.cpp
+//
+//  Shape cache for Chipmunk 6 in portable C++, no engine required.
+//
+//  Loads physics sprites created with https://www.codeandweb.com/physicseditor
+//
+//  Copyright (c) 2026 CodeAndWeb GmbH. All rights reserved.
+//  https://www.codeandweb.com
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+
+#include "CpShapeCache.h"
+#include "PhysicsShapeXml.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+
+// element of an XML property list, text points into the parsed data
+class CpShapeCache::PlistNode
+{
+public:
+    typedef enum
+    {
+        NODE_DICT,
+        NODE_ARRAY,
+        NODE_TEXT,   // <string>, <real> and <integer>
+        NODE_BOOLEAN
+    } NodeType;
+
+    PlistNode() : type(NODE_TEXT), text(""), textEnd(text), boolean(false) {}
+
+    const char *parse(const char *p, const char *end, int depth);
+    const char *parseChildren(const char *p, const char *end, const char *closeTag, int depth);
+    const PlistNode *find(const char *key) const;
+    bool getText(const char *key, const char *value) const;
+    cpFloat getFloat(const char *key) const;
+    unsigned long getInteger(const char *key) const;
+    bool getBool(const char *key) const;
+    cpVect getPoint(const char *key) const;
+
+    NodeType type;
+    const char *text;
+    const char *textEnd;
+    bool boolean;
+    std::vector<std::string> keys; // one per child of a dict
+    std::vector<PlistNode> children;
+};
+
+
+static bool startsWith(const char *p, const char *end, const char *prefix)
+{
+    size_t length = strlen(prefix);
+    return (size_t)(end - p) >= length && memcmp(p, prefix, length) == 0;
+}
+
+
+static const char *findText(const char *p, const char *end, const char *text)
+{
+    while (p < end && !startsWith(p, end, text))
+    {
+        p++;
+    }
+    return p;
+}
+
+
+// skips white space, comments, the XML declaration and the DOCTYPE
+static const char *skipMarkup(const char *p, const char *end)
+{
+    for (;;)
+    {
+        while (p < end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n'))
+        {
+            p++;
+        }
+        if (startsWith(p, end, "<!--"))
+        {
+            p = std::min(findText(p, end, "-->") + 3, end);
+        }
+        else if (startsWith(p, end, "<?") || startsWith(p, end, "<!"))
+        {
+            p = std::min(findText(p, end, ">") + 1, end);
+        }
+        else
+        {
+            return p;
+        }
+    }
+}
+
+
+static void appendDecoded(std::string &out, const char *p, const char *end)
+{
+    static const char *const ENTITIES[][2] =
+    {
+        { "&amp;", "&" }, { "&lt;", "<" }, { "&gt;", ">" }, { "&quot;", "\"" }, { "&apos;", "'" }
+    };
+    while (p < end)
+    {
+        bool decoded = false;
+        if (*p == '&')
+        {
+            for (auto &entity : ENTITIES)
+            {
+                if (startsWith(p, end, entity[0]))
+                {
+                    out.append(entity[1]);
+                    p += strlen(entity[0]);
+                    decoded = true;
+                    break;
+                }
+            }
+        }
+        if (!decoded)
+        {
+            out.push_back(*p++);
+        }
+    }
+}
+
+
+// "{ x, y }"
+static cpVect parsePoint(const char *p, const char *end)
+{
+    float x = 0.0f, y = 0.0f;
+    while (p < end && (*p == '{' || *p == ' '))
+    {
+        p++;
+    }
+    p = PhysicsShapePack::parseFloat(p, end, x);
+    while (p && p < end && (*p == ',' || *p == ' '))
+    {
+        p++;
+    }
+    if (!p || !PhysicsShapePack::parseFloat(p, end, y))
+    {
+        x = y = 0.0f;
+    }
+    return cpv(x, y);
+}
+
+
+const char *CpShapeCache::PlistNode::parseChildren(const char *p, const char *end, const char *closeTag, int depth)
+{
+    for (;;)
+    {
+        p = skipMarkup(p, end);
+        if (startsWith(p, end, closeTag))
+        {
+            return p + strlen(closeTag);
+        }
+        if (type == NODE_DICT)
+        {
+            if (!startsWith(p, end, "<key>"))
+            {
+                return nullptr;
+            }
+            p += 5;
+            const char *keyEnd = findText(p, end, "</key>");
+            if (keyEnd == end)
+            {
+                return nullptr;
+            }
+            keys.push_back(std::string());
+            appendDecoded(keys.back(), p, keyEnd);
+            p = keyEnd + 6;
+        }
+        children.push_back(PlistNode());
+        p = children.back().parse(p, end, depth + 1);
+        if (!p)
+        {
+            return nullptr;
+        }
+    }
+}
+
+
+// parses one value element, returns the position behind it or nullptr
+const char *CpShapeCache::PlistNode::parse(const char *p, const char *end, int depth)
+{
+    p = skipMarkup(p, end);
+    if (p == end || *p != '<' || depth > 64)
+    {
+        return nullptr;
+    }
+    const char *name = ++p;
+    while (p < end && *p != '>' && *p != '/' && *p != ' ')
+    {
+        p++;
+    }
+    std::string tag(name, p);
+    p = findText(p, end, ">");
+    if (p == end)
+    {
+        return nullptr;
+    }
+    bool empty = p[-1] == '/';
+    p++;
+
+    if (tag == "plist")
+    {
+        p = parse(p, end, depth + 1);
+        return p ? findText(p, end, "</plist>") : nullptr;
+    }
+    if (tag == "dict" || tag == "array")
+    {
+        type = tag == "dict" ? NODE_DICT : NODE_ARRAY;
+        return empty ? p : parseChildren(p, end, tag == "dict" ? "</dict>" : "</array>", depth);
+    }
+    if (tag == "true" || tag == "false")
+    {
+        type = NODE_BOOLEAN;
+        boolean = tag == "true";
+        return empty ? p : std::min(findText(p, end, ">") + 1, end);
+    }
+    if (tag == "string" || tag == "real" || tag == "integer")
+    {
+        type = NODE_TEXT;
+        if (empty)
+        {
+            return p;
+        }
+        text = p;
+        textEnd = findText(p, end, "<");
+        p = findText(textEnd, end, ">");
+        return p == end ? nullptr : p + 1;
+    }
+    return nullptr;
+}
+
+
+const CpShapeCache::PlistNode *CpShapeCache::PlistNode::find(const char *key) const
+{
+    for (size_t i = 0; i < keys.size(); i++)
+    {
+        if (keys[i] == key)
+        {
+            return &children[i];
+        }
+    }
+    return nullptr;
+}
+
+
+bool CpShapeCache::PlistNode::getText(const char *key, const char *value) const
+{
+    const PlistNode *node = find(key);
+    return node && startsWith(node->text, node->textEnd, value) && (size_t)(node->textEnd - node->text) == strlen(value);
+}
+
+
+cpFloat CpShapeCache::PlistNode::getFloat(const char *key) const
+{
+    const PlistNode *node = find(key);
+    float value = 0.0f;
+    if (node && !PhysicsShapePack::parseFloat(node->text, node->textEnd, value))
+    {
+        value = 0.0f;
+    }
+    return value;
+}
+
+
+unsigned long CpShapeCache::PlistNode::getInteger(const char *key) const
+{
+    // layers use all 32 bits, read the digits without going through float
+    const PlistNode *node = find(key);
+    if (!node)
+    {
+        return 0;
+    }
+    const char *p = node->text;
+    while (p < node->textEnd && *p == ' ')
+    {
+        p++;
+    }
+    bool negative = p < node->textEnd && *p == '-';
+    if (negative)
+    {
+        p++;
+    }
+    unsigned long value = 0;
+    for (; p < node->textEnd && *p >= '0' && *p <= '9'; p++)
+    {
+        value = value * 10 + (unsigned long)(*p - '0');
+    }
+    return negative ? 0 - value : value;
+}
+
+
+bool CpShapeCache::PlistNode::getBool(const char *key) const
+{
+    const PlistNode *node = find(key);
+    if (!node)
+    {
+        return false;
+    }
+    return node->type == NODE_BOOLEAN ? node->boolean : getInteger(key) != 0;
+}
+
+
+cpVect CpShapeCache::PlistNode::getPoint(const char *key) const
+{
+    const PlistNode *node = find(key);
+    return node ? parsePoint(node->text, node->textEnd) : cpvzero;
+}
+
+
+CpShapeCache *CpShapeCache::getInstance()
+{
+    static CpShapeCache instance;
+    return &instance;
+}
+
+
+CpShapeCache::CpShapeCache()
+{
+}
+
+
+CpShapeCache::~CpShapeCache()
+{
+    removeAllShapes();
+}
+
+
+bool CpShapeCache::addShapesWithFile(const std::string &file)
+{
+    FILE *fp = fopen(file.c_str(), "rb");
+    if (!fp)
+    {
+        fprintf(stderr, "CpShapeCache: can't open \"%s\"\n", file.c_str());
+        return false;
+    }
+    std::vector<char> data;
+    char buffer[65536];
+    size_t read;
+    while ((read = fread(buffer, 1, sizeof(buffer), fp)) > 0)
+    {
+        data.insert(data.end(), buffer, buffer + read);
+    }
+    fclose(fp);
+
+    return addShapesWithData(file, data.data(), data.size());
+}
+
+
+bool CpShapeCache::addShapesWithData(const std::string &name, const char *data, size_t size)
+{
+    if (shapeFiles.find(name) != shapeFiles.end())
+    {
+        return false;
+    }
+
+    PlistNode root;
+    if (!root.parse(data, data + size, 0) || root.type != PlistNode::NODE_DICT)
+    {
+        fprintf(stderr, "CpShapeCache: \"%s\" is not a valid plist file\n", name.c_str());
+        return false;
+    }
+    const PlistNode *metadata = root.find("metadata");
+    if (!metadata || metadata->getInteger("format") != 1)
+    {
+        fprintf(stderr, "CpShapeCache: \"%s\" has an unsupported format\n", name.c_str());
+        return false;
+    }
+    const PlistNode *bodies = root.find("bodies");
+    if (!bodies || bodies->type != PlistNode::NODE_DICT)
+    {
+        fprintf(stderr, "CpShapeCache: \"%s\" has no bodies\n", name.c_str());
+        return false;
+    }
+
+    ShapeFile *file = new ShapeFile();
+    for (size_t i = 0; i < bodies->keys.size(); i++)
+    {
+        if (!addBody(file, bodies->keys[i], bodies->children[i]))
+        {
+            fprintf(stderr, "CpShapeCache: invalid body \"%s\" in \"%s\"\n", bodies->keys[i].c_str(), name.c_str());
+            delete file;
+            return false;
+        }
+    }
+    shapeFiles[name] = file;
+    loadOrder.push_back(file);
+    return true;
+}
+
+
+// signed area, positive for counter-clockwise polygons
+static cpFloat polygonArea(const cpVect *vertices, int count)
+{
+    cpFloat area = 0.0f;
+    for (int i = 0; i < count; i++)
+    {
+        const cpVect &a = vertices[i];
+        const cpVect &b = vertices[(i + 1) % count];
+        area += a.x * b.y - b.x * a.y;
+    }
+    return area * 0.5f;
+}
+
+
+bool CpShapeCache::addBody(ShapeFile *file, const std::string &name, const PlistNode &bodyData)
+{
+    const PlistNode *fixtures = bodyData.find("fixtures");
+    if (bodyData.type != PlistNode::NODE_DICT || !fixtures)
+    {
+        return false;
+    }
+
+    BodyDef bodyDef = BodyDef();
+    bodyDef.anchorPoint = bodyData.getPoint("anchorpoint");
+    bodyDef.firstShape = file->shapes.size();
+
+    for (auto &fixtureData : fixtures->children)
+    {
+        ShapeDef shape = ShapeDef();
+        shape.elasticity      = fixtureData.getFloat("elasticity");
+        shape.friction        = fixtureData.getFloat("friction");
+        shape.surfaceVelocity = fixtureData.getPoint("surface_velocity");
+        shape.collisionType   = (cpCollisionType)fixtureData.getInteger("collision_type");
+        shape.group           = (cpGroup)fixtureData.getInteger("group");
+        shape.layers          = (cpLayers)fixtureData.getInteger("layers");
+        shape.isSensor        = fixtureData.getBool("isSensor");
+        cpFloat mass          = fixtureData.getFloat("mass");
+        bodyDef.mass += mass;
+
+        if (fixtureData.getText("fixture_type", "CIRCLE"))
+        {
+            const PlistNode *circle = fixtureData.find("circle");
+            if (!circle)
+            {
+                return false;
+            }
+            shape.isCircle = true;
+            shape.radius = circle->getFloat("radius");
+            // older exports store the center next to the circle
+            shape.center = circle->find("position") ? circle->getPoint("position") : fixtureData.getPoint("center");
+            bodyDef.moment += cpMomentForCircle(mass, 0.0f, shape.radius, shape.center);
+            file->shapes.push_back(shape);
+            continue;
+        }
+
+        const PlistNode *polygons = fixtureData.find("polygons");
+        if (!fixtureData.getText("fixture_type", "POLYGON") || !polygons)
+        {
+            return false;
+        }
+
+        // the fixture's mass is split by the area of its convex polygons
+        size_t firstShape = file->shapes.size();
+        cpFloat fixtureArea = 0.0f;
+        for (auto &polygon : polygons->children)
+        {
+            // Chipmunk needs at least a triangle
+            if (polygon.type != PlistNode::NODE_ARRAY || polygon.children.size() < 3)
+            {
+                return false;
+            }
+            shape.isCircle = false;
+            shape.firstVertex = file->vertices.size();
+            shape.numVertices = (int)polygon.children.size();
+            for (auto &point : polygon.children)
+            {
+                file->vertices.push_back(parsePoint(point.text, point.textEnd));
+            }
+
+            cpVect *vertices = file->vertices.data() + shape.firstVertex;
+            cpFloat area = polygonArea(vertices, shape.numVertices);
+            if (area > 0.0f)
+            {
+                // Chipmunk 6 wants clockwise winding
+                std::reverse(vertices, vertices + shape.numVertices);
+            }
+            fixtureArea += fabs(area);
+            file->shapes.push_back(shape);
+        }
+        for (size_t i = firstShape; i < file->shapes.size(); i++)
+        {
+            const ShapeDef &polygon = file->shapes[i];
+            const cpVect *vertices = file->vertices.data() + polygon.firstVertex;
+            cpFloat polygonMass = fixtureArea > 0.0f ? mass * fabs(polygonArea(vertices, polygon.numVertices)) / fixtureArea : 0.0f;
+            bodyDef.moment += cpMomentForPoly(polygonMass, polygon.numVertices, const_cast<cpVect *>(vertices), cpvzero);
+        }
+    }
+
+    bodyDef.numShapes = file->shapes.size() - bodyDef.firstShape;
+    file->bodies[name] = bodyDef;
+    return true;
+}
+
+
+void CpShapeCache::removeShapesWithFile(const std::string &name)
+{
+    auto pos = shapeFiles.find(name);
+    if (pos != shapeFiles.end())
+    {
+        loadOrder.erase(std::find(loadOrder.begin(), loadOrder.end(), pos->second));
+        delete pos->second;
+        shapeFiles.erase(pos);
+    }
+}
+
+
+void CpShapeCache::removeAllShapes()
+{
+    for (auto iter = shapeFiles.cbegin(); iter != shapeFiles.cend(); ++iter)
+    {
+        delete iter->second;
+    }
+    shapeFiles.clear();
+    loadOrder.clear();
+}
+
+
+const CpShapeCache::BodyDef *CpShapeCache::findBodyDef(const std::string &name, const ShapeFile **file) const
+{
+    // names in several files refer to the body of the file added first
+    for (const ShapeFile *shapeFile : loadOrder)
+    {
+        auto pos = shapeFile->bodies.find(name);
+        if (pos != shapeFile->bodies.end())
+        {
+            *file = shapeFile;
+            return &pos->second;
+        }
+    }
+    return nullptr;
+}
+
+
+void CpShapeCache::createShapes(const ShapeFile *file, const BodyDef *bd, cpBody *body, cpShape **shapes)
+{
+    const ShapeDef *def = file->shapes.data() + bd->firstShape;
+    for (size_t i = 0; i < bd->numShapes; i++, def++)
+    {
+        cpShape *shape;
+        if (def->isCircle)
+        {
+            shape = cpCircleShapeNew(body, def->radius, def->center);
+        }
+        else
+        {
+            cpVect *vertices = const_cast<cpVect *>(file->vertices.data() + def->firstVertex);
+            shape = cpPolyShapeNew(body, def->numVertices, vertices, cpvzero);
+        }
+        cpShapeSetElasticity(shape, def->elasticity);
+        cpShapeSetFriction(shape, def->friction);
+        cpShapeSetSurfaceVelocity(shape, def->surfaceVelocity);
+        cpShapeSetCollisionType(shape, def->collisionType);
+        cpShapeSetGroup(shape, def->group);
+        cpShapeSetLayers(shape, def->layers);
+        cpShapeSetSensor(shape, def->isSensor);
+        shapes[i] = shape;
+    }
+}
+
+
+// a body and its shapes waiting for the space to be unlocked
+class PendingShapes
+{
+public:
+    cpBody *body; // nullptr if the body is already in the space
+    std::vector<cpShape *> shapes;
+};
+
+
+static void addPendingShapes(cpSpace *space, void *key, void *data)
+{
+    PendingShapes *pending = static_cast<PendingShapes *>(data);
+    if (pending->body)
+    {
+        cpSpaceAddBody(space, pending->body);
+    }
+    for (auto shape : pending->shapes)
+    {
+        cpSpaceAddShape(space, shape);
+    }
+    delete pending;
+}
+
+
+static void addToSpace(cpSpace *space, cpBody *newBody, std::vector<cpShape *> &shapes)
+{
+    if (cpSpaceIsLocked(space))
+    {
+        PendingShapes *pending = new PendingShapes();
+        pending->body = newBody;
+        pending->shapes.swap(shapes);
+        cpSpaceAddPostStepCallback(space, addPendingShapes, pending, pending);
+        return;
+    }
+    if (newBody)
+    {
+        cpSpaceAddBody(space, newBody);
+    }
+    for (auto shape : shapes)
+    {
+        cpSpaceAddShape(space, shape);
+    }
+}
+
+
+cpBody *CpShapeCache::createBodyWithName(cpSpace *space, const std::string &name, void *data) const
+{
+    const ShapeFile *file;
+    const BodyDef *bd = findBodyDef(name, &file);
+    if (!bd)
+    {
+        return nullptr;
+    }
+
+    cpBody *body = cpBodyNew(bd->mass, bd->moment);
+    cpBodySetPos(body, bd->anchorPoint);
+    cpBodySetUserData(body, data);
+
+    std::vector<cpShape *> shapes(bd->numShapes);
+    createShapes(file, bd, body, shapes.data());
+    addToSpace(space, body, shapes);
+    return body;
+}
+
+
+int CpShapeCache::addShapesToBody(cpSpace *space, cpBody *body, const std::string &name) const
+{
+    const ShapeFile *file;
+    const BodyDef *bd = findBodyDef(name, &file);
+    if (!bd)
+    {
+        return -1;
+    }
+
+    std::vector<cpShape *> shapes(bd->numShapes);
+    createShapes(file, bd, body, shapes.data());
+    addToSpace(space, nullptr, shapes);
+    return (int)bd->numShapes;
+}
+
+
+bool CpShapeCache::getMassAndMoment(const std::string &name, cpFloat &mass, cpFloat &moment) const
+{
+    const ShapeFile *file;
+    const BodyDef *bd = findBodyDef(name, &file);
+    if (!bd)
+    {
+        return false;
+    }
+    mass = bd->mass;
+    moment = bd->moment;
+    return true;
+}
+
+
+bool CpShapeCache::getAnchorPoint(const std::string &name, cpVect &anchorPoint) const
+{
+    const ShapeFile *file;
+    const BodyDef *bd = findBodyDef(name, &file);
+    if (!bd)
+    {
+        return false;
+    }
+    anchorPoint = bd->anchorPoint;
+    return true;
+}
@@ -0,0 +1,198 @@
+//
+//  CpShapeCache.h
+//
+//  Shape cache for Chipmunk 6 in portable C++, no engine required.
+//
+//  Loads physics sprites created with https://www.codeandweb.com/physicseditor
+//
+//  Copyright (c) 2026 CodeAndWeb GmbH. All rights reserved.
+//  https://www.codeandweb.com
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+
+#ifndef __CpShapeCache_h__
+#define __CpShapeCache_h__
+#include "chipmunk.h"
+#include <map>
+#include <string>
+#include <vector>
+
+
+class CpShapeCache
+{
+public:
+    /**
+     * Get pointer to the CpShapeCache singleton instance.
+     * Separate instances can be created as well, e.g. one per space.
+     *
+     * @return CpShapeCache*
+     */
+    static CpShapeCache *getInstance();
+
+    CpShapeCache();
+    ~CpShapeCache();
+
+    /**
+     * Adds the shapes of a "Chipmunk generic (PLIST)" file, the format
+     * of generic-chipmunk-plist. Mass and moment of each body are
+     * computed here, polygons are stored clockwise as Chipmunk expects.
+     *
+     * @param file path of the plist file, also the name to remove the shapes with
+     *
+     * @retval true if ok
+     * @retval false if the file can't be read or parsed, or is already loaded
+     */
+    bool addShapesWithFile(const std::string &file);
+
+    /**
+     * Adds the shapes of a plist file already in memory
+     *
+     * @param name name to remove the shapes with
+     * @param data file contents, not needed after the call
+     * @param size size of data in bytes
+     *
+     * @retval true if ok
+     * @retval false if the data can't be parsed or the name is already loaded
+     */
+    bool addShapesWithData(const std::string &name, const char *data, size_t size);
+
+    /**
+     * Removes all shapes loaded with the given name. Bodies created
+     * before keep their shapes.
+     *
+     * @param name name passed to addShapesWithData(), or the file passed
+     *             to addShapesWithFile()
+     */
+    void removeShapesWithFile(const std::string &name);
+
+    /**
+     * Removes all shapes
+     */
+    void removeAllShapes();
+
+    /**
+     * Creates a body with the precomputed mass and moment, positioned at
+     * the anchor point like GCpShapeCache, and adds it to the space
+     * together with all of its shapes. While the space is locked, e.g.
+     * in a collision callback, the body and its shapes are added in a
+     * single post-step callback.
+     * Only reads the cache, bodies in different spaces can be created
+     * from several threads at once.
+     *
+     * @param space space to add the body to
+     * @param name name of the body in the shape file
+     * @param data user data of the body
+     *
+     * @return new body, owned by the caller like cpBodyNew()
+     * @retval nullptr if the body is not found
+     */
+    cpBody *createBodyWithName(cpSpace *space, const std::string &name, void *data) const;
+
+    /**
+     * Creates the shapes of the named body on an existing body, e.g. a
+     * static body, and adds them to the space in one pass. The mass of
+     * the body is not changed, see getMassAndMoment().
+     *
+     * @param space space to add the shapes to
+     * @param body body to attach the shapes to
+     * @param name name of the body in the shape file
+     *
+     * @return number of shapes created
+     * @retval -1 if the body is not found
+     */
+    int addShapesToBody(cpSpace *space, cpBody *body, const std::string &name) const;
+
+    /**
+     * Returns the mass and the moment of inertia computed at load time
+     *
+     * @param name name of the body
+     * @param mass receives the sum of the fixture masses
+     * @param moment receives the moment about the body's origin
+     *
+     * @retval false if the body is not found
+     */
+    bool getMassAndMoment(const std::string &name, cpFloat &mass, cpFloat &moment) const;
+
+    /**
+     * Returns the anchor point set in PhysicsEditor, relative to the sprite size
+     *
+     * @param name name of the body
+     * @param anchorPoint receives the anchor point
+     *
+     * @retval false if the body is not found
+     */
+    bool getAnchorPoint(const std::string &name, cpVect &anchorPoint) const;
+
+private:
+    class PlistNode;
+
+    class ShapeDef
+    {
+    public:
+        bool isCircle;
+        cpFloat elasticity;
+        cpFloat friction;
+        cpVect surfaceVelocity;
+        cpCollisionType collisionType;
+        cpGroup group;
+        cpLayers layers;
+        bool isSensor;
+
+        // for circles
+        cpVect center;
+        cpFloat radius;
+
+        // for polygons
+        size_t firstVertex; // index into ShapeFile::vertices
+        int numVertices;
+    };
+
+
+    class BodyDef
+    {
+    public:
+        cpVect anchorPoint;
+        cpFloat mass;
+        cpFloat moment;
+        size_t firstShape; // index into ShapeFile::shapes
+        size_t numShapes;
+    };
+
+
+    class ShapeFile
+    {
+    public:
+        std::map<std::string, BodyDef> bodies;
+        std::vector<ShapeDef> shapes;   // of all bodies, in body order
+        std::vector<cpVect> vertices;   // of all polygons, clockwise
+    };
+
+    CpShapeCache(const CpShapeCache &);
+    CpShapeCache &operator=(const CpShapeCache &);
+    static bool addBody(ShapeFile *file, const std::string &name, const PlistNode &bodyData);
+    const BodyDef *findBodyDef(const std::string &name, const ShapeFile **file) const;
+    static void createShapes(const ShapeFile *file, const BodyDef *bd, cpBody *body, cpShape **shapes);
+
+    std::map<std::string, ShapeFile *> shapeFiles;
+    std::vector<ShapeFile *> loadOrder; // shapeFiles in the order they were added
+};
+
+
+#endif // __CpShapeCache_h__
@@ -29,6 +29,36 @@
 
 #include "GB2ShapeCache-x.h"
 #include "Box2D/Box2D.h"
+#include "PhysicsShapePack.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
+#include <unordered_set>
+
+// statements for the stats and trace builds, compiled out otherwise
+#if GB2SHAPECACHE_STATS
+#define GB2_STATS(...) __VA_ARGS__
+#else
+#define GB2_STATS(...)
+#endif
+#if GB2SHAPECACHE_TRACE
+#define GB2_TRACE(...) __VA_ARGS__
+#define GB2_TRACE_SCOPE(recorder, name, subject) ShapeCacheTrace::Scope traceScope(recorder, name, subject)
+#else
+#define GB2_TRACE(...)
+#define GB2_TRACE_SCOPE(recorder, name, subject)
+#endif
+
+#if GB2SHAPECACHE_STATS
+#include <chrono>
+
+typedef std::chrono::steady_clock StatsClock;
+
+static double microsSince(const StatsClock::time_point &start) {
+	return std::chrono::duration<double, std::micro>(StatsClock::now() - start).count();
+}
+#endif
 
 USING_NS_CC;
 
@@ -55,7 +85,8 @@ public:
 class BodyDef {
 public:
 	BodyDef()
-	: fixtures(NULL) {}
+	: fixtures(NULL)
+	, hasMassData(false) {}
 
 	~BodyDef() {
 		if (fixtures)
@@ -64,8 +95,66 @@ public:
 
 	FixtureDef *fixtures;
 	Vec2 anchorPoint;
+	b2MassData massData;   // about the body origin, see createBodies()
+	bool hasMassData;
 };
 
+/**
+ * Bodies of a shape pack, in the pack's order
+ */
+class PackFile {
+public:
+	~PackFile() {
+		for (BodyDef *bd : bodies) {
+			delete bd;
+		}
+	}
+
+	PhysicsShapePack::PackView view;
+	std::vector<BodyDef *> bodies;
+	unsigned long long loadNumber; // see GB2ShapeCache::loadCounter
+};
+
+// red-black tree node of std::map: parent, left, right and color
+static const size_t MAP_NODE_OVERHEAD = 4 * sizeof(void *);
+
+// polygons with more vertices are split into fans of convex pieces
+static const int MAX_PIECE_VERTICES = b2_maxPolygonVertices;
+
+// adds the fixtures of a convex polygon. Polygons with more than
+// b2_maxPolygonVertices vertices become fan pieces that share the first
+// vertex and one edge with the next piece.
+static void addPolygonFixtures(FixtureDef **&nextFixtureDef, const b2FixtureDef &basicData, int callbackData,
+		const b2Vec2 *vertices, int count, const char *bodyName) {
+	if (count < 3) {
+		CCLOG("WARNING: skipping degenerate polygon in %s", bodyName);
+		return;
+	}
+	if (count > MAX_PIECE_VERTICES) {
+		// the Box2D exporter keeps to 8 vertices, cocos2d-x files don't
+		CCLOG("WARNING: splitting polygon with %d vertices in %s", count, bodyName);
+	}
+
+	b2Vec2 piece[b2_maxPolygonVertices];
+	for (int first = 1; first < count - 1; first += MAX_PIECE_VERTICES - 2) {
+		int pieceCount = std::min(MAX_PIECE_VERTICES - 1, count - first);
+		piece[0] = vertices[0];
+		for (int v = 0; v < pieceCount; v++)
+			piece[v + 1] = vertices[first + v];
+
+		FixtureDef *fix = new FixtureDef();
+		fix->fixture = basicData;
+		fix->callbackData = callbackData;
+		b2PolygonShape *polyshape = new b2PolygonShape();
+		polyshape->Set(piece, pieceCount + 1);
+		fix->fixture.shape = polyshape;
+
+		// create a list
+		*nextFixtureDef = fix;
+		nextFixtureDef = &(fix->next);
+	}
+}
+
 static GB2ShapeCache *_sharedGB2ShapeCache = NULL;
 
 GB2ShapeCache* GB2ShapeCache::sharedGB2ShapeCache(void) {
@@ -78,45 +167,239 @@ GB2ShapeCache* GB2ShapeCache::sharedGB2ShapeCache(void) {
 }
 
 bool GB2ShapeCache::init() {
+	loadCounter = 0;
+	GB2_STATS(stats = Stats());
 	return true;
 }
 
 void GB2ShapeCache::reset() {
-	std::map<std::string, BodyDef *>::iterator iter;
-	for (iter = shapeObjects.begin() ; iter != shapeObjects.end() ; ++iter) {
-		delete iter->second;
+	// bodiesInFile also holds bodies hidden by a name of an earlier file
+	std::map<std::string, std::vector<BodyDef *> >::iterator iter;
+	for (iter = bodiesInFile.begin() ; iter != bodiesInFile.end() ; ++iter) {
+		for (BodyDef *bd : iter->second) {
+			delete bd;
+		}
 	}
 	shapeObjects.clear();
+	shadowedBodies.clear();
+	bodiesInFile.clear();
+
+	std::map<std::string, PackFile *>::iterator pack;
+	for (pack = packFiles.begin() ; pack != packFiles.end() ; ++pack) {
+		delete pack->second;
+	}
+	packFiles.clear();
+	packLoadOrder.clear();
 }
 
-void GB2ShapeCache::addFixturesToBody(b2Body *body, const std::string &shape) {
-	std::map<std::string, BodyDef *>::iterator pos = shapeObjects.find(shape);
-	assert(pos != shapeObjects.end());
+void GB2ShapeCache::removeShapesWithFile(const std::string &plist) {
+	std::map<std::string, PackFile *>::iterator pack = packFiles.find(plist);
+	if (pack != packFiles.end()) {
+		// names of the pack that no other file hides
+		PackFile *file = pack->second;
+		std::vector<std::string> removedNames;
+		for (uint32_t i = 0; i < file->view.numBodies; i++) {
+			std::string name = file->view.names + file->view.nameOffsets[i];
+			int index;
+			if (!shapeObjects.count(name) && findPackBody(name, index) == file)
+				removedNames.push_back(name);
+		}
+		packLoadOrder.erase(std::find(packLoadOrder.begin(), packLoadOrder.end(), file));
+		delete file;
+		packFiles.erase(pack);
+		unshadowBodies(plist, removedNames);
+		return;
+	}
 
-	BodyDef *so = (*pos).second;
+	std::map<std::string, std::vector<BodyDef *> >::iterator file = bodiesInFile.find(plist);
+	if (file == bodiesInFile.end())
+		return;
+
+	std::unordered_set<BodyDef *> bodies(file->second.begin(), file->second.end());
+	std::vector<std::string> removedNames;
+	std::map<std::string, BodyDef *>::iterator iter = shapeObjects.begin();
+	while (iter != shapeObjects.end()) {
+		if (bodies.count(iter->second)) {
+			removedNames.push_back(iter->first);
+			iter = shapeObjects.erase(iter);
+		}
+		else
+			++iter;
+	}
+	for (BodyDef *bd : bodies) {
+		delete bd;
+	}
+	bodiesInFile.erase(file);
+	unshadowBodies(plist, removedNames);
+}
+
+bool GB2ShapeCache::isBodyNameTaken(const std::string &shape) const {
+	int index;
+	return shapeObjects.count(shape) != 0 || findPackBody(shape, index) != NULL;
+}
+
+void GB2ShapeCache::unshadowBodies(const std::string &plist, const std::vector<std::string> &names) {
+	// forget the removed file's hidden bodies, they were deleted with the file
+	std::map<std::string, std::vector<ShadowedBody> >::iterator iter = shadowedBodies.begin();
+	while (iter != shadowedBodies.end()) {
+		std::vector<ShadowedBody> &candidates = iter->second;
+		candidates.erase(std::remove_if(candidates.begin(), candidates.end(),
+			[&plist](const ShadowedBody &shadowed) { return shadowed.plist == plist; }),
+			candidates.end());
+		if (candidates.empty())
+			iter = shadowedBodies.erase(iter);
+		else
+			++iter;
+	}
+
+	// the names refer to the body of the next file loaded, unless a pack
+	// loaded before that file still has them
+	for (const std::string &name : names) {
+		iter = shadowedBodies.find(name);
+		if (iter == shadowedBodies.end() || shapeObjects.count(name))
+			continue;
+		int index;
+		PackFile *pack = findPackBody(name, index);
+		if (pack && pack->loadNumber < iter->second.front().loadNumber)
+			continue;
+		shapeObjects[name] = iter->second.front().bodyDef;
+		iter->second.erase(iter->second.begin());
+		if (iter->second.empty())
+			shadowedBodies.erase(iter);
+	}
+}
+
+BodyDef *GB2ShapeCache::findBodyDef(const std::string &shape) const {
+	GB2_TRACE_SCOPE(trace, "lookup", shape);
+	std::map<std::string, BodyDef *>::const_iterator pos = shapeObjects.find(shape);
+	if (pos != shapeObjects.end())
+		return pos->second;
+
+	int index;
+	PackFile *pack = findPackBody(shape, index);
+	return pack ? pack->bodies[index] : NULL;
+}
+
+PackFile *GB2ShapeCache::findPackBody(const std::string &shape, int &index) const {
+	// names in several packs refer to the body of the pack added first
+	for (PackFile *pack : packLoadOrder) {
+		index = PhysicsShapePack::findBody(pack->view, shape.c_str());
+		if (index >= 0)
+			return pack;
+	}
+	return NULL;
+}
+
+void GB2ShapeCache::addFixturesToBody(b2Body *body, const std::string &shape) {
+	GB2_STATS(StatsClock::time_point start = StatsClock::now());
+	GB2_TRACE(ShapeCacheTrace::Clock::time_point traceStart = trace.now());
+	BodyDef *so = findBodyDef(shape);
+	GB2_STATS(so ? stats.lookupHits++ : stats.lookupMisses++);
+	assert(so);
 
 	FixtureDef *fix = so->fixtures;
     while (fix) {
         body->CreateFixture(&fix->fixture);
         fix = fix->next;
     }
+
+	GB2_TRACE(traceBody("addFixturesToBody", shape, traceStart, so));
+	GB2_STATS(recordInstantiations(shape, microsSince(start), 1));
+}
+
+// what b2Body::ResetMassData() computes from the fixtures
+static void computeMassData(BodyDef *bd) {
+	b2MassData &massData = bd->massData;
+	massData.mass = 0.0f;
+	massData.center.SetZero();
+	massData.I = 0.0f;
+	for (const FixtureDef *fix = bd->fixtures; fix; fix = fix->next) {
+		if (fix->fixture.density == 0.0f)
+			continue;
+		b2MassData fixtureMass;
+		fix->fixture.shape->ComputeMass(&fixtureMass, fix->fixture.density);
+		massData.mass += fixtureMass.mass;
+		massData.center += fixtureMass.mass * fixtureMass.center;
+		massData.I += fixtureMass.I;
+	}
+	if (massData.mass > 0.0f)
+		massData.center *= 1.0f / massData.mass;
+	bd->hasMassData = true;
+}
+
+int GB2ShapeCache::createBodies(b2World *world, const std::string &shape, const b2BodyDef &bodyDef, const b2Transform *transforms, int count, b2Body **out) {
+	// CreateBody() returns NULL during a time step
+	if (world->IsLocked()) {
+		CCLOG("WARNING: world is locked, can't create bodies of %s", shape.c_str());
+		return 0;
+	}
+	GB2_STATS(StatsClock::time_point start = StatsClock::now());
+	GB2_TRACE(ShapeCacheTrace::Clock::time_point traceStart = trace.now());
+	BodyDef *bd = findBodyDef(shape);
+	GB2_STATS(bd ? stats.lookupHits++ : stats.lookupMisses++);
+	if (!bd) {
+		CCLOG("WARNING: body %s not found", shape.c_str());
+		return 0;
+	}
+	bool dynamic = bodyDef.type == b2_dynamicBody;
+	if (dynamic && !bd->hasMassData)
+		computeMassData(bd);
+
+	b2BodyDef placed = bodyDef;
+	for (int i = 0; i < count; i++) {
+		placed.position = transforms[i].p;
+		placed.angle = transforms[i].q.GetAngle();
+		b2Body *body = world->CreateBody(&placed);
+
+		// CreateFixture() recomputes the mass of the body for every
+		// fixture with a density, the density is set afterwards instead
+		for (const FixtureDef *fix = bd->fixtures; fix; fix = fix->next) {
+			b2FixtureDef fixtureDef = fix->fixture;
+			fixtureDef.density = 0.0f;
+			b2Fixture *fixture = body->CreateFixture(&fixtureDef);
+			fixture->SetDensity(fix->fixture.density);
+		}
+		if (dynamic)
+			body->SetMassData(&bd->massData);
+		if (out)
+			out[i] = body;
+	}
+
+	GB2_TRACE(traceBody("createBodies", shape, traceStart, bd));
+	GB2_STATS(recordInstantiations(shape, microsSince(start), count));
+	return count;
 }
 
 cocos2d::CCPoint GB2ShapeCache::anchorPointForShape(const std::string &shape) {
-	std::map<std::string, BodyDef *>::iterator pos = shapeObjects.find(shape);
-	assert(pos != shapeObjects.end());
+	BodyDef *bd = findBodyDef(shape);
+	GB2_STATS(bd ? stats.lookupHits++ : stats.lookupMisses++);
+	assert(bd);
 
-	BodyDef *bd = (*pos).second;
 	return bd->anchorPoint;
 }
 
 void cocos2d::GB2ShapeCache::addShapesWithFile(const std::string &plist)
 {
-	ValueMap dict = FileUtils::getInstance()->getValueMapFromFile(plist);
+	GB2_STATS(StatsClock::time_point ioStart = StatsClock::now());
+	GB2_TRACE(ShapeCacheTrace::Clock::time_point traceStart = trace.now());
+	Data data = FileUtils::getInstance()->getDataFromFile(plist);
+	GB2_TRACE(trace.record("read", plist, traceStart));
+	GB2_TRACE(traceStart = trace.now());
+	if (data.isNull())
+	{
+		return;
+	}
+	GB2_STATS(FileLoadStats fileStats = FileLoadStats());
+	GB2_STATS(fileStats.ioMicros = microsSince(ioStart));
+	GB2_STATS(StatsClock::time_point parseStart = StatsClock::now());
+	ValueMap dict = FileUtils::getInstance()->getValueMapFromData((const char *)data.getBytes(), (int)data.getSize());
+	GB2_TRACE(trace.record("parse", plist, traceStart));
 	if (dict.empty())
 	{
 		return;
 	}
+	GB2_STATS(fileStats.parseMicros = microsSince(parseStart));
+	GB2_STATS(StatsClock::time_point buildStart = StatsClock::now());
 	ValueMap &metadata = dict["metadata"].asValueMap();
 	int format = metadata["format"].asInt();
 	if (format != 1)
@@ -127,16 +410,21 @@ void cocos2d::GB2ShapeCache::addShapesWithFile(const std::string &plist)
 
 	ValueMap &bodydict = dict.at("bodies").asValueMap();
 
-	b2Vec2 vertices[b2_maxPolygonVertices];
+	std::vector<b2Vec2> vertices;
+	std::vector<BodyDef *> &bodies = bodiesInFile[plist];
+	loadCounter++;
 
 	for (auto iter = bodydict.cbegin(); iter != bodydict.cend(); ++iter)
 	{
+		GB2_STATS(fileStats.numBodies++);
+		GB2_TRACE(traceStart = trace.now());
 		const ValueMap &bodyData = iter->second.asValueMap();
 		std::string bodyName = iter->first;
 		BodyDef *bodyDef = new BodyDef();
 		bodyDef->anchorPoint = PointFromString(bodyData.at("anchorpoint").asString());
 		const ValueVector &fixtureList = bodyData.at("fixtures").asValueVector();
 		FixtureDef **nextFixtureDef = &(bodyDef->fixtures);
+		bodies.push_back(bodyDef);
 
 		for (auto &fixtureitem : fixtureList)
 		{
@@ -152,7 +440,7 @@ void cocos2d::GB2ShapeCache::addShapesWithFile(const std::string &plist)
 
 			std::string cb = fixturedata["userdataCbValue"].asString();
 			int callbackData = 0;
-			if (cb.compare("") == 0)
+			if (!cb.empty())
 				callbackData = std::atoi(cb.c_str());
 			std::string fixtureType = fixturedata.at("fixture_type").asString();
 
@@ -162,30 +450,17 @@ void cocos2d::GB2ShapeCache::addShapesWithFile(const std::string &plist)
 
 				for (auto &polygonItem : polygonsArray)
 				{
-					FixtureDef *fix = new FixtureDef();
-					fix->fixture = basicData;
-					fix->callbackData = callbackData;
-
-					b2PolygonShape *polyshape = new b2PolygonShape();
-					int vindex = 0;
-
 					auto &polygonArray = polygonItem.asValueVector();
-					assert(polygonArray.size() <= b2_maxPolygonVertices);
+					vertices.clear();
 
 					for (auto &pointString : polygonArray)
 					{
 						Vec2 offset = PointFromString(pointString.asString());
-						vertices[vindex].x = (offset.x / ptmRatio);
-						vertices[vindex].y = (offset.y / ptmRatio);
-						vindex++;
+						vertices.push_back(b2Vec2(offset.x / ptmRatio, offset.y / ptmRatio));
 					}
 
-					polyshape->Set(vertices, vindex);
-					fix->fixture.shape = polyshape;
-
-					// create a list
-					*nextFixtureDef = fix;
-					nextFixtureDef = &(fix->next);
+					addPolygonFixtures(nextFixtureDef, basicData, callbackData,
+						vertices.data(), (int)vertices.size(), bodyName.c_str());
 				}
 			}
 			else if (fixtureType == "CIRCLE") {
@@ -209,11 +484,775 @@ void cocos2d::GB2ShapeCache::addShapesWithFile(const std::string &plist)
 			else {
 				CCASSERT(0, "Unknown fixtureType");
 			}
+		}
 
-			// add the body element to the hash
+		// add the body element to the hash, names already loaded from
+		// another file are not replaced
+		if (isBodyNameTaken(bodyName)) {
+			ShadowedBody shadowed = { plist, bodyDef, loadCounter };
+			shadowedBodies[bodyName].push_back(shadowed);
+		}
+		else
 			shapeObjects[bodyName] = bodyDef;
+
+		GB2_TRACE(traceBody("build", bodyName, traceStart, bodyDef));
+	}
+
+	GB2_STATS(fileStats.buildMicros = microsSince(buildStart));
+	GB2_STATS(stats.files[plist] = fileStats);
+}
+
+void GB2ShapeCache::addShapesWithPack(const std::string &name, const PhysicsShapePack::PackView &pack) {
+	GB2_STATS(StatsClock::time_point buildStart = StatsClock::now());
+	// pack bodies have no name strings, the whole pack is one span
+	GB2_TRACE_SCOPE(trace, "build", name);
+	if (packFiles.count(name))
+		return;
+	if (pack.ptmRatio <= 0) {
+		// packs of cocos2d-x plists are in points, not meters
+		CCLOG("WARNING: %s is not a Box2D shape pack, generate it from a Box2D plist", name.c_str());
+		return;
+	}
+	ptmRatio = pack.ptmRatio;
+
+	std::vector<b2Vec2> vertices;
+	PackFile *file = new PackFile();
+	file->view = pack;
+	file->loadNumber = ++loadCounter;
+	packFiles[name] = file;
+	packLoadOrder.push_back(file);
+	std::vector<BodyDef *> &bodies = file->bodies;
+	bodies.reserve(pack.numBodies);
+
+	for (uint32_t b = 0; b < pack.numBodies; b++) {
+		const PhysicsShapePack::Body &body = pack.bodies[b];
+		BodyDef *bodyDef = new BodyDef();
+		bodyDef->anchorPoint = Vec2(body.anchorX, body.anchorY);
+		FixtureDef **nextFixtureDef = &(bodyDef->fixtures);
+		bodies.push_back(bodyDef);
+
+		for (uint32_t f = 0; f < body.numFixtures; f++) {
+			const PhysicsShapePack::Fixture &fixture = pack.fixtures[body.firstFixture + f];
+			b2FixtureDef basicData;
+			basicData.filter.categoryBits = fixture.categoryMask;
+			basicData.filter.maskBits = fixture.collisionMask;
+			basicData.filter.groupIndex = fixture.group;
+			basicData.friction = fixture.friction;
+			basicData.density = fixture.density;
+			basicData.restitution = fixture.restitution;
+			basicData.isSensor = fixture.isSensor != 0;
+
+			if (fixture.fixtureType == PhysicsShapePack::FIXTURE_POLYGON) {
+				for (uint32_t p = 0; p < fixture.numPolygons; p++) {
+					const PhysicsShapePack::Polygon &polygon = pack.polygons[fixture.firstPolygon + p];
+
+					// pack coordinates are already divided by the ptm ratio
+					const PhysicsShapePack::Vertex *v = pack.vertices + polygon.firstVertex;
+					vertices.clear();
+					for (uint32_t i = 0; i < polygon.numVertices; i++) {
+						vertices.push_back(b2Vec2(v[i].x, v[i].y));
+					}
+
+					addPolygonFixtures(nextFixtureDef, basicData, fixture.callbackData,
+						vertices.data(), (int)vertices.size(), pack.names + pack.nameOffsets[b]);
+				}
+			}
+			else {
+				FixtureDef *fix = new FixtureDef();
+				fix->fixture = basicData;
+				fix->callbackData = fixture.callbackData;
+
+				b2CircleShape *circleShape = new b2CircleShape();
+				circleShape->m_radius = fixture.radius;
+				circleShape->m_p = b2Vec2(fixture.centerX, fixture.centerY);
+				fix->fixture.shape = circleShape;
+
+				*nextFixtureDef = fix;
+				nextFixtureDef = &(fix->next);
+			}
 		}
+	}
+
+#if GB2SHAPECACHE_STATS
+	FileLoadStats fileStats = FileLoadStats();
+	fileStats.buildMicros = microsSince(buildStart);
+	fileStats.numBodies = (int)pack.numBodies;
+	stats.files[name] = fileStats;
+#endif
+}
+
+// FNV-1a
+static uint64_t hashBytes(uint64_t hash, const void *data, size_t size) {
+	const unsigned char *bytes = (const unsigned char *)data;
+	for (size_t i = 0; i < size; i++)
+		hash = (hash ^ bytes[i]) * 1099511628211ULL;
+	return hash;
+}
+
+template <typename T>
+static uint64_t hashValue(uint64_t hash, const T &value) {
+	return hashBytes(hash, &value, sizeof(value));
+}
+
+static const uint64_t HASH_SEED = 14695981039346656037ULL;
 
+static uint64_t hashFixture(uint64_t hash, const FixtureDef *fix) {
+	const b2FixtureDef &f = fix->fixture;
+	hash = hashValue(hash, f.friction);
+	hash = hashValue(hash, f.restitution);
+	hash = hashValue(hash, f.density);
+	hash = hashValue(hash, f.isSensor);
+	hash = hashValue(hash, f.filter.categoryBits);
+	hash = hashValue(hash, f.filter.maskBits);
+	hash = hashValue(hash, f.filter.groupIndex);
+	hash = hashValue(hash, fix->callbackData);
+	hash = hashValue(hash, f.shape->m_type);
+	hash = hashValue(hash, f.shape->m_radius);
+	if (f.shape->m_type == b2Shape::e_polygon) {
+		const b2PolygonShape *polygon = (const b2PolygonShape *)f.shape;
+		hash = hashBytes(hash, polygon->m_vertices, polygon->m_count * sizeof(b2Vec2));
 	}
+	else if (f.shape->m_type == b2Shape::e_circle) {
+		hash = hashValue(hash, ((const b2CircleShape *)f.shape)->m_p);
+	}
+	return hash;
+}
+
+// fixtures are only combined if all of these match
+static bool sameMaterial(const FixtureDef *a, const FixtureDef *b) {
+	const b2FixtureDef &fa = a->fixture;
+	const b2FixtureDef &fb = b->fixture;
+	return fa.friction == fb.friction && fa.restitution == fb.restitution && fa.density == fb.density
+		&& fa.isSensor == fb.isSensor && fa.filter.categoryBits == fb.filter.categoryBits
+		&& fa.filter.maskBits == fb.filter.maskBits && fa.filter.groupIndex == fb.filter.groupIndex
+		&& a->callbackData == b->callbackData;
+}
+
+static FixtureDef **appendFixture(FixtureDef **next, const FixtureDef *material, b2Shape *shape) {
+	FixtureDef *fix = new FixtureDef();
+	fix->fixture = material->fixture;
+	fix->fixture.shape = shape;
+	fix->callbackData = material->callbackData;
+	*next = fix;
+	return &(fix->next);
+}
+
+/**
+ * Merges vertices closer than b2_linearSlop into one point, so that
+ * touching props share their edges
+ */
+class WeldGrid {
+public:
+	int add(const b2Vec2 &v) {
+		int cx = (int)std::floor(v.x / b2_linearSlop);
+		int cy = (int)std::floor(v.y / b2_linearSlop);
+		for (int dx = -1; dx <= 1; dx++) {
+			for (int dy = -1; dy <= 1; dy++) {
+				std::unordered_map<uint64_t, std::vector<int> >::const_iterator cell = cells.find(key(cx + dx, cy + dy));
+				if (cell == cells.end())
+					continue;
+				for (int index : cell->second) {
+					b2Vec2 d = points[index] - v;
+					if (d.x * d.x + d.y * d.y <= b2_linearSlop * b2_linearSlop)
+						return index;
+				}
+			}
+		}
+		cells[key(cx, cy)].push_back((int)points.size());
+		points.push_back(v);
+		return (int)points.size() - 1;
+	}
+
+	static uint64_t key(int a, int b) {
+		return ((uint64_t)(uint32_t)a << 32) | (uint32_t)b;
+	}
+
+	std::vector<b2Vec2> points;
+	std::unordered_map<uint64_t, std::vector<int> > cells;
+};
+
+/**
+ * Polygons of one material, counter-clockwise rings of WeldGrid points
+ */
+class BakeGroup {
+public:
+	const FixtureDef *material;
+	std::vector<std::vector<int> > polygons;
+};
+
+static float cross(const b2Vec2 &o, const b2Vec2 &a, const b2Vec2 &b) {
+	return (a.x - o.x) * (b.y - o.y) - (a.y - o.y) * (b.x - o.x);
+}
+
+// drops repeated points and points on the line between their neighbors
+static void simplifyRing(std::vector<int> &ring, const std::vector<b2Vec2> &points) {
+	bool changed = true;
+	while (changed && ring.size() >= 3) {
+		changed = false;
+		for (size_t i = 0; i < ring.size() && ring.size() >= 3; i++) {
+			int prev = ring[(i + ring.size() - 1) % ring.size()];
+			int next = ring[(i + 1) % ring.size()];
+			b2Vec2 d = points[next] - points[prev];
+			float length = std::sqrt(d.x * d.x + d.y * d.y);
+			if (ring[i] == prev || std::fabs(cross(points[prev], points[ring[i]], points[next])) <= b2_linearSlop * length) {
+				ring.erase(ring.begin() + i);
+				changed = true;
+				i--;
+			}
+		}
+	}
+	if (ring.size() < 3)
+		ring.clear();
+}
+
+static bool isConvex(const std::vector<int> &ring, const std::vector<b2Vec2> &points) {
+	for (size_t i = 0; i < ring.size(); i++) {
+		if (cross(points[ring[i]], points[ring[(i + 1) % ring.size()]], points[ring[(i + 2) % ring.size()]]) <= 0.0f)
+			return false;
+	}
+	return true;
+}
+
+// joins polygons across shared edges while the result is a convex
+// b2PolygonShape, until no pair can be joined
+static void mergePolygons(std::vector<std::vector<int> > &polygons, const std::vector<b2Vec2> &points) {
+	bool merged = true;
+	while (merged) {
+		merged = false;
+		// directed edge -> polygon and index of its first point
+		std::unordered_map<uint64_t, std::pair<int, int> > edges;
+		for (size_t p = 0; p < polygons.size(); p++) {
+			const std::vector<int> &ring = polygons[p];
+			for (size_t i = 0; i < ring.size(); i++)
+				edges[WeldGrid::key(ring[i], ring[(i + 1) % ring.size()])] = std::make_pair((int)p, (int)i);
+		}
+
+		std::vector<bool> changed(polygons.size());
+		for (size_t p = 0; p < polygons.size(); p++) {
+			std::vector<int> &ring = polygons[p];
+			for (size_t i = 0; i < ring.size() && !changed[p]; i++) {
+				int a = ring[i];
+				int b = ring[(i + 1) % ring.size()];
+				std::unordered_map<uint64_t, std::pair<int, int> >::const_iterator shared = edges.find(WeldGrid::key(b, a));
+				if (shared == edges.end())
+					continue;
+				int q = shared->second.first;
+				if (q == (int)p || changed[q] || polygons[q].empty())
+					continue;
+
+				// p from b around to a, then q between a and b
+				const std::vector<int> &other = polygons[q];
+				std::vector<int> candidate;
+				for (size_t k = 0; k < ring.size(); k++)
+					candidate.push_back(ring[(i + 1 + k) % ring.size()]);
+				for (size_t k = 2; k < other.size(); k++)
+					candidate.push_back(other[(shared->second.second + k) % other.size()]);
+				simplifyRing(candidate, points);
+				if (candidate.size() > b2_maxPolygonVertices || candidate.empty() || !isConvex(candidate, points))
+					continue;
+
+				ring = candidate;
+				polygons[q].clear();
+				changed[p] = changed[q] = true;
+				merged = true;
+			}
+		}
+		polygons.erase(std::remove_if(polygons.begin(), polygons.end(),
+			[](const std::vector<int> &ring) { return ring.empty(); }), polygons.end());
+	}
+}
+
+// inserts points that lie inside an edge of another polygon (T-junctions),
+// so that the edges of neighbors match exactly
+static void splitEdges(std::vector<std::vector<int> > &polygons, const std::vector<b2Vec2> &points) {
+	std::vector<int> byX(points.size());
+	for (size_t i = 0; i < points.size(); i++)
+		byX[i] = (int)i;
+	std::sort(byX.begin(), byX.end(), [&points](int a, int b) { return points[a].x < points[b].x; });
+
+	for (std::vector<int> &ring : polygons) {
+		std::vector<int> result;
+		for (size_t i = 0; i < ring.size(); i++) {
+			const b2Vec2 &a = points[ring[i]];
+			const b2Vec2 &b = points[ring[(i + 1) % ring.size()]];
+			b2Vec2 d = b - a;
+			float length2 = d.x * d.x + d.y * d.y;
+			float minY = std::min(a.y, b.y) - b2_linearSlop;
+			float maxY = std::max(a.y, b.y) + b2_linearSlop;
+			float maxX = std::max(a.x, b.x) + b2_linearSlop;
+			std::vector<std::pair<float, int> > inside;
+			std::vector<int>::const_iterator iter = std::lower_bound(byX.begin(), byX.end(), std::min(a.x, b.x) - b2_linearSlop,
+				[&points](int index, float x) { return points[index].x < x; });
+			for ( ; iter != byX.end() && points[*iter].x <= maxX; ++iter) {
+				const b2Vec2 &v = points[*iter];
+				if (v.y < minY || v.y > maxY || *iter == ring[i] || *iter == ring[(i + 1) % ring.size()])
+					continue;
+				float t = ((v.x - a.x) * d.x + (v.y - a.y) * d.y) / length2;
+				float distance = cross(a, b, v);
+				if (t > 0.0f && t < 1.0f && distance * distance <= b2_linearSlop * b2_linearSlop * length2)
+					inside.push_back(std::make_pair(t, *iter));
+			}
+			std::sort(inside.begin(), inside.end());
+			result.push_back(ring[i]);
+			for (const std::pair<float, int> &point : inside)
+				result.push_back(point.second);
+		}
+		ring = result;
+	}
+}
+
+// the edges that are not shared with a neighbor, joined into loops
+static void traceOutlines(const std::vector<std::vector<int> > &polygons, const std::vector<b2Vec2> &points, std::vector<std::vector<int> > &loops) {
+	// an edge and its reverse cancel out
+	std::map<std::pair<int, int>, int> boundary;
+	for (const std::vector<int> &ring : polygons) {
+		for (size_t i = 0; i < ring.size(); i++) {
+			int a = ring[i];
+			int b = ring[(i + 1) % ring.size()];
+			std::map<std::pair<int, int>, int>::iterator reverse = boundary.find(std::make_pair(b, a));
+			if (reverse != boundary.end()) {
+				if (--reverse->second == 0)
+					boundary.erase(reverse);
+			}
+			else {
+				boundary[std::make_pair(a, b)]++;
+			}
+		}
+	}
+
+	std::map<int, std::vector<int> > outgoing;
+	for (const auto &edge : boundary) {
+		for (int n = 0; n < edge.second; n++)
+			outgoing[edge.first.first].push_back(edge.first.second);
+	}
+
+	while (!outgoing.empty()) {
+		int start = outgoing.begin()->first;
+		int prev = -1;
+		int current = start;
+		std::vector<int> loop;
+		for (;;) {
+			loop.push_back(current);
+			std::map<int, std::vector<int> >::iterator out = outgoing.find(current);
+			if (out == outgoing.end())
+				break;
+			// where outlines touch, take the sharpest left turn: the solid is
+			// on the left, so this keeps touching loops apart
+			size_t best = 0;
+			if (prev >= 0 && out->second.size() > 1) {
+				b2Vec2 in = points[current] - points[prev];
+				float bestAngle = -10.0f;
+				for (size_t k = 0; k < out->second.size(); k++) {
+					b2Vec2 o = points[out->second[k]] - points[current];
+					float angle = std::atan2(in.x * o.y - in.y * o.x, in.x * o.x + in.y * o.y);
+					if (angle > bestAngle) {
+						bestAngle = angle;
+						best = k;
+					}
+				}
+			}
+			int next = out->second[best];
+			out->second.erase(out->second.begin() + best);
+			if (out->second.empty())
+				outgoing.erase(out);
+			if (next == start)
+				break;
+			prev = current;
+			current = next;
+		}
+		simplifyRing(loop, points);
+		if (!loop.empty())
+			loops.push_back(loop);
+	}
+}
+
+// baked file: magic, key, number of fixtures, then per fixture the shape
+// type, material, radius and vertices; readBakedFile() checks all sizes
+static const char BAKE_MAGIC[8] = { 'G', 'B', '2', 'B', 'A', 'K', 'E', '1' };
+
+template <typename T>
+static void writeValue(std::vector<unsigned char> &out, const T &value) {
+	const unsigned char *bytes = (const unsigned char *)&value;
+	out.insert(out.end(), bytes, bytes + sizeof(value));
+}
+
+template <typename T>
+static bool readValue(const unsigned char *&p, const unsigned char *end, T &value) {
+	if ((size_t)(end - p) < sizeof(value))
+		return false;
+	memcpy(&value, p, sizeof(value));
+	p += sizeof(value);
+	return true;
+}
+
+static void writeBakedFile(const std::string &path, uint64_t key, const BodyDef *bd) {
+	std::vector<unsigned char> out(BAKE_MAGIC, BAKE_MAGIC + sizeof(BAKE_MAGIC));
+	writeValue(out, key);
+	int32_t numFixtures = 0;
+	for (const FixtureDef *fix = bd->fixtures; fix; fix = fix->next)
+		numFixtures++;
+	writeValue(out, numFixtures);
+
+	for (const FixtureDef *fix = bd->fixtures; fix; fix = fix->next) {
+		const b2FixtureDef &f = fix->fixture;
+		writeValue(out, (int32_t)f.shape->m_type);
+		writeValue(out, f.friction);
+		writeValue(out, f.restitution);
+		writeValue(out, f.density);
+		writeValue(out, (int32_t)f.isSensor);
+		writeValue(out, (int32_t)f.filter.categoryBits);
+		writeValue(out, (int32_t)f.filter.maskBits);
+		writeValue(out, (int32_t)f.filter.groupIndex);
+		writeValue(out, (int32_t)fix->callbackData);
+		writeValue(out, f.shape->m_radius);
+
+		const b2Vec2 *vertices = NULL;
+		int32_t count = 0;
+		if (f.shape->m_type == b2Shape::e_polygon) {
+			vertices = ((const b2PolygonShape *)f.shape)->m_vertices;
+			count = ((const b2PolygonShape *)f.shape)->m_count;
+		}
+		else if (f.shape->m_type == b2Shape::e_chain) {
+			// loops store the first vertex again at the end
+			vertices = ((const b2ChainShape *)f.shape)->m_vertices;
+			count = ((const b2ChainShape *)f.shape)->m_count - 1;
+		}
+		else {
+			vertices = &((const b2CircleShape *)f.shape)->m_p;
+			count = 1;
+		}
+		writeValue(out, count);
+		for (int32_t i = 0; i < count; i++) {
+			writeValue(out, vertices[i].x);
+			writeValue(out, vertices[i].y);
+		}
+	}
+
+	Data data;
+	data.copy(out.data(), (ssize_t)out.size());
+	if (!FileUtils::getInstance()->writeDataToFile(data, path))
+		CCLOG("WARNING: could not write baked shapes to %s", path.c_str());
+}
+
+static bool readBakedFile(const std::string &path, uint64_t key, BodyDef *bd) {
+	if (!FileUtils::getInstance()->isFileExist(path))
+		return false;
+	Data data = FileUtils::getInstance()->getDataFromFile(path);
+	const unsigned char *p = data.getBytes();
+	const unsigned char *end = p + data.getSize();
+
+	uint64_t fileKey = 0;
+	int32_t numFixtures = 0;
+	if (data.getSize() < (ssize_t)sizeof(BAKE_MAGIC) || memcmp(p, BAKE_MAGIC, sizeof(BAKE_MAGIC)) != 0)
+		return false;
+	p += sizeof(BAKE_MAGIC);
+	if (!readValue(p, end, fileKey) || fileKey != key || !readValue(p, end, numFixtures))
+		return false;
+
+	FixtureDef **nextFixtureDef = &(bd->fixtures);
+	std::vector<b2Vec2> vertices;
+	for (int32_t n = 0; n < numFixtures; n++) {
+		int32_t type = 0, isSensor = 0, categoryBits = 0, maskBits = 0, groupIndex = 0, count = 0;
+		FixtureDef material;
+		b2FixtureDef &f = material.fixture;
+		float radius = 0.0f;
+		if (!readValue(p, end, type) || !readValue(p, end, f.friction) || !readValue(p, end, f.restitution)
+			|| !readValue(p, end, f.density) || !readValue(p, end, isSensor) || !readValue(p, end, categoryBits)
+			|| !readValue(p, end, maskBits) || !readValue(p, end, groupIndex) || !readValue(p, end, material.callbackData)
+			|| !readValue(p, end, radius) || !readValue(p, end, count) || count < 1 || count > (end - p) / 8)
+			return false;
+		f.isSensor = isSensor != 0;
+		f.filter.categoryBits = (uint16)categoryBits;
+		f.filter.maskBits = (uint16)maskBits;
+		f.filter.groupIndex = (int16)groupIndex;
+		vertices.resize(count);
+		for (int32_t i = 0; i < count; i++) {
+			readValue(p, end, vertices[i].x);
+			readValue(p, end, vertices[i].y);
+		}
+
+		b2Shape *shape = NULL;
+		if (type == b2Shape::e_polygon && count >= 3 && count <= b2_maxPolygonVertices) {
+			b2PolygonShape *polygon = new b2PolygonShape();
+			polygon->Set(vertices.data(), count);
+			shape = polygon;
+		}
+		else if (type == b2Shape::e_chain && count >= 3) {
+			b2ChainShape *chain = new b2ChainShape();
+			chain->CreateLoop(vertices.data(), count);
+			shape = chain;
+		}
+		else if (type == b2Shape::e_circle && count == 1) {
+			b2CircleShape *circle = new b2CircleShape();
+			circle->m_p = vertices[0];
+			shape = circle;
+		}
+		else {
+			return false;
+		}
+		shape->m_radius = radius;
+		nextFixtureDef = appendFixture(nextFixtureDef, &material, shape);
+	}
+	return p == end;
+}
+
+bool GB2ShapeCache::bakeStaticBodies(const std::string &name, const std::vector<Placement> &placements, bool useChains, const std::string &cachePath) {
+	GB2_TRACE_SCOPE(trace, "bake", name);
+	if (isBodyNameTaken(name) || bodiesInFile.count(name) || packFiles.count(name)) {
+		CCLOG("WARNING: shapes %s are already loaded", name.c_str());
+		return false;
+	}
+
+	// the cache key covers the placements and the source shapes
+	uint64_t key = hashValue(HASH_SEED, useChains);
+	std::vector<const BodyDef *> sources;
+	for (const Placement &placement : placements) {
+		const BodyDef *source = findBodyDef(placement.shape);
+		if (!source) {
+			CCLOG("WARNING: body %s not found", placement.shape.c_str());
+			return false;
+		}
+		sources.push_back(source);
+		key = hashBytes(key, placement.shape.c_str(), placement.shape.size() + 1);
+		key = hashValue(key, placement.x);
+		key = hashValue(key, placement.y);
+		key = hashValue(key, placement.angle);
+		for (const FixtureDef *fix = source->fixtures; fix; fix = fix->next)
+			key = hashFixture(key, fix);
+	}
+
+	BodyDef *bodyDef = new BodyDef();
+	if (cachePath.empty() || !readBakedFile(cachePath, key, bodyDef)) {
+		delete bodyDef;
+		bodyDef = new BodyDef();
+
+		// into world space, polygons grouped by material
+		WeldGrid grid;
+		std::vector<BakeGroup> groups;
+		FixtureDef **nextFixtureDef = &(bodyDef->fixtures);
+		for (size_t n = 0; n < placements.size(); n++) {
+			b2Transform xf(b2Vec2(placements[n].x, placements[n].y), b2Rot(placements[n].angle));
+			for (const FixtureDef *fix = sources[n]->fixtures; fix; fix = fix->next) {
+				if (fix->fixture.shape->m_type == b2Shape::e_circle) {
+					const b2CircleShape *source = (const b2CircleShape *)fix->fixture.shape;
+					b2CircleShape *circle = new b2CircleShape();
+					circle->m_radius = source->m_radius;
+					circle->m_p = b2Mul(xf, source->m_p);
+					nextFixtureDef = appendFixture(nextFixtureDef, fix, circle);
+					continue;
+				}
+
+				size_t g = 0;
+				while (g < groups.size() && !sameMaterial(groups[g].material, fix))
+					g++;
+				if (g == groups.size()) {
+					groups.push_back(BakeGroup());
+					groups[g].material = fix;
+				}
+				const b2PolygonShape *source = (const b2PolygonShape *)fix->fixture.shape;
+				std::vector<int> ring;
+				for (int32 i = 0; i < source->m_count; i++)
+					ring.push_back(grid.add(b2Mul(xf, source->m_vertices[i])));
+				simplifyRing(ring, grid.points);
+				if (!ring.empty())
+					groups[g].polygons.push_back(ring);
+			}
+		}
+
+		std::vector<b2Vec2> vertices;
+		for (BakeGroup &group : groups) {
+			if (useChains && !group.material->fixture.isSensor) {
+				splitEdges(group.polygons, grid.points);
+				std::vector<std::vector<int> > loops;
+				traceOutlines(group.polygons, grid.points, loops);
+				for (const std::vector<int> &loop : loops) {
+					vertices.clear();
+					for (int index : loop)
+						vertices.push_back(grid.points[index]);
+					b2ChainShape *chain = new b2ChainShape();
+					chain->CreateLoop(vertices.data(), (int32)vertices.size());
+					nextFixtureDef = appendFixture(nextFixtureDef, group.material, chain);
+				}
+				continue;
+			}
+
+			mergePolygons(group.polygons, grid.points);
+			for (const std::vector<int> &ring : group.polygons) {
+				vertices.clear();
+				for (int index : ring)
+					vertices.push_back(grid.points[index]);
+				b2PolygonShape *polygon = new b2PolygonShape();
+				polygon->Set(vertices.data(), (int32)vertices.size());
+				nextFixtureDef = appendFixture(nextFixtureDef, group.material, polygon);
+			}
+		}
+
+		if (!cachePath.empty())
+			writeBakedFile(cachePath, key, bodyDef);
+	}
+	bodiesInFile[name].push_back(bodyDef);
+	shapeObjects[name] = bodyDef;
+	return true;
+}
+
+static size_t stringHeapSize(const std::string &s) {
+	// short strings are stored inside the string object itself
+	return s.capacity() > std::string().capacity() ? s.capacity() + 1 : 0;
+}
+
+static bool compareMemoryUsage(const GB2ShapeCache::MemoryUsage &a, const GB2ShapeCache::MemoryUsage &b) {
+	return a.bytes > b.bytes;
+}
+
+static void addBodyDefMemoryUsage(GB2ShapeCache::MemoryUsage &usage, const BodyDef *bd) {
+	usage.bytes += sizeof(BodyDef);
+	usage.numBodies++;
+	for (const FixtureDef *fix = bd->fixtures; fix; fix = fix->next) {
+		usage.bytes += sizeof(FixtureDef);
+		usage.numFixtures++;
+		if (fix->fixture.shape->m_type == b2Shape::e_polygon) {
+			usage.bytes += sizeof(b2PolygonShape);
+			usage.numVertices += ((const b2PolygonShape *)fix->fixture.shape)->m_count;
+		}
+		else if (fix->fixture.shape->m_type == b2Shape::e_chain) {
+			int32 count = ((const b2ChainShape *)fix->fixture.shape)->m_count;
+			usage.bytes += sizeof(b2ChainShape) + count * sizeof(b2Vec2);
+			usage.numVertices += count;
+		}
+		else {
+			usage.bytes += sizeof(b2CircleShape);
+		}
+	}
+}
+
+GB2ShapeCache::MemoryUsage GB2ShapeCache::getBodyMemoryUsage(const std::string &shape) const {
+	MemoryUsage usage = MemoryUsage();
+	usage.name = shape;
+	std::map<std::string, BodyDef *>::const_iterator pos = shapeObjects.find(shape);
+	if (pos != shapeObjects.end()) {
+		addBodyDefMemoryUsage(usage, pos->second);
+		usage.bytes += MAP_NODE_OVERHEAD + sizeof(*pos) + stringHeapSize(pos->first);
+	}
+	else if (const BodyDef *bd = findBodyDef(shape)) {
+		addBodyDefMemoryUsage(usage, bd);
+	}
+	return usage;
+}
+
+GB2ShapeCache::MemoryUsage GB2ShapeCache::getFileMemoryUsage(const std::string &plist) const {
+	MemoryUsage usage = MemoryUsage();
+	usage.name = plist;
+	std::map<std::string, PackFile *>::const_iterator pack = packFiles.find(plist);
+	if (pack != packFiles.end()) {
+		usage.bytes += MAP_NODE_OVERHEAD + sizeof(*pack) + stringHeapSize(pack->first)
+			+ sizeof(PackFile) + pack->second->bodies.capacity() * sizeof(BodyDef *);
+		for (const BodyDef *bd : pack->second->bodies) {
+			addBodyDefMemoryUsage(usage, bd);
+		}
+		return usage;
+	}
+
+	std::map<std::string, std::vector<BodyDef *> >::const_iterator pos = bodiesInFile.find(plist);
+	if (pos == bodiesInFile.end())
+		return usage;
+
+	const std::vector<BodyDef *> &bodies = pos->second;
+	usage.bytes += MAP_NODE_OVERHEAD + sizeof(*pos) + stringHeapSize(pos->first)
+		+ bodies.capacity() * sizeof(BodyDef *);
+	for (const BodyDef *bd : bodies) {
+		addBodyDefMemoryUsage(usage, bd);
+	}
+
+	// name index entries pointing to the file's bodies
+	std::unordered_set<const BodyDef *> fileBodies(bodies.begin(), bodies.end());
+	for (const auto &entry : shapeObjects) {
+		if (fileBodies.count(entry.second))
+			usage.bytes += MAP_NODE_OVERHEAD + sizeof(entry) + stringHeapSize(entry.first);
+	}
+	return usage;
+}
+
+GB2ShapeCache::MemoryReport GB2ShapeCache::getMemoryReport(size_t maxEntries) const {
+	MemoryReport report = MemoryReport();
+	report.totalBytes = sizeof(GB2ShapeCache);
+
+	for (const auto &entry : shapeObjects) {
+		MemoryUsage usage = getBodyMemoryUsage(entry.first);
+		report.totalBytes += usage.bytes;
+		report.bodies.push_back(usage);
+	}
+	for (const auto &entry : bodiesInFile) {
+		report.totalBytes += MAP_NODE_OVERHEAD + sizeof(entry) + stringHeapSize(entry.first)
+			+ entry.second.capacity() * sizeof(BodyDef *);
+		report.files.push_back(getFileMemoryUsage(entry.first));
+	}
+	for (const auto &entry : packFiles) {
+		MemoryUsage usage = getFileMemoryUsage(entry.first);
+		report.totalBytes += usage.bytes;
+		report.files.push_back(usage);
+		const PhysicsShapePack::PackView &pack = entry.second->view;
+		for (uint32_t i = 0; i < pack.numBodies; i++) {
+			MemoryUsage body = MemoryUsage();
+			body.name = pack.names + pack.nameOffsets[i];
+			addBodyDefMemoryUsage(body, entry.second->bodies[i]);
+			report.bodies.push_back(body);
+		}
+	}
+
+	std::sort(report.files.begin(), report.files.end(), compareMemoryUsage);
+	std::sort(report.bodies.begin(), report.bodies.end(), compareMemoryUsage);
+	if (report.files.size() > maxEntries)
+		report.files.resize(maxEntries);
+	if (report.bodies.size() > maxEntries)
+		report.bodies.resize(maxEntries);
+	return report;
+}
+
+#if GB2SHAPECACHE_STATS
+GB2ShapeCache::Stats GB2ShapeCache::getStats() const {
+	Stats result = stats;
+	result.liveBodyDefs = (int)shapeObjects.size();
+	for (const auto &entry : packFiles) {
+		result.liveBodyDefs += (int)entry.second->bodies.size();
+	}
+	return result;
+}
+
+void GB2ShapeCache::resetStats() {
+	stats.files.clear();
+	stats.bodies.clear();
+	stats.lookupHits = 0;
+	stats.lookupMisses = 0;
+}
+
+// count bodies created in one call share the average time
+void GB2ShapeCache::recordInstantiations(const std::string &shape, double micros, int count) {
+	if (count <= 0)
+		return;
+	double perBody = micros / count;
+	BodyStats &bs = stats.bodies[shape];
+	bs.instantiations += count;
+	bs.totalMicros += micros;
+	bs.maxMicros = std::max(bs.maxMicros, perBody);
+	int bucket = 0;
+	while (bucket < LATENCY_BUCKETS - 1 && perBody >= (double)(2u << bucket))
+		bucket++;
+	bs.histogram[bucket] += count;
+}
+#endif
+
+#if GB2SHAPECACHE_TRACE
+void GB2ShapeCache::traceBody(const char *span, const std::string &shape, ShapeCacheTrace::Clock::time_point start, const BodyDef *bd) {
+	if (!trace.isEnabled() || !bd) {
+		trace.record(span, shape, start);
+		return;
+	}
+	MemoryUsage usage = MemoryUsage();
+	addBodyDefMemoryUsage(usage, bd);
+	trace.record(span, shape, start, usage.numFixtures, usage.numVertices);
+}
 
+bool GB2ShapeCache::writeTrace(const std::string &path) const {
+	return FileUtils::getInstance()->writeStringToFile(trace.toJson(), path);
 }
+#endif
@@ -32,8 +32,31 @@
 
 #include "cocos2d.h"
 
+// Set to 1 to record load timings, lookup counters and instantiation latencies
+#ifndef GB2SHAPECACHE_STATS
+#define GB2SHAPECACHE_STATS 0
+#endif
+
+// Set to 1 to record trace spans of loading, lookups and addFixturesToBody,
+// see setTraceEnabled()
+#ifndef GB2SHAPECACHE_TRACE
+#define GB2SHAPECACHE_TRACE 0
+#endif
+
+#if GB2SHAPECACHE_TRACE
+#include "ShapeCacheTrace.h"
+#endif
+
 class BodyDef;
+class PackFile;
 class b2Body;
+class b2World;
+struct b2BodyDef;
+struct b2Transform;
+
+namespace PhysicsShapePack {
+	struct PackView;
+}
 
 namespace cocos2d {
 	class GB2ShapeCache {
@@ -43,17 +66,157 @@ namespace cocos2d {
 
 	public:
 		bool init();
+		// names already loaded from another file or pack refer to the body
+		// of the file loaded first, until that file is removed
 		void addShapesWithFile(const std::string &plist);
+		// shapes compiled into the application with shape-pack/pe_shape_pack.py,
+		// no plist parsing and no name strings, bodies are found with the
+		// pack's name index; removed with removeShapesWithFile(name).
+		// Names already loaded keep referring to that body, names of the
+		// pack hide those of files loaded later.
+		// Only packs of Box2D plists, packs of cocos2d-x plists have no
+		// ptm ratio and are rejected. Polygons with more than
+		// b2_maxPolygonVertices vertices are split into several fixtures.
+		void addShapesWithPack(const std::string &name, const PhysicsShapePack::PackView &pack);
+		void removeShapesWithFile(const std::string &plist);
 		void addFixturesToBody(b2Body *body, const std::string &shape);
+
+		// creates count bodies of a shape with all of their fixtures. Type,
+		// damping and the other body settings come from bodyDef, Box2D plists
+		// have none; its position and angle are replaced by transforms, in
+		// meters and radians. For dynamic bodies the mass data is computed
+		// once per shape and set once per body instead of after every
+		// fixture. out receives the bodies and may be NULL.
+		// Returns the number of bodies created, 0 if the shape is unknown or
+		// the world is locked, e.g. in a contact callback.
+		int createBodies(b2World *world, const std::string &shape, const b2BodyDef &bodyDef, const b2Transform *transforms, int count, b2Body **out);
 		cocos2d::CCPoint anchorPointForShape(const std::string &shape);
+
+		// placement of a static body for bakeStaticBodies(), in meters and
+		// radians like b2BodyDef::position and b2BodyDef::angle
+		struct Placement {
+			std::string shape;
+			float x;
+			float y;
+			float angle;
+		};
+
+		// merges many static bodies into one body definition, added to a
+		// single static b2Body with addFixturesToBody(body, name).
+		// Vertices closer than b2_linearSlop are welded and polygons that
+		// share an edge are merged while they stay convex. With useChains
+		// the outlines of the polygons become b2ChainShape loops instead,
+		// edges between neighbors are dropped. Circles are copied, sensors
+		// stay polygons, fixtures are only combined if their properties match.
+		// With a cachePath the result is written to that file and read back
+		// by later calls with the same placements and source shapes.
+		// Removed with removeShapesWithFile(name).
+		bool bakeStaticBodies(const std::string &name, const std::vector<Placement> &placements, bool useChains, const std::string &cachePath = "");
 		void reset();
 		float getPtmRatio() { return ptmRatio; }
 		~GB2ShapeCache() {}
 
+		// memory used by a loaded file or a single body: requested sizes of the
+		// body, fixture and Box2D shape objects, name strings and map nodes,
+		// without heap allocator overhead
+		struct MemoryUsage {
+			std::string name;
+			size_t bytes;
+			int numBodies;
+			int numFixtures;
+			int numVertices;
+		};
+
+		// largest files and bodies first
+		struct MemoryReport {
+			size_t totalBytes;
+			std::vector<MemoryUsage> files;
+			std::vector<MemoryUsage> bodies;
+		};
+
+		MemoryUsage getFileMemoryUsage(const std::string &plist) const;
+		MemoryUsage getBodyMemoryUsage(const std::string &shape) const;
+		MemoryReport getMemoryReport(size_t maxEntries = 10) const;
+
+#if GB2SHAPECACHE_STATS
+		enum { LATENCY_BUCKETS = 16 };
+
+		// load timings of one plist file, in microseconds
+		struct FileLoadStats {
+			double ioMicros;
+			double parseMicros;
+			double buildMicros;
+			int numBodies;
+		};
+
+		// histogram[i] counts calls faster than 2^(i+1) microseconds,
+		// the last bucket also holds all slower calls. Bodies of one
+		// createBodies() call count with the average time per body.
+		struct BodyStats {
+			unsigned int instantiations;
+			double totalMicros;
+			double maxMicros;
+			unsigned int histogram[LATENCY_BUCKETS];
+		};
+
+		struct Stats {
+			std::map<std::string, FileLoadStats> files;
+			std::map<std::string, BodyStats> bodies;
+			unsigned int lookupHits;
+			unsigned int lookupMisses;
+			int liveBodyDefs;
+		};
+
+		Stats getStats() const;
+		void resetStats();
+#endif
+
+#if GB2SHAPECACHE_TRACE
+		// spans are kept in a ring buffer of setTraceCapacity() entries (4096)
+		// and returned as Chrome trace-event JSON for chrome://tracing or Perfetto
+		void setTraceEnabled(bool enabled) { trace.setEnabled(enabled); }
+		void setTraceCapacity(size_t numSpans) { trace.setCapacity(numSpans); }
+		void clearTrace() { trace.clear(); }
+		std::string getTraceJson() const { return trace.toJson(); }
+		bool writeTrace(const std::string &path) const;
+#endif
+
 	private:
+		BodyDef *findBodyDef(const std::string &shape) const;
+		PackFile *findPackBody(const std::string &shape, int &index) const;
+		bool isBodyNameTaken(const std::string &shape) const;
+		void unshadowBodies(const std::string &plist, const std::vector<std::string> &names);
+#if GB2SHAPECACHE_STATS
+		void recordInstantiations(const std::string &shape, double micros, int count);
+#endif
+
+		// body hidden by the same name in a file loaded earlier
+		struct ShadowedBody {
+			std::string plist;
+			BodyDef *bodyDef;
+			unsigned long long loadNumber; // of its file, see loadCounter
+		};
+
 		std::map<std::string, BodyDef *> shapeObjects;
-		GB2ShapeCache(void) {}
+		std::map<std::string, std::vector<ShadowedBody> > shadowedBodies; // by name, in load order
+		std::map<std::string, std::vector<BodyDef *> > bodiesInFile;
+		std::map<std::string, PackFile *> packFiles;
+		std::vector<PackFile *> packLoadOrder; // names in several packs refer to the first
+		unsigned long long loadCounter; // counts added files, orders them when names clash
+		GB2ShapeCache(void)
+#if GB2SHAPECACHE_TRACE
+		: trace("GB2ShapeCache")
+#endif
+		{}
 		float ptmRatio;
+#if GB2SHAPECACHE_STATS
+		Stats stats;
+#endif
+#if GB2SHAPECACHE_TRACE
+		void traceBody(const char *span, const std::string &shape, ShapeCacheTrace::Clock::time_point start, const BodyDef *bd);
+
+		mutable ShapeCacheTrace::Recorder trace;
+#endif
 	};
 }
 
@@ -0,0 +1,369 @@
+//
+//  PhysicsShapeInflate.cpp
+//
+//  Streaming decompression of shape files compressed with
+//  pe_shape_pack.py compress, engine independent, uses zlib.
+//
+//  Loads physics sprites created with https://www.codeandweb.com/physicseditor
+//
+//  Copyright (c) 2026 CodeAndWeb GmbH. All rights reserved.
+//  https://www.codeandweb.com
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+#include "PhysicsShapeInflate.h"
+#include <cstring>
+#include <zlib.h>
+
+#if PHYSICSSHAPEPACK_READER_THREAD
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#endif
+
+
+namespace PhysicsShapePack
+{
+    static const char COMPRESSED_MAGIC[8] = { 'P', 'S', 'C', 'Z', 'L', 'I', 'B', '1' };
+
+
+    static size_t readUInt32(const unsigned char *p)
+    {
+        return (size_t)p[0] | ((size_t)p[1] << 8) | ((size_t)p[2] << 16) | ((size_t)p[3] << 24);
+    }
+
+
+    static bool readHeader(const void *data, size_t size, size_t &contentSize, size_t &compressedSize)
+    {
+        const unsigned char *p = (const unsigned char *)data;
+        if (size < COMPRESSED_HEADER_SIZE || memcmp(p, COMPRESSED_MAGIC, sizeof(COMPRESSED_MAGIC)) != 0)
+        {
+            return false;
+        }
+        contentSize = readUInt32(p + 8);
+        compressedSize = readUInt32(p + 12);
+        return true;
+    }
+
+
+    bool readCompressedHeader(const void *data, size_t size, size_t &contentSize)
+    {
+        size_t compressedSize;
+        return readHeader(data, size, contentSize, compressedSize);
+    }
+
+
+    /**
+     * Inflates one piece of the zlib stream into the output buffer
+     *
+     * @retval Z_OK if more input is needed
+     * @retval Z_STREAM_END when the content is complete
+     * @retval other zlib error code if the stream is corrupt
+     */
+    static int inflateChunk(z_stream &stream, const unsigned char *input, size_t size)
+    {
+        stream.next_in = (Bytef *)input;
+        stream.avail_in = (uInt)size;
+        while (stream.avail_in > 0)
+        {
+            int result = inflate(&stream, Z_NO_FLUSH);
+            if (result != Z_OK)
+            {
+                return result == Z_BUF_ERROR ? Z_DATA_ERROR : result;
+            }
+        }
+        return Z_OK;
+    }
+
+
+    static bool beginInflate(z_stream &stream, void *output, size_t outputSize)
+    {
+        memset(&stream, 0, sizeof(stream));
+        if (inflateInit(&stream) != Z_OK)
+        {
+            return false;
+        }
+        stream.next_out = (Bytef *)output;
+        stream.avail_out = (uInt)outputSize;
+        return true;
+    }
+
+
+    static bool endInflate(z_stream &stream, int result, size_t outputSize)
+    {
+        bool ok = result == Z_STREAM_END && stream.total_out == outputSize;
+        inflateEnd(&stream);
+        return ok;
+    }
+
+
+    bool inflateCompressed(const void *data, size_t size, void *output, size_t outputSize)
+    {
+        size_t contentSize, compressedSize;
+        if (!readHeader(data, size, contentSize, compressedSize) || contentSize != outputSize
+            || compressedSize > size - COMPRESSED_HEADER_SIZE)
+        {
+            return false;
+        }
+
+        z_stream stream;
+        if (!beginInflate(stream, output, outputSize))
+        {
+            return false;
+        }
+        int result = inflateChunk(stream, (const unsigned char *)data + COMPRESSED_HEADER_SIZE, compressedSize);
+        return endInflate(stream, result, outputSize);
+    }
+
+
+    const size_t CompressedFileReader::CHUNK_SIZE;
+    const int CompressedFileReader::NUM_CHUNKS;
+
+
+    CompressedFileReader::CompressedFileReader()
+    : file(nullptr)
+    , source(nullptr)
+    , readFunction(nullptr)
+    , contentSize(0)
+    , compressedSize(0)
+    {
+    }
+
+
+    CompressedFileReader::~CompressedFileReader()
+    {
+        close();
+    }
+
+
+    static size_t readFromFile(void *source, void *buffer, size_t size)
+    {
+        return fread(buffer, 1, size, (FILE *)source);
+    }
+
+
+    bool CompressedFileReader::open(const char *path)
+    {
+        close();
+        file = fopen(path, "rb");
+        if (!file)
+        {
+            return false;
+        }
+        source = file;
+        readFunction = readFromFile;
+        return readFileHeader();
+    }
+
+
+    bool CompressedFileReader::open(void *source, ReadFunction readFunction)
+    {
+        close();
+        this->source = source;
+        this->readFunction = readFunction;
+        return readFileHeader();
+    }
+
+
+    void CompressedFileReader::close()
+    {
+        if (file)
+        {
+            fclose(file);
+            file = nullptr;
+        }
+        source = nullptr;
+        readFunction = nullptr;
+    }
+
+
+    // read functions may return less than requested before the end, e.g. AAsset_read()
+    size_t CompressedFileReader::readFully(void *buffer, size_t size)
+    {
+        size_t total = 0;
+        while (total < size)
+        {
+            size_t count = readFunction(source, (unsigned char *)buffer + total, size - total);
+            if (count == 0)
+            {
+                break;
+            }
+            total += count;
+        }
+        return total;
+    }
+
+
+    bool CompressedFileReader::readFileHeader()
+    {
+        unsigned char header[COMPRESSED_HEADER_SIZE];
+        if (readFully(header, sizeof(header)) != sizeof(header)
+            || !readHeader(header, sizeof(header), contentSize, compressedSize))
+        {
+            close();
+            return false;
+        }
+        return true;
+    }
+
+
+#if PHYSICSSHAPEPACK_READER_THREAD
+
+    /**
+     * Ring of chunks shared by the reader thread and the inflating thread.
+     * The reader fills chunks while the ring is not full, a chunk with
+     * size 0 marks the end of the file or a read error.
+     */
+    class ChunkRing
+    {
+    public:
+        ChunkRing() : head(0), count(0), cancelled(false) {}
+
+        unsigned char *beginWrite()
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            changed.wait(lock, [this] { return count < CompressedFileReader::NUM_CHUNKS || cancelled; });
+            return cancelled ? nullptr : data[(head + count) % CompressedFileReader::NUM_CHUNKS];
+        }
+
+        void endWrite(size_t size)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            sizes[(head + count) % CompressedFileReader::NUM_CHUNKS] = size;
+            count++;
+            changed.notify_all();
+        }
+
+        const unsigned char *beginRead(size_t &size)
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            changed.wait(lock, [this] { return count > 0; });
+            size = sizes[head];
+            return data[head];
+        }
+
+        void endRead()
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            head = (head + 1) % CompressedFileReader::NUM_CHUNKS;
+            count--;
+            changed.notify_all();
+        }
+
+        void cancel()
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            cancelled = true;
+            changed.notify_all();
+        }
+
+    private:
+        unsigned char data[CompressedFileReader::NUM_CHUNKS][CompressedFileReader::CHUNK_SIZE];
+        size_t sizes[CompressedFileReader::NUM_CHUNKS];
+        int head;
+        int count;
+        bool cancelled;
+        std::mutex mutex;
+        std::condition_variable changed;
+    };
+
+
+    bool CompressedFileReader::read(void *output)
+    {
+        if (!readFunction)
+        {
+            return false;
+        }
+
+        z_stream stream;
+        if (!output || !beginInflate(stream, output, contentSize))
+        {
+            close();
+            return false;
+        }
+
+        // heap allocated, the ring is too large for small thread stacks
+        ChunkRing *ring = new ChunkRing();
+        size_t remaining = compressedSize;
+        std::thread reader([this, ring, remaining]() mutable {
+            size_t size;
+            do
+            {
+                unsigned char *chunk = ring->beginWrite();
+                if (!chunk)
+                {
+                    return;
+                }
+                size = readFully(chunk, remaining < CHUNK_SIZE ? remaining : CHUNK_SIZE);
+                remaining -= size;
+                ring->endWrite(size);
+            } while (size > 0);
+        });
+
+        int result = Z_OK;
+        while (result == Z_OK)
+        {
+            size_t size;
+            const unsigned char *chunk = ring->beginRead(size);
+            result = size > 0 ? inflateChunk(stream, chunk, size) : Z_DATA_ERROR;
+            ring->endRead();
+        }
+
+        ring->cancel();
+        reader.join();
+        delete ring;
+
+        close();
+        return endInflate(stream, result, contentSize);
+    }
+
+#else
+
+    bool CompressedFileReader::read(void *output)
+    {
+        if (!readFunction)
+        {
+            return false;
+        }
+
+        z_stream stream;
+        if (!output || !beginInflate(stream, output, contentSize))
+        {
+            close();
+            return false;
+        }
+
+        unsigned char *chunk = new unsigned char[CHUNK_SIZE];
+        size_t remaining = compressedSize;
+        int result = Z_OK;
+        while (result == Z_OK)
+        {
+            size_t size = remaining < CHUNK_SIZE ? remaining : CHUNK_SIZE;
+            size = readFully(chunk, size);
+            remaining -= size;
+            result = size > 0 ? inflateChunk(stream, chunk, size) : Z_DATA_ERROR;
+        }
+        delete[] chunk;
+
+        close();
+        return endInflate(stream, result, contentSize);
+    }
+
+#endif
+}
@@ -0,0 +1,161 @@
+//
+//  PhysicsShapeInflate.h
+//
+//  Streaming decompression of shape files compressed with
+//  pe_shape_pack.py compress, engine independent, uses zlib.
+//
+//  Loads physics sprites created with https://www.codeandweb.com/physicseditor
+//
+//  Copyright (c) 2026 CodeAndWeb GmbH. All rights reserved.
+//  https://www.codeandweb.com
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+
+#ifndef __PhysicsShapeInflate_h__
+#define __PhysicsShapeInflate_h__
+
+#include <stddef.h>
+#include <stdio.h>
+
+/**
+ * Set to 0 on platforms without threads. The file is then read and
+ * inflated alternately instead of at the same time.
+ */
+#ifndef PHYSICSSHAPEPACK_READER_THREAD
+#if defined(__EMSCRIPTEN__) && !defined(__EMSCRIPTEN_PTHREADS__)
+#define PHYSICSSHAPEPACK_READER_THREAD 0
+#else
+#define PHYSICSSHAPEPACK_READER_THREAD 1
+#endif
+#endif
+
+
+namespace PhysicsShapePack
+{
+    /**
+     * Compressed shape files start with "PSCZLIB1", the size of the
+     * content and the size of the zlib stream that follows, both little
+     * endian uint32. The content is a plist file or a bundle.
+     */
+    static const size_t COMPRESSED_HEADER_SIZE = 16;
+
+
+    /**
+     * Checks if data starts with the header of a compressed shape file
+     *
+     * @param data first bytes of the file
+     * @param size number of bytes available
+     * @param contentSize receives the size of the uncompressed content
+     *
+     * @retval true if the file is compressed
+     */
+    bool readCompressedHeader(const void *data, size_t size, size_t &contentSize);
+
+
+    /**
+     * Inflates a compressed shape file that is already in memory.
+     * Files on disk or in an Android APK are streamed with
+     * CompressedFileReader instead.
+     *
+     * @param data the whole file, including the header
+     * @param size size of data in bytes
+     * @param output receives the content
+     * @param outputSize size from readCompressedHeader()
+     *
+     * @retval false if the data is corrupt or truncated
+     */
+    bool inflateCompressed(const void *data, size_t size, void *output, size_t outputSize);
+
+
+    /**
+     * Reads a compressed shape file in chunks and inflates them straight
+     * into the caller's buffer. A second thread reads the next chunks
+     * while the current one is inflated, only NUM_CHUNKS chunks of the
+     * compressed file are in memory at a time.
+     */
+    class CompressedFileReader
+    {
+    public:
+        static const size_t CHUNK_SIZE = 64 * 1024;
+        static const int NUM_CHUNKS = 4;
+
+        /**
+         * Reads the next bytes of a file that is not a plain file, e.g.
+         * AAsset_read() for files in an Android APK. Called from the
+         * reader thread.
+         *
+         * @return number of bytes read, 0 at the end of the file or on error
+         */
+        typedef size_t (*ReadFunction)(void *source, void *buffer, size_t size);
+
+        CompressedFileReader();
+        ~CompressedFileReader();
+
+        /**
+         * Opens the file and reads the header
+         *
+         * @param path file system path
+         *
+         * @retval false if the file can't be opened or is not compressed
+         */
+        bool open(const char *path);
+
+        /**
+         * Reads the header from a source opened by the caller. The source
+         * must stay open until read() returns, the caller closes it.
+         *
+         * @param source passed to readFunction
+         * @param readFunction reads the next bytes of source
+         *
+         * @retval false if the file is not compressed
+         */
+        bool open(void *source, ReadFunction readFunction);
+
+        /**
+         * Size of the buffer to pass to read()
+         */
+        size_t getContentSize() const { return contentSize; }
+
+        /**
+         * Inflates the content and closes a file opened with a path
+         *
+         * @param output buffer of getContentSize() bytes
+         *
+         * @retval false if the file is corrupt or truncated
+         */
+        bool read(void *output);
+
+    private:
+        CompressedFileReader(const CompressedFileReader &);
+        CompressedFileReader &operator=(const CompressedFileReader &);
+
+        bool readFileHeader();
+        size_t readFully(void *buffer, size_t size);
+        void close();
+
+        FILE *file;
+        void *source;
+        ReadFunction readFunction;
+        size_t contentSize;
+        size_t compressedSize;
+    };
+}
+
+#endif // __PhysicsShapeInflate_h__
@@ -0,0 +1,200 @@
+//
+//  PhysicsShapePack.h
+//
+//  Engine independent shape records shared by the PhysicsEditor loaders.
+//  Used for shapes compiled into the application with pe_shape_pack.py.
+//
+//  Loads physics sprites created with https://www.codeandweb.com/physicseditor
+//
+//  Copyright (c) 2026 CodeAndWeb GmbH. All rights reserved.
+//  https://www.codeandweb.com
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+
+#ifndef __PhysicsShapePack_h__
+#define __PhysicsShapePack_h__
+
+#include <stdint.h>
+
+
+namespace PhysicsShapePack
+{
+    enum
+    {
+        FIXTURE_POLYGON = 0,
+        FIXTURE_CIRCLE = 1
+    };
+
+    enum
+    {
+        BODY_DYNAMIC = 1,
+        BODY_AFFECTED_BY_GRAVITY = 2,
+        BODY_ALLOWS_ROTATION = 4
+    };
+
+
+    struct Vertex
+    {
+        float x;
+        float y;
+    };
+
+
+    struct Polygon
+    {
+        uint32_t firstVertex;
+        uint32_t numVertices;
+    };
+
+
+    /**
+     * Fixture properties of all exporters. Box2D filter bits are stored
+     * in categoryMask (categoryBits), collisionMask (maskBits) and
+     * group (groupIndex).
+     */
+    struct Fixture
+    {
+        uint32_t fixtureType;
+
+        float density;
+        float restitution;
+        float friction;
+
+        int32_t tag;
+        int32_t group;
+        uint32_t categoryMask;
+        uint32_t collisionMask;
+        uint32_t contactTestMask;
+        uint32_t isSensor;
+        int32_t callbackData;
+
+        // for circles
+        float centerX;
+        float centerY;
+        float radius;
+
+        uint32_t firstPolygon;
+        uint32_t numPolygons;
+    };
+
+
+    struct Body
+    {
+        float anchorX;
+        float anchorY;
+        uint32_t flags;
+
+        float linearDamping;
+        float angularDamping;
+        float velocityLimit;
+        float angularVelocityLimit;
+
+        uint32_t firstFixture;
+        uint32_t numFixtures;
+    };
+
+
+    /**
+     * A set of bodies. Coordinates are in final units: divided by the
+     * scale factor (cocos2d-x) or by ptmRatio (Box2D) when the pack was
+     * generated. The name table is sorted by byte value.
+     *
+     * The optional name index is a minimal perfect hash computed by the
+     * generator: the body named n is hashSlots[slotForHash(hashName(n))].
+     * Without it (numHashBuckets == 0) names are found by binary search.
+     */
+    struct PackView
+    {
+        uint32_t numBodies;
+        const char *names;           ///< NUL terminated names
+        const uint32_t *nameOffsets; ///< start of each body's name in names
+        const Body *bodies;
+        const Fixture *fixtures;
+        const Polygon *polygons;
+        const Vertex *vertices;
+        float ptmRatio;              ///< Box2D packs only
+
+        uint32_t numHashBuckets;
+        const uint32_t *hashDisplacements; ///< one per bucket
+        const uint32_t *hashSlots;         ///< body index of each slot
+    };
+
+
+    /**
+     * 64 bit FNV-1a of a NUL terminated name
+     */
+    inline constexpr uint64_t hashName(const char *name, uint64_t hash = 14695981039346656037ULL)
+    {
+        return *name ? hashName(name + 1, (hash ^ (unsigned char)*name) * 1099511628211ULL) : hash;
+    }
+
+
+    // finalizer of MurmurHash3, spreads the displaced hash over all slots
+    inline constexpr uint32_t shiftMix(uint32_t x, int shift)
+    {
+        return x ^ (x >> shift);
+    }
+
+    inline constexpr uint32_t mixHash(uint32_t x)
+    {
+        return shiftMix(shiftMix(shiftMix(x, 16) * 0x85ebca6bu, 13) * 0xc2b2ae35u, 16);
+    }
+
+
+    inline constexpr uint32_t slotForHash(const PackView &pack, uint64_t hash)
+    {
+        return mixHash((uint32_t)hash ^ pack.hashDisplacements[(uint32_t)(hash >> 32) % pack.numHashBuckets]) % pack.numBodies;
+    }
+
+
+    inline constexpr int compareNames(const char *a, const char *b)
+    {
+        return (*a != *b || *a == 0) ? (int)(unsigned char)*a - (int)(unsigned char)*b : compareNames(a + 1, b + 1);
+    }
+
+
+    inline constexpr int matchBody(const PackView &pack, const char *name, uint32_t body)
+    {
+        return compareNames(pack.names + pack.nameOffsets[body], name) == 0 ? (int)body : -1;
+    }
+
+
+    inline constexpr int findBody(const PackView &pack, const char *name, int lo, int hi)
+    {
+        return lo >= hi ? -1
+             : compareNames(pack.names + pack.nameOffsets[(lo + hi) / 2], name) == 0 ? (lo + hi) / 2
+             : compareNames(pack.names + pack.nameOffsets[(lo + hi) / 2], name) < 0 ? findBody(pack, name, (lo + hi) / 2 + 1, hi)
+             : findBody(pack, name, lo, (lo + hi) / 2);
+    }
+
+
+    /**
+     * Returns the index of the body with the given name, -1 if not found.
+     * With a name index this is one hash and one string compare.
+     * Can be evaluated at compile time for packs generated as C++ header.
+     */
+    inline constexpr int findBody(const PackView &pack, const char *name)
+    {
+        return pack.numHashBuckets > 0 ? matchBody(pack, name, pack.hashSlots[slotForHash(pack, hashName(name))])
+             : findBody(pack, name, 0, (int)pack.numBodies);
+    }
+}
+
+#endif // __PhysicsShapePack_h__
@@ -0,0 +1,970 @@
+//
+//  PhysicsShapeXml.cpp
+//
+//  Reads PhysicsEditor XML exports (<bodydef>) into shape pack records.
+//  Same format as read by gdx-pe-loader.
+//
+//  Loads physics sprites created with https://www.codeandweb.com/physicseditor
+//
+//  Copyright (c) 2026 CodeAndWeb GmbH. All rights reserved.
+//  https://www.codeandweb.com
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+
+#include "PhysicsShapeXml.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+
+namespace PhysicsShapePack
+{
+    static const double POWERS_OF_10[] =
+    {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+
+    // more digits than this do not change a float
+    static const uint64_t MANTISSA_LIMIT = 100000000000000000ULL;
+
+
+    static inline bool isSpace(char c)
+    {
+        return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+    }
+
+
+    static inline bool isDigit(char c)
+    {
+        return (unsigned char)(c - '0') < 10;
+    }
+
+
+    static const char *skipSpace(const char *p, const char *end)
+    {
+        while (p < end && isSpace(*p))
+        {
+            p++;
+        }
+        return p;
+    }
+
+
+    const char *parseFloat(const char *p, const char *end, float &value)
+    {
+        p = skipSpace(p, end);
+        bool negative = false;
+        if (p < end && (*p == '-' || *p == '+'))
+        {
+            negative = *p == '-';
+            p++;
+        }
+
+        // all digits go into one integer, the decimal point only moves the exponent
+        uint64_t mantissa = 0;
+        int exponent = 0;
+        int numDigits = 0;
+        for (; p < end && isDigit(*p); p++, numDigits++)
+        {
+            if (mantissa < MANTISSA_LIMIT)
+            {
+                mantissa = mantissa * 10 + (uint64_t)(*p - '0');
+            }
+            else
+            {
+                exponent++;
+            }
+        }
+        if (p < end && *p == '.')
+        {
+            for (p++; p < end && isDigit(*p); p++, numDigits++)
+            {
+                if (mantissa < MANTISSA_LIMIT)
+                {
+                    mantissa = mantissa * 10 + (uint64_t)(*p - '0');
+                    exponent--;
+                }
+            }
+        }
+        if (numDigits == 0)
+        {
+            return nullptr;
+        }
+
+        if (p < end && (*p == 'e' || *p == 'E'))
+        {
+            const char *q = p + 1;
+            bool negativeExponent = false;
+            if (q < end && (*q == '-' || *q == '+'))
+            {
+                negativeExponent = *q == '-';
+                q++;
+            }
+            if (q < end && isDigit(*q))
+            {
+                int e = 0;
+                for (; q < end && isDigit(*q); q++)
+                {
+                    e = std::min(e * 10 + (*q - '0'), 10000);
+                }
+                exponent += negativeExponent ? -e : e;
+                p = q;
+            }
+        }
+
+        // exact for the usual 4 decimals: both operands are exact doubles
+        double result = (double)mantissa;
+        if (exponent < 0)
+        {
+            result = exponent >= -22 ? result / POWERS_OF_10[-exponent] : result * std::pow(10.0, exponent);
+        }
+        else if (exponent > 0)
+        {
+            result = exponent <= 22 ? result * POWERS_OF_10[exponent] : result * std::pow(10.0, exponent);
+        }
+        value = (float)(negative ? -result : result);
+        return p;
+    }
+
+
+    static const char *parseInt(const char *p, const char *end, int64_t &value)
+    {
+        p = skipSpace(p, end);
+        bool negative = false;
+        if (p < end && (*p == '-' || *p == '+'))
+        {
+            negative = *p == '-';
+            p++;
+        }
+        if (p >= end || !isDigit(*p))
+        {
+            return nullptr;
+        }
+        int64_t result = 0;
+        for (; p < end && isDigit(*p); p++)
+        {
+            result = std::min<int64_t>(result * 10 + (*p - '0'), (int64_t)1 << 40);
+        }
+        value = negative ? -result : result;
+        return p;
+    }
+
+
+    /**
+     * Reads the XML with a tokenizer that keeps pointers into the buffer.
+     * Only the elements of the bodydef format are interpreted, everything
+     * else is skipped.
+     */
+    class XmlPack::Parser
+    {
+    public:
+        enum
+        {
+            TOKEN_OPEN,  ///< <name attributes>
+            TOKEN_CLOSE, ///< </name>
+            TOKEN_EMPTY, ///< <name attributes/>
+            TOKEN_TEXT,  ///< text that is not just white space
+            TOKEN_END,
+            TOKEN_ERROR
+        };
+
+        Parser(XmlPack &pack, const char *data, size_t size)
+        : pack(pack)
+        , data(data)
+        , p(data)
+        , end(data + size)
+        , token(data)
+        , ptmRatio(0)
+        , hasMetadata(false)
+        {
+        }
+
+        bool run();
+
+    private:
+        int next();
+        bool fail(const char *message);
+        bool isName(const char *tag) const;
+        bool findAttribute(const char *attribute, const char *&value, const char *&valueEnd) const;
+
+        bool readText(const char *&text, const char *&textEnd);
+        bool readFloat(float &value);
+        bool readInt(int64_t &value);
+        bool skipElement();
+        bool skipContent(int token);
+
+        bool parseBodyDef();
+        bool parseBody(bool empty);
+        bool parseFixture();
+        bool parseCircle(Fixture &fixture);
+        bool parsePolygon();
+        bool parseMetadata();
+        void finish();
+
+        XmlPack &pack;
+        const char *data;
+        const char *p;
+        const char *end;
+
+        // current token
+        const char *token;
+        const char *name;
+        const char *nameEnd;
+        const char *attributes;
+        const char *attributesEnd;
+        const char *text;
+        const char *textEnd;
+
+        std::vector<std::string> bodyNames; // in file order
+        float ptmRatio;
+        bool hasMetadata;
+    };
+
+
+    int XmlPack::Parser::next()
+    {
+        for (;;)
+        {
+            const char *start = p;
+            while (p < end && *p != '<')
+            {
+                p++;
+            }
+            if (skipSpace(start, p) != p)
+            {
+                token = start;
+                text = start;
+                textEnd = p;
+                return TOKEN_TEXT;
+            }
+            if (p >= end)
+            {
+                token = p;
+                return TOKEN_END;
+            }
+
+            token = p;
+            const char *skipTo = nullptr;
+            if (end - p >= 4 && p[1] == '!' && p[2] == '-' && p[3] == '-')
+            {
+                skipTo = "-->";
+            }
+            else if (end - p >= 2 && (p[1] == '?' || p[1] == '!'))
+            {
+                skipTo = ">"; // declaration, processing instruction or DOCTYPE
+            }
+            if (skipTo)
+            {
+                const char *found = std::search(p + 2, end, skipTo, skipTo + strlen(skipTo));
+                if (found == end)
+                {
+                    return TOKEN_ERROR;
+                }
+                p = found + strlen(skipTo);
+                continue;
+            }
+
+            bool closing = end - p >= 2 && p[1] == '/';
+            const char *q = p + (closing ? 2 : 1);
+            name = q;
+            while (q < end && !isSpace(*q) && *q != '>' && *q != '/')
+            {
+                q++;
+            }
+            nameEnd = q;
+
+            // '>' inside quoted attribute values does not end the tag
+            char quote = 0;
+            while (q < end && (quote || *q != '>'))
+            {
+                if (quote)
+                {
+                    quote = *q == quote ? 0 : quote;
+                }
+                else if (*q == '"' || *q == '\'')
+                {
+                    quote = *q;
+                }
+                q++;
+            }
+            if (q >= end || name == nameEnd)
+            {
+                return TOKEN_ERROR;
+            }
+
+            bool empty = !closing && q[-1] == '/';
+            attributes = nameEnd;
+            attributesEnd = empty ? q - 1 : q;
+            p = q + 1;
+            return closing ? TOKEN_CLOSE : empty ? TOKEN_EMPTY : TOKEN_OPEN;
+        }
+    }
+
+
+    bool XmlPack::Parser::fail(const char *message)
+    {
+        int line = 1 + (int)std::count(data, std::min(token, end), '\n');
+        char buffer[32];
+        snprintf(buffer, sizeof(buffer), "line %d: ", line);
+        pack.error = std::string(buffer) + message;
+        return false;
+    }
+
+
+    bool XmlPack::Parser::isName(const char *tag) const
+    {
+        size_t length = strlen(tag);
+        return (size_t)(nameEnd - name) == length && memcmp(name, tag, length) == 0;
+    }
+
+
+    bool XmlPack::Parser::findAttribute(const char *attribute, const char *&value, const char *&valueEnd) const
+    {
+        size_t length = strlen(attribute);
+        const char *q = attributes;
+        while (q < attributesEnd)
+        {
+            q = skipSpace(q, attributesEnd);
+            const char *key = q;
+            while (q < attributesEnd && *q != '=' && !isSpace(*q))
+            {
+                q++;
+            }
+            const char *keyEnd = q;
+            q = skipSpace(q, attributesEnd);
+            if (q >= attributesEnd || *q != '=')
+            {
+                return false;
+            }
+            q = skipSpace(q + 1, attributesEnd);
+            if (q >= attributesEnd || (*q != '"' && *q != '\''))
+            {
+                return false;
+            }
+            const char *valueStart = q + 1;
+            q = std::find(valueStart, attributesEnd, *q);
+            if (q >= attributesEnd)
+            {
+                return false;
+            }
+            if ((size_t)(keyEnd - key) == length && memcmp(key, attribute, length) == 0)
+            {
+                value = valueStart;
+                valueEnd = q;
+                return true;
+            }
+            q++;
+        }
+        return false;
+    }
+
+
+    // appends XML text with the predefined and numeric entities replaced
+    static void appendDecoded(std::string &out, const char *p, const char *end)
+    {
+        static const char *const ENTITIES[][2] =
+        {
+            { "&amp;", "&" }, { "&lt;", "<" }, { "&gt;", ">" }, { "&quot;", "\"" }, { "&apos;", "'" }
+        };
+
+        while (p < end)
+        {
+            const char *amp = std::find(p, end, '&');
+            out.append(p, amp);
+            if (amp == end)
+            {
+                return;
+            }
+            p = amp + 1;
+
+            const char *semicolon = std::find(amp, end, ';');
+            if (semicolon == end)
+            {
+                out += '&';
+                continue;
+            }
+            bool decoded = false;
+            for (auto &entity : ENTITIES)
+            {
+                size_t length = strlen(entity[0]);
+                if ((size_t)(semicolon + 1 - amp) == length && memcmp(amp, entity[0], length) == 0)
+                {
+                    out += entity[1];
+                    decoded = true;
+                    break;
+                }
+            }
+            bool hex = semicolon - amp > 2 && (amp[2] == 'x' || amp[2] == 'X');
+            unsigned long code = 0;
+            if (!decoded && amp[1] == '#')
+            {
+                code = strtoul(std::string(amp + (hex ? 3 : 2), semicolon).c_str(), nullptr, hex ? 16 : 10);
+            }
+            if (code > 0 && code <= 0x10ffff)
+            {
+                // as UTF-8
+                if (code < 0x80)
+                {
+                    out += (char)code;
+                }
+                else if (code < 0x800)
+                {
+                    out += (char)(0xc0 | (code >> 6));
+                    out += (char)(0x80 | (code & 0x3f));
+                }
+                else if (code < 0x10000)
+                {
+                    out += (char)(0xe0 | (code >> 12));
+                    out += (char)(0x80 | ((code >> 6) & 0x3f));
+                    out += (char)(0x80 | (code & 0x3f));
+                }
+                else
+                {
+                    out += (char)(0xf0 | ((code >> 18) & 0x07));
+                    out += (char)(0x80 | ((code >> 12) & 0x3f));
+                    out += (char)(0x80 | ((code >> 6) & 0x3f));
+                    out += (char)(0x80 | (code & 0x3f));
+                }
+                decoded = true;
+            }
+            if (decoded)
+            {
+                p = semicolon + 1;
+            }
+            else
+            {
+                out += '&';
+            }
+        }
+    }
+
+
+    // contents of a simple element, after its start tag
+    bool XmlPack::Parser::readText(const char *&value, const char *&valueEnd)
+    {
+        int token = next();
+        value = valueEnd = p;
+        if (token == TOKEN_TEXT)
+        {
+            value = text;
+            valueEnd = textEnd;
+            token = next();
+        }
+        return token == TOKEN_CLOSE ? true : fail("expected a value");
+    }
+
+
+    bool XmlPack::Parser::readFloat(float &value)
+    {
+        const char *value0, *valueEnd;
+        if (!readText(value0, valueEnd))
+        {
+            return false;
+        }
+        const char *q = parseFloat(value0, valueEnd, value);
+        return q && skipSpace(q, valueEnd) == valueEnd ? true : fail("expected a number");
+    }
+
+
+    bool XmlPack::Parser::readInt(int64_t &value)
+    {
+        const char *value0, *valueEnd;
+        if (!readText(value0, valueEnd))
+        {
+            return false;
+        }
+        const char *q = parseInt(value0, valueEnd, value);
+        return q && skipSpace(q, valueEnd) == valueEnd ? true : fail("expected an integer");
+    }
+
+
+    bool XmlPack::Parser::skipElement()
+    {
+        int depth = 1;
+        while (depth > 0)
+        {
+            switch (next())
+            {
+                case TOKEN_OPEN:
+                    depth++;
+                    break;
+                case TOKEN_CLOSE:
+                    depth--;
+                    break;
+                case TOKEN_END:
+                case TOKEN_ERROR:
+                    return fail("unterminated element");
+                default:
+                    break;
+            }
+        }
+        return true;
+    }
+
+
+    // flags like <is_dynamic/> can also be written as <is_dynamic></is_dynamic>
+    bool XmlPack::Parser::skipContent(int token)
+    {
+        return token == TOKEN_OPEN ? skipElement() : true;
+    }
+
+
+    bool XmlPack::Parser::run()
+    {
+        for (;;)
+        {
+            int token = next();
+            if (token == TOKEN_OPEN && isName("bodydef"))
+            {
+                break;
+            }
+            if (token == TOKEN_EMPTY && isName("bodydef"))
+            {
+                return fail("missing <metadata>");
+            }
+            if (token != TOKEN_TEXT)
+            {
+                return fail(token == TOKEN_ERROR ? "malformed tag" : "expected <bodydef>");
+            }
+        }
+
+        if (!parseBodyDef())
+        {
+            return false;
+        }
+        if (!hasMetadata)
+        {
+            return fail("missing <metadata>");
+        }
+        finish();
+        return true;
+    }
+
+
+    bool XmlPack::Parser::parseBodyDef()
+    {
+        for (;;)
+        {
+            int token = next();
+            switch (token)
+            {
+                case TOKEN_OPEN:
+                case TOKEN_EMPTY:
+                    if (isName("body"))
+                    {
+                        if (!parseBody(token == TOKEN_EMPTY))
+                        {
+                            return false;
+                        }
+                    }
+                    else if (isName("metadata") && token == TOKEN_OPEN)
+                    {
+                        if (!parseMetadata())
+                        {
+                            return false;
+                        }
+                    }
+                    else if (!skipContent(token))
+                    {
+                        return false;
+                    }
+                    break;
+                case TOKEN_CLOSE:
+                    return true;
+                case TOKEN_TEXT:
+                    break;
+                case TOKEN_END:
+                    return fail("unterminated <bodydef>");
+                default:
+                    return fail("malformed tag");
+            }
+        }
+    }
+
+
+    bool XmlPack::Parser::parseBody(bool empty)
+    {
+        const char *value, *valueEnd;
+        if (!findAttribute("name", value, valueEnd))
+        {
+            return fail("<body> without name");
+        }
+        bodyNames.push_back(std::string());
+        appendDecoded(bodyNames.back(), value, valueEnd);
+
+        Body body = Body();
+        body.flags = BODY_AFFECTED_BY_GRAVITY | BODY_ALLOWS_ROTATION;
+        body.firstFixture = (uint32_t)pack.fixtures.size();
+
+        while (!empty)
+        {
+            int token = next();
+            if (token == TOKEN_CLOSE)
+            {
+                break;
+            }
+            if (token != TOKEN_OPEN && token != TOKEN_EMPTY)
+            {
+                if (token == TOKEN_TEXT)
+                {
+                    continue;
+                }
+                return fail(token == TOKEN_END ? "unterminated <body>" : "malformed tag");
+            }
+
+            bool ok = true;
+            if (isName("fixture") && token == TOKEN_OPEN)
+            {
+                ok = parseFixture();
+            }
+            else if (isName("linear_damping") && token == TOKEN_OPEN)
+            {
+                ok = readFloat(body.linearDamping);
+            }
+            else if (isName("angular_damping") && token == TOKEN_OPEN)
+            {
+                ok = readFloat(body.angularDamping);
+            }
+            else
+            {
+                if (isName("is_dynamic"))
+                {
+                    body.flags |= BODY_DYNAMIC;
+                }
+                else if (isName("fixed_rotation"))
+                {
+                    body.flags &= ~BODY_ALLOWS_ROTATION;
+                }
+                ok = skipContent(token);
+            }
+            if (!ok)
+            {
+                return false;
+            }
+        }
+
+        body.numFixtures = (uint32_t)pack.fixtures.size() - body.firstFixture;
+        pack.bodies.push_back(body);
+        return true;
+    }
+
+
+    bool XmlPack::Parser::parseFixture()
+    {
+        Fixture fixture = Fixture();
+        fixture.fixtureType = FIXTURE_POLYGON;
+        fixture.categoryMask = 1;
+        fixture.collisionMask = 0xffff;
+        fixture.firstPolygon = (uint32_t)pack.polygons.size();
+        bool hasCircle = false;
+        Fixture circle = Fixture();
+
+        for (;;)
+        {
+            int token = next();
+            if (token == TOKEN_CLOSE)
+            {
+                break;
+            }
+            if (token != TOKEN_OPEN && token != TOKEN_EMPTY)
+            {
+                if (token == TOKEN_TEXT)
+                {
+                    continue;
+                }
+                return fail(token == TOKEN_END ? "unterminated <fixture>" : "malformed tag");
+            }
+
+            bool ok = true;
+            int64_t value = 0;
+            if (isName("polygon") && token == TOKEN_OPEN)
+            {
+                ok = parsePolygon();
+            }
+            else if (isName("circle"))
+            {
+                hasCircle = true;
+                ok = parseCircle(circle) && skipContent(token);
+            }
+            else if (isName("density") && token == TOKEN_OPEN)
+            {
+                ok = readFloat(fixture.density);
+            }
+            else if (isName("friction") && token == TOKEN_OPEN)
+            {
+                ok = readFloat(fixture.friction);
+            }
+            else if (isName("restitution") && token == TOKEN_OPEN)
+            {
+                ok = readFloat(fixture.restitution);
+            }
+            else if (isName("filter_category_bits") && token == TOKEN_OPEN)
+            {
+                ok = readInt(value);
+                fixture.categoryMask = (uint32_t)value;
+            }
+            else if (isName("filter_mask_bits") && token == TOKEN_OPEN)
+            {
+                ok = readInt(value);
+                fixture.collisionMask = (uint32_t)value;
+            }
+            else if (isName("filter_group_index") && token == TOKEN_OPEN)
+            {
+                ok = readInt(value);
+                fixture.group = (int32_t)value;
+            }
+            else
+            {
+                if (isName("is_sensor"))
+                {
+                    fixture.isSensor = 1;
+                }
+                ok = skipContent(token);
+            }
+            if (!ok)
+            {
+                return false;
+            }
+        }
+
+        // like gdx-pe-loader, a fixture with a circle and polygons creates both
+        fixture.numPolygons = (uint32_t)pack.polygons.size() - fixture.firstPolygon;
+        if (hasCircle)
+        {
+            Fixture circleFixture = fixture;
+            circleFixture.fixtureType = FIXTURE_CIRCLE;
+            circleFixture.centerX = circle.centerX;
+            circleFixture.centerY = circle.centerY;
+            circleFixture.radius = circle.radius;
+            circleFixture.numPolygons = 0;
+            pack.fixtures.push_back(circleFixture);
+        }
+        if (fixture.numPolygons > 0)
+        {
+            pack.fixtures.push_back(fixture);
+        }
+        return true;
+    }
+
+
+    bool XmlPack::Parser::parseCircle(Fixture &fixture)
+    {
+        const char *names[] = { "x", "y", "r" };
+        float *values[] = { &fixture.centerX, &fixture.centerY, &fixture.radius };
+        for (int i = 0; i < 3; i++)
+        {
+            const char *value, *valueEnd;
+            if (!findAttribute(names[i], value, valueEnd))
+            {
+                return fail("<circle> needs x, y and r");
+            }
+            const char *q = parseFloat(value, valueEnd, *values[i]);
+            if (!q || skipSpace(q, valueEnd) != valueEnd)
+            {
+                return fail("expected a number");
+            }
+        }
+        return true;
+    }
+
+
+    // x, y pairs separated by commas: "1.0000, 6.0000, 19.0000, 6.0000"
+    bool XmlPack::Parser::parsePolygon()
+    {
+        const char *value, *valueEnd;
+        if (!readText(value, valueEnd))
+        {
+            return false;
+        }
+
+        Polygon polygon;
+        polygon.firstVertex = (uint32_t)pack.vertices.size();
+        const char *q = value;
+        for (;;)
+        {
+            Vertex vertex;
+            q = parseFloat(q, valueEnd, vertex.x);
+            q = q ? skipSpace(q, valueEnd) : nullptr;
+            if (!q || q >= valueEnd || *q != ',')
+            {
+                return fail("expected x, y coordinates");
+            }
+            q = parseFloat(q + 1, valueEnd, vertex.y);
+            if (!q)
+            {
+                return fail("expected x, y coordinates");
+            }
+            pack.vertices.push_back(vertex);
+
+            q = skipSpace(q, valueEnd);
+            if (q == valueEnd)
+            {
+                break;
+            }
+            if (*q != ',')
+            {
+                return fail("expected x, y coordinates");
+            }
+            q++;
+        }
+        polygon.numVertices = (uint32_t)pack.vertices.size() - polygon.firstVertex;
+        pack.polygons.push_back(polygon);
+        return true;
+    }
+
+
+    bool XmlPack::Parser::parseMetadata()
+    {
+        int64_t format = 0;
+        for (;;)
+        {
+            int token = next();
+            if (token == TOKEN_CLOSE)
+            {
+                break;
+            }
+            if (token != TOKEN_OPEN && token != TOKEN_EMPTY)
+            {
+                if (token == TOKEN_TEXT)
+                {
+                    continue;
+                }
+                return fail(token == TOKEN_END ? "unterminated <metadata>" : "malformed tag");
+            }
+
+            bool ok = true;
+            if (isName("format") && token == TOKEN_OPEN)
+            {
+                ok = readInt(format);
+            }
+            else if (isName("ptm_ratio") && token == TOKEN_OPEN)
+            {
+                ok = readFloat(ptmRatio);
+            }
+            else
+            {
+                ok = skipContent(token);
+            }
+            if (!ok)
+            {
+                return false;
+            }
+        }
+
+        if (format != 1)
+        {
+            return fail("format not supported");
+        }
+        if (!(ptmRatio > 0))
+        {
+            return fail("invalid ptm_ratio");
+        }
+        hasMetadata = true;
+        return true;
+    }
+
+
+    void XmlPack::Parser::finish()
+    {
+        // metadata is at the end of the file, scale once everything is read
+        float scale = 1.0f / ptmRatio;
+        for (auto &vertex : pack.vertices)
+        {
+            vertex.x *= scale;
+            vertex.y *= scale;
+        }
+        for (auto &fixture : pack.fixtures)
+        {
+            fixture.centerX *= scale;
+            fixture.centerY *= scale;
+            fixture.radius *= scale;
+        }
+
+        // PackView needs names sorted by byte value, a later body replaces
+        // an earlier one with the same name
+        std::vector<uint32_t> order(bodyNames.size());
+        for (uint32_t i = 0; i < order.size(); i++)
+        {
+            order[i] = i;
+        }
+        std::stable_sort(order.begin(), order.end(), [this](uint32_t a, uint32_t b) {
+            return bodyNames[a] < bodyNames[b];
+        });
+
+        std::vector<Body> sorted;
+        sorted.reserve(order.size());
+        for (size_t i = 0; i < order.size(); i++)
+        {
+            if (i + 1 < order.size() && bodyNames[order[i]] == bodyNames[order[i + 1]])
+            {
+                continue;
+            }
+            const std::string &bodyName = bodyNames[order[i]];
+            pack.nameOffsets.push_back((uint32_t)pack.names.size());
+            pack.names.insert(pack.names.end(), bodyName.begin(), bodyName.end());
+            pack.names.push_back(0);
+            sorted.push_back(pack.bodies[order[i]]);
+        }
+        pack.bodies.swap(sorted);
+
+        PackView &view = pack.view;
+        view.numBodies = (uint32_t)pack.bodies.size();
+        view.names = pack.names.empty() ? "" : pack.names.data();
+        view.nameOffsets = pack.nameOffsets.data();
+        view.bodies = pack.bodies.data();
+        view.fixtures = pack.fixtures.data();
+        view.polygons = pack.polygons.data();
+        view.vertices = pack.vertices.data();
+        view.ptmRatio = ptmRatio;
+        view.numHashBuckets = 0; // binary search
+        view.hashDisplacements = nullptr;
+        view.hashSlots = nullptr;
+    }
+
+
+    XmlPack::XmlPack()
+    : view()
+    {
+    }
+
+
+    bool XmlPack::parse(const char *data, size_t size)
+    {
+        names.clear();
+        nameOffsets.clear();
+        bodies.clear();
+        fixtures.clear();
+        polygons.clear();
+        vertices.clear();
+        view = PackView();
+        error.clear();
+
+        Parser parser(*this, data, size);
+        if (!parser.run())
+        {
+            view = PackView();
+            return false;
+        }
+        return true;
+    }
+}
@@ -0,0 +1,111 @@
+//
+//  PhysicsShapeXml.h
+//
+//  Reads PhysicsEditor XML exports (<bodydef>) into shape pack records.
+//  Same format as read by gdx-pe-loader.
+//
+//  Loads physics sprites created with https://www.codeandweb.com/physicseditor
+//
+//  Copyright (c) 2026 CodeAndWeb GmbH. All rights reserved.
+//  https://www.codeandweb.com
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+
+#ifndef __PhysicsShapeXml_h__
+#define __PhysicsShapeXml_h__
+
+#include "PhysicsShapePack.h"
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+
+namespace PhysicsShapePack
+{
+    /**
+     * Parses one number of a coordinate list like "1.0000, 6.0000".
+     * Plain decimals are accumulated as integers and scaled once, without
+     * strtod, locales or a NUL terminated copy.
+     *
+     * @param p first character, leading white space is skipped
+     * @param end end of the text
+     * @param value receives the number
+     *
+     * @return pointer behind the number
+     * @retval nullptr if there is no number at p
+     */
+    const char *parseFloat(const char *p, const char *end, float &value);
+
+
+    /**
+     * Shape records read from a PhysicsEditor XML export: <bodydef> with
+     * <body>, <fixture>, <polygon> and <circle> elements, as written by the
+     * LibGDX exporter. Coordinates are divided by the ptm_ratio in
+     * <metadata>, like packs generated from Box2D plists, so the view can
+     * be passed to the Box2D caches' addShapesWithPack().
+     *
+     * The format has no anchor points, they are (0, 0).
+     */
+    class XmlPack
+    {
+    public:
+        XmlPack();
+
+        /**
+         * Parses an XML export. The tokenizer reads the buffer in place,
+         * only body names are copied. The buffer is not needed afterwards.
+         *
+         * @param data file contents, need not be NUL terminated
+         * @param size size of data in bytes
+         *
+         * @retval true if ok
+         * @retval false if the data is not a valid bodydef file, see getError()
+         */
+        bool parse(const char *data, size_t size);
+
+        /**
+         * Records of the parsed bodies, valid while this object exists
+         */
+        const PackView &getView() const { return view; }
+
+        /**
+         * Reason and line of the last parse error
+         */
+        const std::string &getError() const { return error; }
+
+    private:
+        class Parser;
+
+        XmlPack(const XmlPack &);
+        XmlPack &operator=(const XmlPack &);
+
+        std::vector<char> names;
+        std::vector<uint32_t> nameOffsets;
+        std::vector<Body> bodies;
+        std::vector<Fixture> fixtures;
+        std::vector<Polygon> polygons;
+        std::vector<Vertex> vertices;
+
+        PackView view;
+        std::string error;
+    };
+}
+
+#endif // __PhysicsShapeXml_h__
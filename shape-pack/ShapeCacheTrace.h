@@ -0,0 +1,245 @@
+//
+//  ShapeCacheTrace.h
+//
+//  Trace spans of the PhysicsEditor loaders, written as Chrome trace-event
+//  JSON for chrome://tracing and Perfetto.
+//
+//  Loads physics sprites created with https://www.codeandweb.com/physicseditor
+//
+//  Copyright (c) 2026 CodeAndWeb GmbH. All rights reserved.
+//  https://www.codeandweb.com
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+
+#ifndef __ShapeCacheTrace_h__
+#define __ShapeCacheTrace_h__
+
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+namespace ShapeCacheTrace
+{
+    typedef std::chrono::steady_clock Clock;
+
+
+    /**
+     * A finished span. The subject is copied into a fixed buffer so that
+     * recording never allocates.
+     */
+    struct Span
+    {
+        const char *name;      ///< string literal
+        char subject[48];      ///< body or file name, truncated
+        double startMicros;    ///< since the recorder was created
+        double durationMicros;
+        unsigned int thread;
+        int fixtures;          ///< -1 if not applicable
+        int vertices;          ///< -1 if not applicable
+    };
+
+
+    /**
+     * Keeps the most recent spans in a ring buffer. Nothing is recorded
+     * until the recorder is enabled, a disabled span costs one branch.
+     * Not thread safe, like the caches using it.
+     */
+    class Recorder
+    {
+    public:
+        explicit Recorder(const char *category, size_t capacity = 4096)
+        : category(category)
+        , spans(capacity)
+        , next(0)
+        , count(0)
+        , enabled(false)
+        , epoch(Clock::now())
+        {
+        }
+
+        void setEnabled(bool value) { enabled = value; }
+        bool isEnabled() const { return enabled; }
+
+        /**
+         * Resizes the ring buffer, recorded spans are dropped
+         */
+        void setCapacity(size_t capacity)
+        {
+            spans.assign(capacity, Span());
+            clear();
+        }
+
+        void clear()
+        {
+            next = 0;
+            count = 0;
+        }
+
+        size_t size() const { return count; }
+
+        /**
+         * Start time for record(), only reads the clock when enabled
+         */
+        Clock::time_point now() const
+        {
+            return enabled ? Clock::now() : Clock::time_point();
+        }
+
+        void record(const char *name, const std::string &subject, Clock::time_point start, int fixtures = -1, int vertices = -1)
+        {
+            record(name, subject.c_str(), start, fixtures, vertices);
+        }
+
+        void record(const char *name, const char *subject, Clock::time_point start, int fixtures = -1, int vertices = -1)
+        {
+            // start is unset if the recorder was enabled during the span
+            if (!enabled || spans.empty() || start == Clock::time_point())
+            {
+                return;
+            }
+            Clock::time_point end = Clock::now();
+            Span &span = spans[next];
+            span.name = name;
+            snprintf(span.subject, sizeof(span.subject), "%s", subject);
+            span.startMicros = std::chrono::duration<double, std::micro>(start - epoch).count();
+            span.durationMicros = std::chrono::duration<double, std::micro>(end - start).count();
+            span.thread = (unsigned int)std::hash<std::thread::id>()(std::this_thread::get_id());
+            span.fixtures = fixtures;
+            span.vertices = vertices;
+
+            next = (next + 1) % spans.size();
+            if (count < spans.size())
+            {
+                count++;
+            }
+        }
+
+        /**
+         * Returns the recorded spans, oldest first, as Chrome trace-event
+         * JSON: complete ("X") events with the subject, fixture and vertex
+         * counts as arguments.
+         */
+        std::string toJson() const
+        {
+            std::string json = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+            char buffer[256];
+            size_t first = (next + spans.size() - count) % (spans.empty() ? 1 : spans.size());
+            for (size_t i = 0; i < count; i++)
+            {
+                const Span &span = spans[(first + i) % spans.size()];
+                snprintf(buffer, sizeof(buffer), "%s{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%u,\"args\":{\"subject\":\"",
+                         i > 0 ? "," : "", span.name, category, span.startMicros, span.durationMicros, span.thread);
+                json += buffer;
+                appendEscaped(json, span.subject);
+                json += "\"";
+                if (span.fixtures >= 0)
+                {
+                    snprintf(buffer, sizeof(buffer), ",\"fixtures\":%d,\"vertices\":%d", span.fixtures, span.vertices);
+                    json += buffer;
+                }
+                json += "}}";
+            }
+            json += "]}";
+            return json;
+        }
+
+    private:
+        static void appendEscaped(std::string &json, const char *text)
+        {
+            for (; *text; text++)
+            {
+                unsigned char c = (unsigned char)*text;
+                if (c == '"' || c == '\\')
+                {
+                    json += '\\';
+                    json += (char)c;
+                }
+                else if (c < 0x20)
+                {
+                    char escape[8];
+                    snprintf(escape, sizeof(escape), "\\u%04x", c);
+                    json += escape;
+                }
+                else
+                {
+                    json += (char)c;
+                }
+            }
+        }
+
+        const char *category;
+        std::vector<Span> spans;
+        size_t next;
+        size_t count;
+        bool enabled;
+        Clock::time_point epoch;
+    };
+
+
+    /**
+     * Records a span from construction to the end of the enclosing block
+     */
+    class Scope
+    {
+    public:
+        Scope(Recorder &recorder, const char *name, const std::string &subject)
+        : recorder(recorder)
+        , name(name)
+        , start(recorder.now())
+        , fixtures(-1)
+        , vertices(-1)
+        {
+            // only copied if the span is recorded, the caller's string can be a temporary
+            this->subject[0] = 0;
+            if (start != Clock::time_point())
+            {
+                snprintf(this->subject, sizeof(this->subject), "%s", subject.c_str());
+            }
+        }
+
+        ~Scope()
+        {
+            recorder.record(name, subject, start, fixtures, vertices);
+        }
+
+        void setCounts(int numFixtures, int numVertices)
+        {
+            fixtures = numFixtures;
+            vertices = numVertices;
+        }
+
+    private:
+        Scope(const Scope &);
+        Scope &operator=(const Scope &);
+
+        Recorder &recorder;
+        const char *name;
+        char subject[sizeof(Span::subject)];
+        Clock::time_point start;
+        int fixtures;
+        int vertices;
+    };
+}
+
+#endif // __ShapeCacheTrace_h__
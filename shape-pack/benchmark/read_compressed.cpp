@@ -0,0 +1,220 @@
+//
+//  read_compressed.cpp
+//
+//  Time to load a shape file, plain and compressed with
+//  pe_shape_pack.py compress, with a cold and a warm page cache.
+//  Cold runs drop the files from the page cache with posix_fadvise()
+//  first, Linux only. Use a file system on the storage to measure,
+//  not tmpfs.
+//
+//  Storage slower than the disk at hand, e.g. eMMC or an SD card, is
+//  simulated by passing its read rate in MB/s: every read then waits
+//  until the bytes read so far would have arrived at that rate.
+//
+//    ../pe_shape_pack.py compress shapes.plist -o shapes.pscz
+//
+//  Build:
+//    c++ -O2 -std=c++11 -pthread -I.. read_compressed.cpp ../PhysicsShapeInflate.cpp -lz -o read_compressed
+//
+//  Run:
+//    ./read_compressed shapes.plist shapes.pscz [MB/s]
+//
+
+#include "PhysicsShapeInflate.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fcntl.h>
+#include <thread>
+#include <unistd.h>
+
+static const int NUM_RUNS = 5;
+static const size_t CHUNK_SIZE = 64 * 1024;
+
+// simulated read rate in bytes per second, 0 reads at the disk's rate
+static double readRate = 0;
+
+
+struct ThrottledFile
+{
+    FILE *file;
+    size_t bytesRead;
+    std::chrono::steady_clock::time_point start;
+};
+
+
+static bool openThrottled(ThrottledFile &throttled, const char *path)
+{
+    throttled.file = fopen(path, "rb");
+    throttled.bytesRead = 0;
+    throttled.start = std::chrono::steady_clock::now();
+    return throttled.file != nullptr;
+}
+
+
+static size_t readThrottled(void *source, void *buffer, size_t size)
+{
+    ThrottledFile *throttled = (ThrottledFile *)source;
+    size_t count = fread(buffer, 1, size, throttled->file);
+    throttled->bytesRead += count;
+    if (readRate > 0)
+    {
+        std::this_thread::sleep_until(throttled->start
+            + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                std::chrono::duration<double>(throttled->bytesRead / readRate)));
+    }
+    return count;
+}
+
+
+static bool readAll(ThrottledFile &throttled, unsigned char *bytes, size_t size)
+{
+    for (size_t offset = 0; offset < size; )
+    {
+        size_t count = readThrottled(&throttled, bytes + offset, std::min(CHUNK_SIZE, size - offset));
+        if (count == 0)
+        {
+            return false;
+        }
+        offset += count;
+    }
+    return true;
+}
+
+
+static size_t fileSize(FILE *file)
+{
+    fseek(file, 0, SEEK_END);
+    size_t size = (size_t)ftell(file);
+    fseek(file, 0, SEEK_SET);
+    return size;
+}
+
+
+static void dropFromPageCache(const char *path)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd >= 0)
+    {
+        fdatasync(fd);
+        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        close(fd);
+    }
+}
+
+
+static bool readPlain(const char *path, size_t &size)
+{
+    ThrottledFile throttled;
+    if (!openThrottled(throttled, path))
+    {
+        return false;
+    }
+    size = fileSize(throttled.file);
+    unsigned char *bytes = (unsigned char *)malloc(std::max<size_t>(size, 1));
+    bool ok = bytes && readAll(throttled, bytes, size);
+    fclose(throttled.file);
+    free(bytes);
+    return ok;
+}
+
+
+// reads the whole compressed file before inflating it
+static bool readThenInflate(const char *path, size_t &size)
+{
+    ThrottledFile throttled;
+    if (!openThrottled(throttled, path))
+    {
+        return false;
+    }
+    size_t compressedSize = fileSize(throttled.file);
+    unsigned char *compressed = (unsigned char *)malloc(std::max<size_t>(compressedSize, 1));
+    bool ok = compressed && readAll(throttled, compressed, compressedSize)
+        && PhysicsShapePack::readCompressedHeader(compressed, compressedSize, size);
+    fclose(throttled.file);
+    if (ok)
+    {
+        unsigned char *bytes = (unsigned char *)malloc(std::max<size_t>(size, 1));
+        ok = bytes && PhysicsShapePack::inflateCompressed(compressed, compressedSize, bytes, size);
+        free(bytes);
+    }
+    free(compressed);
+    return ok;
+}
+
+
+// what the loaders do, inflating while the next chunks are read
+static bool readStreaming(const char *path, size_t &size)
+{
+    ThrottledFile throttled;
+    if (!openThrottled(throttled, path))
+    {
+        return false;
+    }
+    PhysicsShapePack::CompressedFileReader reader;
+    if (!reader.open(&throttled, readThrottled))
+    {
+        fclose(throttled.file);
+        return false;
+    }
+    size = reader.getContentSize();
+    unsigned char *bytes = (unsigned char *)malloc(std::max<size_t>(size, 1));
+    bool ok = bytes && reader.read(bytes);
+    fclose(throttled.file);
+    free(bytes);
+    return ok;
+}
+
+
+static void measure(const char *label, bool (*read)(const char *, size_t &), const char *path, bool cold)
+{
+    double best = 1e30;
+    double total = 0;
+    size_t size = 0;
+    for (int run = 0; run < NUM_RUNS; run++)
+    {
+        if (cold)
+        {
+            dropFromPageCache(path);
+        }
+        else if (run == 0)
+        {
+            read(path, size);
+        }
+        auto start = std::chrono::steady_clock::now();
+        if (!read(path, size))
+        {
+            printf("%-18s can't read %s\n", label, path);
+            return;
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        best = std::min(best, seconds);
+        total += seconds;
+    }
+    printf("%-18s %-5s %8zu bytes: best %8.2f ms, mean %8.2f ms\n",
+           label, cold ? "cold" : "warm", size, best * 1e3, total * 1e3 / NUM_RUNS);
+}
+
+
+int main(int argc, char **argv)
+{
+    if (argc != 3 && argc != 4)
+    {
+        printf("usage: %s shapes.plist shapes.pscz [MB/s]\n", argv[0]);
+        return 1;
+    }
+    if (argc == 4)
+    {
+        readRate = atof(argv[3]) * 1e6;
+        printf("simulated read rate %.0f MB/s\n", readRate / 1e6);
+    }
+
+    for (int cold = 1; cold >= 0; cold--)
+    {
+        measure("plain", readPlain, argv[1], cold != 0);
+        measure("read, inflate", readThenInflate, argv[2], cold != 0);
+        measure("streaming inflate", readStreaming, argv[2], cold != 0);
+    }
+    return 0;
+}
@@ -0,0 +1,501 @@
+//
+//  check_shape_pack.cpp
+//
+//  Checks the shape pack readers without an engine:
+//  - XmlPack on a PhysicsEditor XML export
+//  - parseFloat() against strtof()
+//  - findBody() on a generated pack, with and without a name index
+//  - .pscz files written like pe_shape_pack.py compress, whole and
+//    truncated, read with CompressedFileReader
+//
+//  Build:
+//    c++ -O2 -std=c++11 -Wall -Wextra -Wpedantic -pthread -I.. check_shape_pack.cpp ../PhysicsShapeXml.cpp ../PhysicsShapeInflate.cpp -lz -o check_shape_pack
+//
+//  Run:
+//    ./check_shape_pack [bugs.xml]
+//
+//  The XML file defaults to gdx-pe-loader's test resource. A temporary
+//  .pscz file is written to the current directory. Prints the failed
+//  checks and exits with 1 if any failed.
+//
+
+#include "PhysicsShapeInflate.h"
+#include "PhysicsShapeXml.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+#include <zlib.h>
+
+using namespace PhysicsShapePack;
+
+static const char *DEFAULT_XML_PATH = "../../gdx-pe-loader/src/test/resources/bugs.xml";
+static const char *PSCZ_PATH = "check_shape_pack.pscz";
+static const int NUM_GENERATED_BODIES = 5000;
+static const int NUM_RANDOM_FLOATS = 100000;
+
+static int numChecks = 0;
+static int numFailed = 0;
+
+#define CHECK(condition) check((condition), #condition, __LINE__)
+
+
+static void check(bool ok, const char *condition, int line)
+{
+    numChecks++;
+    if (!ok)
+    {
+        numFailed++;
+        printf("FAIL line %d: %s\n", line, condition);
+    }
+}
+
+
+static bool readFile(const char *path, std::vector<char> &data)
+{
+    FILE *file = fopen(path, "rb");
+    if (!file)
+    {
+        return false;
+    }
+    char buffer[64 * 1024];
+    size_t count;
+    while ((count = fread(buffer, 1, sizeof(buffer), file)) > 0)
+    {
+        data.insert(data.end(), buffer, buffer + count);
+    }
+    fclose(file);
+    return true;
+}
+
+
+static bool writeFile(const char *path, const std::vector<unsigned char> &data)
+{
+    FILE *file = fopen(path, "wb");
+    if (!file)
+    {
+        return false;
+    }
+    bool ok = data.empty() || fwrite(data.data(), 1, data.size(), file) == data.size();
+    return fclose(file) == 0 && ok;
+}
+
+
+static const char *bodyName(const PackView &pack, int body)
+{
+    return pack.names + pack.nameOffsets[body];
+}
+
+
+static void checkXml(const char *path)
+{
+    std::vector<char> data;
+    if (!readFile(path, data))
+    {
+        printf("FAIL can't read %s\n", path);
+        numFailed++;
+        return;
+    }
+
+    XmlPack xml;
+    CHECK(xml.parse(data.data(), data.size()));
+    const PackView &pack = xml.getView();
+    CHECK(pack.numBodies == 4);
+    CHECK(pack.numHashBuckets == 0);
+    CHECK(pack.ptmRatio == 32.0f);
+
+    const char *names[] = { "bug_0001", "bug_0002", "bug_0003", "bug_0004" };
+    const uint32_t numPolygons[] = { 3, 6, 0, 4 };
+    for (int i = 0; i < 4; i++)
+    {
+        int body = findBody(pack, names[i]);
+        CHECK(body >= 0 && strcmp(bodyName(pack, body), names[i]) == 0);
+        if (body < 0)
+        {
+            continue;
+        }
+        uint32_t polygons = 0;
+        const Body &b = pack.bodies[body];
+        for (uint32_t f = b.firstFixture; f < b.firstFixture + b.numFixtures; f++)
+        {
+            polygons += pack.fixtures[f].numPolygons;
+        }
+        CHECK(polygons == numPolygons[i]);
+    }
+    CHECK(findBody(pack, "bug_0000") == -1);
+    CHECK(findBody(pack, "bug_0005") == -1);
+    CHECK(findBody(pack, "") == -1);
+
+    // first polygon of bug_0001: 1.0000, 6.0000, 19.0000, 6.0000, ...
+    int body = findBody(pack, "bug_0001");
+    if (body >= 0)
+    {
+        const Fixture &fixture = pack.fixtures[pack.bodies[body].firstFixture];
+        CHECK(fixture.numPolygons == 1);
+        const Polygon &polygon = pack.polygons[fixture.firstPolygon];
+        CHECK(polygon.numVertices == 4);
+        const Vertex &vertex = pack.vertices[polygon.firstVertex + 1];
+        CHECK(vertex.x == 19.0f / 32.0f && vertex.y == 6.0f / 32.0f);
+    }
+
+    // the buffer is not needed after parsing
+    std::fill(data.begin(), data.end(), 0);
+    CHECK(findBody(pack, "bug_0004") >= 0);
+
+    const char broken[] = "<bodydef><bodies><body name=\"a\">";
+    XmlPack brokenXml;
+    CHECK(!brokenXml.parse(broken, sizeof(broken) - 1));
+    CHECK(!brokenXml.getError().empty());
+}
+
+
+static bool parsesLikeStrtof(const char *text, float maxUlps)
+{
+    float value = 0;
+    const char *end = text + strlen(text);
+    const char *next = parseFloat(text, end, value);
+    char *expectedNext = nullptr;
+    float expected = strtof(text, &expectedNext);
+    if (next != expectedNext)
+    {
+        return false;
+    }
+    if (value == expected)
+    {
+        return true;
+    }
+    float ulp = std::nextafter(std::fabs(expected), INFINITY) - std::fabs(expected);
+    return std::fabs(value - expected) <= maxUlps * ulp;
+}
+
+
+static void checkParseFloat()
+{
+    const char *exact[] = {
+        "0", "1", "-1", "+1", "1.0000", "19.0000", "9.4203", "-0.5", ".5", "5.",
+        "  7.25", "\t\n3", "1e3", "1.5E-2", "-2.5e+1", "65535.9999", "0.0001",
+    };
+    for (size_t i = 0; i < sizeof(exact) / sizeof(exact[0]); i++)
+    {
+        if (!parsesLikeStrtof(exact[i], 0))
+        {
+            printf("FAIL parseFloat(\"%s\")\n", exact[i]);
+            numFailed++;
+        }
+        numChecks++;
+    }
+
+    float value = 0;
+    const char list[] = "1.0000, 6.0000,19.5";
+    const char *end = list + sizeof(list) - 1;
+    const char *p = parseFloat(list, end, value);
+    CHECK(p && value == 1.0f && *p == ',');
+    p = parseFloat(p + 1, end, value);
+    CHECK(p && value == 6.0f && *p == ',');
+    p = parseFloat(p + 1, end, value);
+    CHECK(p == end && value == 19.5f);
+
+    const char *invalid[] = { "", " ", ",", "-", "x1", "e5", "." };
+    for (size_t i = 0; i < sizeof(invalid) / sizeof(invalid[0]); i++)
+    {
+        CHECK(parseFloat(invalid[i], invalid[i] + strlen(invalid[i]), value) == nullptr);
+    }
+
+    // stops at end, the text need not be NUL terminated
+    const char digits[] = "12345";
+    CHECK(parseFloat(digits, digits + 2, value) == digits + 2 && value == 12.0f);
+
+    // PhysicsEditor writes 4 decimals, those must match strtof exactly,
+    // longer numbers may be off by the last bit
+    std::mt19937 random(42);
+    std::uniform_real_distribution<double> coordinates(-4096.0, 4096.0);
+    std::uniform_real_distribution<double> exponents(-20.0, 20.0);
+    char text[64];
+    int numWrong = 0;
+    for (int i = 0; i < NUM_RANDOM_FLOATS; i++)
+    {
+        snprintf(text, sizeof(text), "%.4f", coordinates(random));
+        if (!parsesLikeStrtof(text, 0))
+        {
+            if (numWrong++ < 10)
+            {
+                printf("FAIL parseFloat(\"%s\") differs from strtof\n", text);
+            }
+        }
+        snprintf(text, sizeof(text), "%.9g", coordinates(random) * std::pow(10.0, exponents(random)));
+        if (!parsesLikeStrtof(text, 1))
+        {
+            if (numWrong++ < 10)
+            {
+                printf("FAIL parseFloat(\"%s\") more than 1 ulp from strtof\n", text);
+            }
+        }
+    }
+    numChecks += 2 * NUM_RANDOM_FLOATS;
+    numFailed += numWrong;
+}
+
+
+// name index built like build_name_index() in pe_shape_pack.py
+static bool buildNameIndex(const PackView &pack, std::vector<uint32_t> &displacements, std::vector<uint32_t> &slots)
+{
+    uint32_t count = pack.numBodies;
+    uint32_t numBuckets = std::max<uint32_t>(1, (count + 2) / 3);
+    std::vector<std::vector<uint32_t> > buckets(numBuckets);
+    for (uint32_t body = 0; body < count; body++)
+    {
+        buckets[(uint32_t)(hashName(bodyName(pack, body)) >> 32) % numBuckets].push_back(body);
+    }
+    std::vector<uint32_t> order(numBuckets);
+    for (uint32_t i = 0; i < numBuckets; i++)
+    {
+        order[i] = i;
+    }
+    std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+        return buckets[a].size() > buckets[b].size();
+    });
+
+    displacements.assign(numBuckets, 0);
+    slots.assign(count, 0);
+    std::vector<bool> taken(count, false);
+    std::vector<uint32_t> placed;
+    for (uint32_t bucket : order)
+    {
+        if (buckets[bucket].empty())
+        {
+            break;
+        }
+        for (uint32_t d = 0; ; d++)
+        {
+            if (d == 0xffffffffu)
+            {
+                return false;
+            }
+            placed.clear();
+            for (uint32_t body : buckets[bucket])
+            {
+                uint32_t slot = mixHash((uint32_t)hashName(bodyName(pack, body)) ^ d) % count;
+                if (taken[slot] || std::find(placed.begin(), placed.end(), slot) != placed.end())
+                {
+                    break;
+                }
+                placed.push_back(slot);
+            }
+            if (placed.size() == buckets[bucket].size())
+            {
+                displacements[bucket] = d;
+                for (size_t i = 0; i < placed.size(); i++)
+                {
+                    taken[placed[i]] = true;
+                    slots[placed[i]] = buckets[bucket][i];
+                }
+                break;
+            }
+        }
+    }
+    return true;
+}
+
+
+static void checkFindBody()
+{
+    std::vector<std::string> names;
+    char name[32];
+    for (int i = 0; i < NUM_GENERATED_BODIES; i++)
+    {
+        snprintf(name, sizeof(name), "body_%d", i * 7919 % 100003);
+        names.push_back(name);
+    }
+    names.push_back("a");
+    names.push_back("A");
+    names.push_back("body");
+    names.push_back("body_");
+    names.push_back("\xc3\xa4pfel");
+    std::sort(names.begin(), names.end());
+
+    std::string nameData;
+    std::vector<uint32_t> nameOffsets;
+    for (size_t i = 0; i < names.size(); i++)
+    {
+        nameOffsets.push_back((uint32_t)nameData.size());
+        nameData += names[i];
+        nameData += '\0';
+    }
+
+    PackView pack;
+    memset(&pack, 0, sizeof(pack));
+    pack.numBodies = (uint32_t)names.size();
+    pack.names = nameData.c_str();
+    pack.nameOffsets = nameOffsets.data();
+
+    std::vector<uint32_t> displacements;
+    std::vector<uint32_t> slots;
+    CHECK(buildNameIndex(pack, displacements, slots));
+    PackView hashed = pack;
+    hashed.numHashBuckets = (uint32_t)displacements.size();
+    hashed.hashDisplacements = displacements.data();
+    hashed.hashSlots = slots.data();
+
+    const char *missing[] = { "", "b", "body_-1", "body_100003", "body_0 ", "Body_0", "\xc3\xa4" };
+    const PackView *views[] = { &pack, &hashed };
+    for (int v = 0; v < 2; v++)
+    {
+        const PackView &view = *views[v];
+        int numWrong = 0;
+        for (size_t i = 0; i < names.size(); i++)
+        {
+            if (findBody(view, names[i].c_str()) != (int)i && numWrong++ < 10)
+            {
+                printf("FAIL findBody(\"%s\") %s\n", names[i].c_str(), v ? "hashed" : "sorted");
+            }
+        }
+        numChecks += (int)names.size();
+        numFailed += numWrong;
+        for (size_t i = 0; i < sizeof(missing) / sizeof(missing[0]); i++)
+        {
+            CHECK(findBody(view, missing[i]) == -1);
+        }
+    }
+}
+
+
+// header and zlib stream as written by pe_shape_pack.py compress
+static std::vector<unsigned char> compress(const std::vector<char> &content)
+{
+    uLongf compressedSize = compressBound((uLong)content.size());
+    std::vector<unsigned char> file(COMPRESSED_HEADER_SIZE + compressedSize);
+    if (compress2(&file[COMPRESSED_HEADER_SIZE], &compressedSize,
+                  (const Bytef *)content.data(), (uLong)content.size(), 9) != Z_OK)
+    {
+        return std::vector<unsigned char>();
+    }
+    file.resize(COMPRESSED_HEADER_SIZE + compressedSize);
+    memcpy(&file[0], "PSCZLIB1", 8);
+    uint32_t sizes[2] = { (uint32_t)content.size(), (uint32_t)compressedSize };
+    for (int i = 0; i < 8; i++)
+    {
+        file[8 + i] = (unsigned char)(sizes[i / 4] >> (8 * (i % 4)));
+    }
+    return file;
+}
+
+
+struct MemorySource
+{
+    const unsigned char *data;
+    size_t size;
+    size_t offset;
+};
+
+
+// reads odd sized pieces, like AAsset_read() may
+static size_t readFromMemory(void *source, void *buffer, size_t size)
+{
+    MemorySource *memory = (MemorySource *)source;
+    size_t count = std::min(std::min(size, (size_t)4093), memory->size - memory->offset);
+    if (count > 0)
+    {
+        memcpy(buffer, memory->data + memory->offset, count);
+        memory->offset += count;
+    }
+    return count;
+}
+
+
+static bool readCompressedPath(const char *path, std::vector<char> &content)
+{
+    CompressedFileReader reader;
+    if (!reader.open(path))
+    {
+        return false;
+    }
+    content.resize(reader.getContentSize());
+    return reader.read(content.data());
+}
+
+
+static bool readCompressedMemory(const std::vector<unsigned char> &file, std::vector<char> &content)
+{
+    MemorySource memory = { file.data(), file.size(), 0 };
+    CompressedFileReader reader;
+    if (!reader.open(&memory, readFromMemory))
+    {
+        return false;
+    }
+    content.resize(reader.getContentSize());
+    return reader.read(content.data());
+}
+
+
+static void checkCompressed(const char *xmlPath)
+{
+    // several chunks of content, so the reader thread takes turns
+    std::vector<char> xml;
+    readFile(xmlPath, xml);
+    std::vector<char> content;
+    char line[32];
+    for (int copy = 0; content.size() < 3 * CompressedFileReader::CHUNK_SIZE * CompressedFileReader::NUM_CHUNKS; copy++)
+    {
+        snprintf(line, sizeof(line), "<!-- %d -->\n", copy);
+        content.insert(content.end(), line, line + strlen(line));
+        content.insert(content.end(), xml.begin(), xml.end());
+    }
+    std::vector<unsigned char> file = compress(content);
+    CHECK(file.size() > COMPRESSED_HEADER_SIZE);
+
+    size_t contentSize = 0;
+    CHECK(readCompressedHeader(file.data(), file.size(), contentSize) && contentSize == content.size());
+    std::vector<char> inflated(contentSize);
+    CHECK(inflateCompressed(file.data(), file.size(), inflated.data(), inflated.size()) && inflated == content);
+
+    std::vector<char> read;
+    CHECK(writeFile(PSCZ_PATH, file));
+    CHECK(readCompressedPath(PSCZ_PATH, read) && read == content);
+    read.clear();
+    CHECK(readCompressedMemory(file, read) && read == content);
+
+    // cut off in the stream, in the header and right after it
+    const size_t cuts[] = { file.size() - 1, file.size() / 2, COMPRESSED_HEADER_SIZE, COMPRESSED_HEADER_SIZE - 1, 8, 0 };
+    for (size_t i = 0; i < sizeof(cuts) / sizeof(cuts[0]); i++)
+    {
+        std::vector<unsigned char> truncated(file.begin(), file.begin() + cuts[i]);
+        CHECK(writeFile(PSCZ_PATH, truncated));
+        CHECK(!readCompressedPath(PSCZ_PATH, read));
+        CHECK(!readCompressedMemory(truncated, read));
+        CHECK(!inflateCompressed(truncated.data(), truncated.size(), inflated.data(), inflated.size()));
+    }
+
+    std::vector<unsigned char> corrupt = file;
+    corrupt[COMPRESSED_HEADER_SIZE + corrupt.size() / 2] ^= 0x55;
+    CHECK(!readCompressedMemory(corrupt, read));
+
+    std::vector<unsigned char> plain(content.begin(), content.end());
+    CHECK(!readCompressedHeader(plain.data(), plain.size(), contentSize));
+    CHECK(!readCompressedMemory(plain, read));
+
+    remove(PSCZ_PATH);
+    CHECK(!readCompressedPath(PSCZ_PATH, read));
+}
+
+
+int main(int argc, char *argv[])
+{
+    const char *xmlPath = argc > 1 ? argv[1] : DEFAULT_XML_PATH;
+
+    checkXml(xmlPath);
+    checkParseFloat();
+    checkFindBody();
+    checkCompressed(xmlPath);
+
+    if (numFailed > 0)
+    {
+        printf("%d of %d checks failed\n", numFailed, numChecks);
+        return 1;
+    }
+    printf("OK, %d checks\n", numChecks);
+    return 0;
+}
@@ -0,0 +1,446 @@
+#!/usr/bin/env python3
+#
+#  pe_shape_pack.py
+#
+#  Converts a plist written by PhysicsEditor into shape records that are
+#  compiled into the application (see PhysicsShapePack.h), combines
+#  several plists into a bundle loaded with a single file access, or
+#  compresses a plist or bundle (see PhysicsShapeInflate.h).
+#
+#  Supported exporters: cocos2d-x and Box2D generic (PLIST).
+#
+#  Usage:
+#    pe_shape_pack.py header shapes.plist -o shapes_pack.h --name shapes [--scale 2]
+#    pe_shape_pack.py bundle level1.plist enemies.plist -o level1.pscb
+#    pe_shape_pack.py compress level1.pscb -o level1.pscz
+#
+#  Copyright (c) 2026 CodeAndWeb GmbH. All rights reserved.
+#  https://www.codeandweb.com
+#
+#  Permission is hereby granted, free of charge, to any person obtaining a copy
+#  of this software and associated documentation files (the "Software"), to deal
+#  in the Software without restriction, including without limitation the rights
+#  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+#  copies of the Software, and to permit persons to whom the Software is
+#  furnished to do so, subject to the following conditions:
+#
+#  The above copyright notice and this permission notice shall be included in
+#  all copies or substantial portions of the Software.
+#
+#  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+#  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+#  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+#  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+#  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+#  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+#  THE SOFTWARE.
+#
+
+import argparse
+import os
+import plistlib
+import re
+import struct
+import sys
+import zlib
+
+FIXTURE_POLYGON = 0
+FIXTURE_CIRCLE = 1
+
+BODY_DYNAMIC = 1
+BODY_AFFECTED_BY_GRAVITY = 2
+BODY_ALLOWS_ROTATION = 4
+
+POINT_RE = re.compile(r'\{\s*([^,\s]+)\s*,\s*([^}\s]+)\s*\}')
+
+
+def f32(value):
+    """Rounds to the float the C++ loaders would have parsed."""
+    return struct.unpack('<f', struct.pack('<f', float(value)))[0]
+
+
+def parse_point(text):
+    match = POINT_RE.match(text)
+    if not match:
+        raise ValueError('invalid point: %r' % text)
+    return float(match.group(1)), float(match.group(2))
+
+
+class Pack:
+    """Flattened bodies of one plist, sorted by name."""
+
+    def __init__(self):
+        self.names = []
+        self.bodies = []
+        self.fixtures = []
+        self.polygons = []
+        self.vertices = []
+        self.ptm_ratio = 0.0
+
+    def add_polygon(self, points, divisor):
+        self.polygons.append((len(self.vertices), len(points)))
+        for text in points:
+            x, y = parse_point(text)
+            self.vertices.append((f32(x / divisor), f32(y / divisor)))
+
+
+FNV_OFFSET = 14695981039346656037
+FNV_PRIME = 1099511628211
+MASK32 = 0xffffffff
+MASK64 = 0xffffffffffffffff
+
+
+def hash_name(data):
+    """64 bit FNV-1a, PhysicsShapePack::hashName()"""
+    h = FNV_OFFSET
+    for byte in data:
+        h = ((h ^ byte) * FNV_PRIME) & MASK64
+    return h
+
+
+def mix_hash(x):
+    """MurmurHash3 finalizer, PhysicsShapePack::mixHash()"""
+    x ^= x >> 16
+    x = (x * 0x85ebca6b) & MASK32
+    x ^= x >> 13
+    x = (x * 0xc2b2ae35) & MASK32
+    x ^= x >> 16
+    return x
+
+
+def build_name_index(names):
+    """Minimal perfect hash (hash and displace) over the encoded names.
+
+    Each name falls into bucket hi32(hash) % numBuckets. The buckets are
+    placed largest first, each with the smallest displacement d for which
+    mix_hash(lo32(hash) ^ d) % numNames hits only free slots.
+    Returns (displacements, slots) with slots[slot] = index of the name.
+    """
+    count = len(names)
+    if count == 0:
+        return [], []
+    num_buckets = max(1, (count + 2) // 3)
+    hashes = [hash_name(name) for name in names]
+    buckets = [[] for _ in range(num_buckets)]
+    for index, h in enumerate(hashes):
+        buckets[(h >> 32) % num_buckets].append(index)
+
+    displacements = [0] * num_buckets
+    slots = [None] * count
+    for bucket in sorted(range(num_buckets), key=lambda b: -len(buckets[b])):
+        members = buckets[bucket]
+        if not members:
+            break
+        d = 0
+        while True:
+            taken = [mix_hash((hashes[i] & MASK32) ^ d) % count for i in members]
+            if len(set(taken)) == len(taken) and all(slots[s] is None for s in taken):
+                break
+            d += 1
+            if d > MASK32:
+                raise ValueError('no perfect hash found, duplicate body names?')
+        displacements[bucket] = d
+        for i, s in zip(members, taken):
+            slots[s] = i
+    return displacements, slots
+
+
+def int_value(value):
+    # strings are read like atoi(), as the loaders do: leading digits, else 0
+    if isinstance(value, str):
+        match = re.match(r'\s*[+-]?\d+', value)
+        return int(match.group()) if match else 0
+    return int(value)
+
+
+def read_plist(path, scale):
+    with open(path, 'rb') as f:
+        root = plistlib.load(f)
+
+    metadata = root.get('metadata', {})
+    if int(metadata.get('format', 1)) != 1:
+        raise ValueError('%s: format not supported' % path)
+
+    bodies = root['bodies']
+    box2d = any('filter_categoryBits' in fixture
+                for body in bodies.values() for fixture in body['fixtures'])
+
+    pack = Pack()
+    if box2d:
+        pack.ptm_ratio = float(metadata['ptm_ratio'])
+        divisor = pack.ptm_ratio
+    else:
+        divisor = scale
+
+    for name in sorted(bodies, key=lambda n: n.encode('utf-8')):
+        body = bodies[name]
+        anchor = parse_point(body['anchorpoint'])
+        flags = 0
+        if body.get('is_dynamic', True):
+            flags |= BODY_DYNAMIC
+        if body.get('affected_by_gravity', True):
+            flags |= BODY_AFFECTED_BY_GRAVITY
+        if body.get('allows_rotation', True):
+            flags |= BODY_ALLOWS_ROTATION
+
+        first_fixture = len(pack.fixtures)
+        for fixture in body['fixtures']:
+            first_polygon = len(pack.polygons)
+            center = (0.0, 0.0)
+            radius = 0.0
+            if fixture['fixture_type'] == 'POLYGON':
+                fixture_type = FIXTURE_POLYGON
+                for polygon in fixture['polygons']:
+                    pack.add_polygon(polygon, divisor)
+            elif fixture['fixture_type'] == 'CIRCLE':
+                fixture_type = FIXTURE_CIRCLE
+                circle = fixture['circle']
+                position = circle.get('position', circle.get('center'))
+                x, y = parse_point(position)
+                center = (x / divisor, y / divisor)
+                radius = float(circle['radius']) / divisor
+            else:
+                raise ValueError('%s: unknown fixture type %s' % (name, fixture['fixture_type']))
+
+            if box2d:
+                properties = (
+                    int_value(fixture['filter_groupIndex']),
+                    int_value(fixture['filter_categoryBits']) & 0xffffffff,
+                    int_value(fixture['filter_maskBits']) & 0xffffffff,
+                    0,
+                    1 if int_value(fixture['isSensor']) else 0,
+                    int_value(fixture.get('userdataCbValue', '')),
+                    0)
+            else:
+                properties = (
+                    int_value(fixture['group']),
+                    int_value(fixture['category_mask']) & 0xffffffff,
+                    int_value(fixture['collision_mask']) & 0xffffffff,
+                    int_value(fixture['contact_test_mask']) & 0xffffffff,
+                    0,
+                    0,
+                    int_value(fixture['tag']))
+            group, category, collision, contact_test, sensor, callback, tag = properties
+
+            pack.fixtures.append({
+                'fixtureType': fixture_type,
+                'density': f32(fixture['density']),
+                'restitution': f32(fixture['restitution']),
+                'friction': f32(fixture['friction']),
+                'tag': tag,
+                'group': group,
+                'categoryMask': category,
+                'collisionMask': collision,
+                'contactTestMask': contact_test,
+                'isSensor': sensor,
+                'callbackData': callback,
+                'centerX': f32(center[0]),
+                'centerY': f32(center[1]),
+                'radius': f32(radius),
+                'firstPolygon': first_polygon,
+                'numPolygons': len(pack.polygons) - first_polygon,
+            })
+
+        pack.names.append(name)
+        pack.bodies.append({
+            'anchorX': f32(anchor[0]),
+            'anchorY': f32(anchor[1]),
+            'flags': flags,
+            'linearDamping': f32(body.get('linear_damping', 0)),
+            'angularDamping': f32(body.get('angular_damping', 0)),
+            'velocityLimit': f32(body.get('velocity_limit', 0)),
+            'angularVelocityLimit': f32(body.get('angular_velocity_limit', 0)),
+            'firstFixture': first_fixture,
+            'numFixtures': len(pack.fixtures) - first_fixture,
+        })
+
+    return pack
+
+
+FIXTURE_FIELDS = ('fixtureType', 'density', 'restitution', 'friction', 'tag', 'group',
+                  'categoryMask', 'collisionMask', 'contactTestMask', 'isSensor', 'callbackData',
+                  'centerX', 'centerY', 'radius', 'firstPolygon', 'numPolygons')
+BODY_FIELDS = ('anchorX', 'anchorY', 'flags', 'linearDamping', 'angularDamping',
+               'velocityLimit', 'angularVelocityLimit', 'firstFixture', 'numFixtures')
+FLOAT_FIELDS = {'density', 'restitution', 'friction', 'centerX', 'centerY', 'radius',
+                'anchorX', 'anchorY', 'linearDamping', 'angularDamping', 'velocityLimit',
+                'angularVelocityLimit'}
+UNSIGNED_FIELDS = {'fixtureType', 'categoryMask', 'collisionMask', 'contactTestMask',
+                   'isSensor', 'flags', 'firstPolygon', 'numPolygons', 'firstFixture', 'numFixtures'}
+
+
+def cpp_float(value):
+    # shortest text that reads back as the same float
+    for precision in range(6, 10):
+        text = '%.*g' % (precision, value)
+        if f32(text) == value:
+            break
+    if 'e' not in text and '.' not in text and 'inf' not in text:
+        text += '.0'
+    return text + 'f'
+
+
+def cpp_value(field, value):
+    if field in FLOAT_FIELDS:
+        return cpp_float(value)
+    if field in UNSIGNED_FIELDS:
+        return '%du' % value
+    return '%d' % value
+
+
+def cpp_string(data):
+    out = []
+    for byte in data:
+        c = chr(byte)
+        if c == '"' or c == '\\':
+            out.append('\\' + c)
+        elif 32 <= byte < 127:
+            out.append(c)
+        else:
+            # octal escapes never swallow following characters beyond three digits
+            out.append('\\%03o' % byte)
+    return '"' + ''.join(out) + '"'
+
+
+def write_header(pack, out, name, source):
+    names = b''
+    offsets = []
+    for body_name in pack.names:
+        offsets.append(len(names))
+        names += body_name.encode('utf-8') + b'\0'
+
+    def array(ctype, ident, rows):
+        # C++ does not allow empty arrays, views only read numBodies entries
+        if not rows:
+            rows = ['{}'] if ctype != 'uint32_t' else ['0']
+        out.write('    static constexpr %s %s[] = {\n' % (ctype, ident))
+        for row in rows:
+            out.write('        %s,\n' % row)
+        out.write('    };\n\n')
+
+    out.write('// Generated by pe_shape_pack.py from %s - do not edit\n' % os.path.basename(source))
+    out.write('// Include this file in a single source file only.\n\n')
+    out.write('#pragma once\n\n#include "PhysicsShapePack.h"\n\n')
+    out.write('namespace %s\n{\n' % name)
+    out.write('    static constexpr char names[] =\n')
+    for body_name in pack.names:
+        out.write('        %s\n' % cpp_string(body_name.encode('utf-8') + b'\0'))
+    if not pack.names:
+        out.write('        ""\n')
+    out.write('        ;\n\n')
+    array('uint32_t', 'nameOffsets', ['%du' % o for o in offsets])
+    array('PhysicsShapePack::Body', 'bodies',
+          ['{ %s }' % ', '.join(cpp_value(f, b[f]) for f in BODY_FIELDS) for b in pack.bodies])
+    array('PhysicsShapePack::Fixture', 'fixtures',
+          ['{ %s }' % ', '.join(cpp_value(f, fx[f]) for f in FIXTURE_FIELDS) for fx in pack.fixtures])
+    array('PhysicsShapePack::Polygon', 'polygons',
+          ['{ %du, %du }' % p for p in pack.polygons])
+    array('PhysicsShapePack::Vertex', 'vertices',
+          ['{ %s, %s }' % (cpp_float(x), cpp_float(y)) for x, y in pack.vertices])
+    displacements, slots = build_name_index([n.encode('utf-8') for n in pack.names])
+    array('uint32_t', 'hashDisplacements', ['%du' % d for d in displacements])
+    array('uint32_t', 'hashSlots', ['%du' % s for s in slots])
+
+    out.write('    static constexpr PhysicsShapePack::PackView pack = {\n')
+    out.write('        %du, names, nameOffsets, bodies, fixtures, polygons, vertices, %s,\n'
+              % (len(pack.bodies), cpp_float(pack.ptm_ratio)))
+    out.write('        %du, hashDisplacements, hashSlots\n' % len(displacements))
+    out.write('    };\n}\n')
+
+
+BUNDLE_MAGIC = b'PSCBNDL1'
+
+
+def write_bundle(files, out):
+    """Writes plist files unchanged into one bundle for
+    PhysicsShapeCache::addShapesWithBundle(). All numbers are little endian
+    uint32, offsets are from the start of the bundle:
+
+        magic "PSCBNDL1", number of files,
+        per file: name offset, name length, data offset, data length,
+        the names, the file contents
+    """
+    names = [name.encode('utf-8') for name in files]
+    contents = []
+    for name in files:
+        with open(name, 'rb') as f:
+            contents.append(f.read())
+
+    offset = len(BUNDLE_MAGIC) + 4 + 16 * len(files)
+    table = []
+    for name in names:
+        table.append([offset, len(name)])
+        offset += len(name)
+    for i, data in enumerate(contents):
+        table[i] += [offset, len(data)]
+        offset += len(data)
+
+    out.write(BUNDLE_MAGIC)
+    out.write(struct.pack('<I', len(files)))
+    for entry in table:
+        out.write(struct.pack('<4I', *entry))
+    for name in names:
+        out.write(name)
+    for data in contents:
+        out.write(data)
+
+
+COMPRESSED_MAGIC = b'PSCZLIB1'
+
+
+def write_compressed(data, out):
+    """Writes a plist or bundle as a zlib stream, inflated while it is read
+    by PhysicsShapePack::CompressedFileReader. All numbers are little endian
+    uint32:
+
+        magic "PSCZLIB1", content length, compressed length, zlib stream
+    """
+    compressed = zlib.compress(data, 9)
+    out.write(COMPRESSED_MAGIC)
+    out.write(struct.pack('<2I', len(data), len(compressed)))
+    out.write(compressed)
+
+
+def main(argv):
+    parser = argparse.ArgumentParser(description='Converts PhysicsEditor plist files into shape packs.')
+    sub = parser.add_subparsers(dest='command')
+    sub.required = True
+
+    header = sub.add_parser('header', help='write a C++ header with constexpr shape records')
+    header.add_argument('plist')
+    header.add_argument('-o', '--output', required=True)
+    header.add_argument('--name', required=True, help='C++ namespace of the generated records')
+    header.add_argument('--scale', type=float, default=1.0,
+                        help='content scale factor the cocos2d-x coordinates are divided by')
+
+    bundle = sub.add_parser('bundle', help='combine plist files into one file read with a single access')
+    bundle.add_argument('plists', nargs='+',
+                        help='files to add, stored under the paths given here')
+    bundle.add_argument('-o', '--output', required=True)
+
+    compress = sub.add_parser('compress', help='compress a plist or bundle, use the extension .pscz')
+    compress.add_argument('input')
+    compress.add_argument('-o', '--output', required=True)
+
+    args = parser.parse_args(argv)
+    if args.command == 'header':
+        pack = read_plist(args.plist, args.scale)
+        with open(args.output, 'w', newline='\n') as out:
+            write_header(pack, out, args.name, args.plist)
+    elif args.command == 'bundle':
+        if len(set(args.plists)) != len(args.plists):
+            sys.exit('error: a file is listed twice')
+        with open(args.output, 'wb') as out:
+            write_bundle(args.plists, out)
+    elif args.command == 'compress':
+        with open(args.input, 'rb') as f:
+            data = f.read()
+        if len(data) > 0xffffffff:
+            sys.exit('error: input is larger than 4 GB')
+        with open(args.output, 'wb') as out:
+            write_compressed(data, out)
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main(sys.argv[1:]))